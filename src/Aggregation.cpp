@@ -0,0 +1,72 @@
+#include "Aggregation.hpp"
+#include <string>
+#include <algorithm>
+
+void addToSummary(BlockSummary& summary, const Record& r)
+{
+    if (summary.count == 0)
+    {
+        summary = {r.timestamp, r.timestamp, 1, r.value, r.value, r.value, r.value, r.value};
+        return;
+    }
+
+    summary.lastTimestamp = r.timestamp;
+    summary.count += 1;
+    summary.min = std::min(summary.min, r.value);
+    summary.max = std::max(summary.max, r.value);
+    summary.sum += r.value;
+    summary.last = r.value;
+}
+
+void mergeSummary(BlockSummary& summary, const BlockSummary& other)
+{
+    if (other.count == 0) return;
+    if (summary.count == 0)
+    {
+        summary = other;
+        return;
+    }
+
+    summary.lastTimestamp = other.lastTimestamp;
+    summary.count += other.count;
+    summary.min = std::min(summary.min, other.min);
+    summary.max = std::max(summary.max, other.max);
+    summary.sum += other.sum;
+    summary.last = other.last;
+}
+
+std::optional<double> evaluate(const BlockSummary& summary, AggregateFunction fn)
+{
+    if (fn == AggregateFunction::Count) return static_cast<double>(summary.count);
+    if (summary.count == 0) return std::nullopt;
+
+    switch (fn)
+    {
+        case AggregateFunction::Sum:
+            return summary.sum;
+        case AggregateFunction::Min:
+            return summary.min;
+        case AggregateFunction::Max:
+            return summary.max;
+        case AggregateFunction::Avg:
+            return summary.sum / static_cast<double>(summary.count);
+        case AggregateFunction::First:
+            return summary.first;
+        case AggregateFunction::Last:
+            return summary.last;
+        default:
+            return std::nullopt;
+    }
+}
+
+std::optional<AggregateFunction> parseAggregateFunction(const std::string& name)
+{
+    if (name == "count") return AggregateFunction::Count;
+    if (name == "sum") return AggregateFunction::Sum;
+    if (name == "min") return AggregateFunction::Min;
+    if (name == "max") return AggregateFunction::Max;
+    if (name == "avg") return AggregateFunction::Avg;
+    if (name == "first") return AggregateFunction::First;
+    if (name == "last") return AggregateFunction::Last;
+    return std::nullopt;
+}
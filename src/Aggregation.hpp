@@ -0,0 +1,33 @@
+#pragma once
+#include <optional>
+#include <string>
+#include "Record.hpp"
+#include "BlockSummary.hpp"
+
+
+enum class AggregateFunction
+{
+    Count,
+    Sum,
+    Min,
+    Max,
+    Avg,
+    First,
+    Last
+};
+
+//one bucket of a downsample query; empty buckets are not reported
+struct DownsampleRow
+{
+    int64_t bucketStart;
+    double value;
+};
+
+//summaries are folded in timestamp order, so first and last follow the order of the calls
+void addToSummary(BlockSummary& summary, const Record& r);
+void mergeSummary(BlockSummary& summary, const BlockSummary& other);
+
+//count is 0 over an empty summary; every other function has no value
+std::optional<double> evaluate(const BlockSummary& summary, AggregateFunction fn);
+
+std::optional<AggregateFunction> parseAggregateFunction(const std::string& name);
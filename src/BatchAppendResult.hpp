@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+
+//outcome of appendBatch: accepted records are queued in batch order, rejected ones are dropped
+struct BatchAppendResult
+{
+    size_t accepted;
+    size_t rejected;
+};
@@ -0,0 +1,732 @@
+#include "BlockFile.hpp"
+#include "Checksum.hpp"
+#include "Compression.hpp"
+#include "SegmentFiles.hpp"
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace
+{
+    //deferred mode: sealed records the head file may keep before a seal makes the syncs it put off
+    const size_t maxStaleHeadBlocks = 16;
+
+    void verifyRows(const Record* records, size_t count, ChecksumAlgorithm algorithm)
+    {
+        size_t bad = verifyRecords(records, count, algorithm);
+        if (bad != count) {
+            throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(records[bad].timestamp));
+        }
+    }
+}
+
+BlockFile::BlockFile(const std::string& filename, ReadMode mode, bool compress, bool deferSync, bool readOnly) :
+    filename(filename), headFilename(filename + ".head"), compress(compress), deferSync(deferSync), readOnly(readOnly)
+{
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+
+    TSDBHeader header{};
+    BlockFileHeader fileHeader{};
+    if (!inFile.read(reinterpret_cast<char*>(&header), sizeof(TSDBHeader)) ||
+        !inFile.read(reinterpret_cast<char*>(&fileHeader), sizeof(BlockFileHeader))) {
+        throw std::runtime_error("Failed to read block file header: " + filename);
+    }
+    inFile.close();
+
+    //checksum settings are properties of the file, fixed when it was created
+    checksumAlgorithm = static_cast<ChecksumAlgorithm>(header.reserved[0]);
+    blockChecksums = header.reserved[1] == static_cast<uint8_t>(ChecksumGranularity::PerBlock);
+
+    if (fileHeader.blockCapacity == 0) {
+        throw std::runtime_error("Invalid block capacity: " + filename);
+    }
+
+    blockCapacity = fileHeader.blockCapacity;
+    rawBlockBytes = sizeof(BlockHeader) + blockCapacity * columnarRecordSize;
+
+    reader = std::make_unique<FileReader>(filename, mode);
+
+    recoverBlocks();
+
+    loadHead();
+    if (readOnly) return;
+
+    fd = ::open(filename.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open data file");
+    }
+
+    if (headFd < 0)
+    {
+        headFd = ::open(headFilename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (headFd < 0) {
+            throw std::runtime_error("Failed to open head file: " + headFilename);
+        }
+    }
+}
+
+BlockFile::~BlockFile()
+{
+    if (fd >= 0) ::close(fd);
+    if (headFd >= 0) ::close(headFd);
+}
+
+void BlockFile::create(const std::string& filename, const TSDBHeader& header, uint32_t blockCapacity)
+{
+    BlockFileHeader fileHeader{blockCapacity, 0};
+
+    std::ofstream outFile(filename, std::ios::binary | std::ios::app);
+    if (!outFile.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + filename);
+    }
+    outFile.write(reinterpret_cast<const char*>(&header), sizeof(TSDBHeader));
+    outFile.write(reinterpret_cast<const char*>(&fileHeader), sizeof(BlockFileHeader));
+    outFile.close();
+
+    //a head file left behind by an earlier database of the same name must not be replayed
+    std::filesystem::remove(filename + ".head");
+}
+
+void BlockFile::append(std::span<const Record> batch)
+{
+    if (batch.empty()) return;
+
+    size_t headSize;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        headSize = head.size();
+    }
+
+    size_t sealCount = (headSize + batch.size()) / blockCapacity;
+    if (sealCount == 0)
+    {
+        writeAll(headFd, batch.data(), batch.size() * sizeof(Record));
+
+        std::lock_guard<std::mutex> lock(headMutex);
+        head.insert(head.end(), batch.begin(), batch.end());
+        return;
+    }
+
+    std::vector<Record> combined;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        combined.reserve(head.size() + batch.size());
+        combined.assign(head.begin(), head.end());
+    }
+    combined.insert(combined.end(), batch.begin(), batch.end());
+
+    std::vector<char> encoded;
+    std::vector<BlockInfo> sealed;
+    uint64_t offset = dataEnd;
+    for (size_t block = 0; block < sealCount; ++block)
+    {
+        size_t start = encoded.size();
+        encodeBlock(combined.data() + block * blockCapacity, encoded);
+
+        BlockInfo info{offset, {}};
+        std::memcpy(&info.header, encoded.data() + start, sizeof(BlockHeader));
+        sealed.push_back(info);
+        offset += encoded.size() - start;
+    }
+
+    //blocks become durable before the head shrinks; recovery drops head records a sealed block already holds
+    writeAll(fd, encoded.data(), encoded.size());
+    std::vector<Record> remainder(combined.begin() + static_cast<std::ptrdiff_t>(sealCount * blockCapacity), combined.end());
+    if (deferSync)
+    {
+        //the batch goes to the head file whole, so whichever of the blocks and the head reach disk, recovery
+        //finds every record in one of them
+        writeAll(headFd, batch.data(), batch.size() * sizeof(Record));
+        blocksUnsynced = true;
+        staleHeadRecords += sealCount * blockCapacity;
+    }
+    else
+    {
+        if (::fsync(fd) != 0) {
+            throw std::runtime_error("fsync failed");
+        }
+        rewriteHead(remainder);
+    }
+    dataEnd = offset;
+
+    reader->grow(dataEnd);
+
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        blocks.insert(blocks.end(), sealed.begin(), sealed.end());
+        head = std::move(remainder);
+    }
+
+    //without syncs the head file would grow with everything written, so it is trimmed every few blocks
+    if (staleHeadRecords >= maxStaleHeadBlocks * blockCapacity) syncSealed(true);
+}
+
+std::vector<Record> BlockFile::readAll() const
+{
+    std::vector<BlockInfo> sealed;
+    std::vector<Record> headCopy;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        sealed = blocks;
+        headCopy = head;
+    }
+
+    std::vector<Record> records(sealed.size() * blockCapacity);
+    for (size_t block = 0; block < sealed.size(); ++block)
+    {
+        decodeBlock(sealed[block], records.data() + block * blockCapacity);
+    }
+
+    records.insert(records.end(), headCopy.begin(), headCopy.end());
+    return records;
+}
+
+void BlockFile::readRange(size_t startIndex, int64_t startTs, int64_t endTs, std::vector<Record>& out) const
+{
+    auto byTimestamp = [](const Record& r, int64_t ts) { return r.timestamp < ts; };
+
+    size_t sealedCount;
+    std::vector<Record> headPart;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        sealedCount = blocks.size();
+        auto first = std::lower_bound(head.begin(), head.end(), startTs, byTimestamp);
+        auto last = std::upper_bound(first, head.end(), endTs,
+                                     [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+        headPart.assign(first, last);
+    }
+
+    for (size_t block = startIndex / blockCapacity; block < sealedCount; ++block)
+    {
+        if (scanBlock(getBlock(block), startTs, endTs, out)) return;
+    }
+
+    out.insert(out.end(), headPart.begin(), headPart.end());
+}
+
+size_t BlockFile::readRecords(size_t index, std::span<Record> out) const
+{
+    size_t n = 0;
+    while (n < out.size())
+    {
+        BlockInfo block;
+        {
+            std::lock_guard<std::mutex> lock(headMutex);
+            size_t sealedRecords = blocks.size() * blockCapacity;
+            if (index >= sealedRecords)
+            {
+                if (index >= sealedRecords + head.size()) break;
+                size_t fromHead = std::min(out.size() - n, sealedRecords + head.size() - index);
+                std::copy_n(head.begin() + static_cast<std::ptrdiff_t>(index - sealedRecords), fromHead, out.begin() + static_cast<std::ptrdiff_t>(n));
+                n += fromHead;
+                break;
+            }
+            block = blocks[index / blockCapacity];
+        }
+
+        size_t from = index % blockCapacity;
+        size_t to = std::min(blockCapacity, from + (out.size() - n));
+        readRows(block, from, to, out.data() + n);
+        n += to - from;
+        index += to - from;
+    }
+    return n;
+}
+
+Record BlockFile::getRecord(size_t index) const
+{
+    BlockInfo block;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        size_t sealedRecords = blocks.size() * blockCapacity;
+        if (index >= sealedRecords) return head.at(index - sealedRecords);
+        block = blocks[index / blockCapacity];
+    }
+
+    Record record;
+    readRows(block, index % blockCapacity, index % blockCapacity + 1, &record);
+    return record;
+}
+
+int64_t BlockFile::getTimestamp(size_t index) const
+{
+    BlockInfo block;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        size_t sealedRecords = blocks.size() * blockCapacity;
+        if (index >= sealedRecords) return head.at(index - sealedRecords).timestamp;
+        block = blocks[index / blockCapacity];
+    }
+
+    //sparse index lookups land on block boundaries, which the block header already answers
+    if (index % blockCapacity == 0) return block.header.firstTimestamp;
+
+    Record record;
+    readRows(block, index % blockCapacity, index % blockCapacity + 1, &record);
+    return record.timestamp;
+}
+
+std::optional<Record> BlockFile::getLastRecord() const
+{
+    BlockInfo block;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        if (!head.empty()) return head.back();
+        if (blocks.empty()) return std::nullopt;
+        block = blocks.back();
+    }
+
+    Record last;
+    readRows(block, blockCapacity - 1, blockCapacity, &last);
+    return last;
+}
+
+size_t BlockFile::getRecordCount() const
+{
+    std::lock_guard<std::mutex> lock(headMutex);
+    return blocks.size() * blockCapacity + head.size();
+}
+
+size_t BlockFile::getBlockCapacity() const
+{
+    return blockCapacity;
+}
+
+size_t BlockFile::getSealedBlockCount() const
+{
+    std::lock_guard<std::mutex> lock(headMutex);
+    return blocks.size();
+}
+
+uint64_t BlockFile::dataStart() const
+{
+    return sizeof(TSDBHeader) + sizeof(BlockFileHeader);
+}
+
+BlockFile::BlockInfo BlockFile::getBlock(size_t block) const
+{
+    std::lock_guard<std::mutex> lock(headMutex);
+    return blocks[block];
+}
+
+void BlockFile::recoverBlocks()
+{
+    uint64_t fileSize = reader->size();
+    if (fileSize < dataStart()) {
+        throw std::runtime_error("File too small to contain valid TSDB header: " + filename);
+    }
+
+    //walk the block headers; the first torn or inconsistent header marks the end of the valid data
+    uint64_t offset = dataStart();
+    while (offset + sizeof(BlockHeader) <= fileSize)
+    {
+        BlockInfo block{offset, {}};
+        reader->read(&block.header, sizeof(BlockHeader), offset);
+
+        const BlockHeader& h = block.header;
+        bool valid = h.checksum == headerChecksum(h) &&
+                     h.count == blockCapacity &&
+                     validPayloadSize(h) &&
+                     offset + sizeof(BlockHeader) + h.payloadBytes <= fileSize;
+        if (!valid) break;
+
+        blocks.push_back(block);
+        offset += sizeof(BlockHeader) + h.payloadBytes;
+    }
+
+    //blocks from the last flush may have been torn mid-payload even when their headers landed, so the
+    //tail is verified in full and cut back to the last block whose checksums hold; until the head file
+    //is rewritten those records are still in it
+    while (!blocks.empty() && !validPayload(blocks.back()))
+    {
+        offset = blocks.back().offset;
+        blocks.pop_back();
+    }
+
+    dataEnd = offset;
+    if (dataEnd != fileSize && !readOnly)
+    {
+        int rwFd = ::open(filename.c_str(), O_WRONLY);
+        if (rwFd < 0) {
+            throw std::runtime_error("Failed to open file for truncation");
+        }
+        if (::ftruncate(rwFd, static_cast<off_t>(dataEnd)) != 0) {
+            ::close(rwFd);
+            throw std::runtime_error("Failed to truncate TSDB file");
+        }
+        ::close(rwFd);
+    }
+}
+
+bool BlockFile::validPayloadSize(const BlockHeader& header) const
+{
+    switch (header.encoding)
+    {
+        case RawColumns:
+            return header.payloadBytes == blockCapacity * columnarRecordSize;
+        case GorillaColumns:
+            return header.payloadBytes >= sizeof(PayloadHeader);
+        case ChecksummedColumns:
+            return header.payloadBytes == sizeof(PayloadHeader) + blockCapacity * (sizeof(int64_t) + sizeof(double));
+        default:
+            return false;
+    }
+}
+
+bool BlockFile::validPayload(const BlockInfo& block) const
+{
+    try
+    {
+        std::vector<Record> records(blockCapacity);
+        decodeBlock(block, records.data());
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+void BlockFile::loadHead()
+{
+    std::ifstream inFile(headFilename, std::ios::binary | std::ios::ate);
+    if (!inFile.is_open()) return;
+
+    std::streamoff size = inFile.tellg();
+    head.resize(static_cast<size_t>(size) / sizeof(Record));
+    inFile.seekg(0, std::ios::beg);
+    if (!head.empty() && !inFile.read(reinterpret_cast<char*>(head.data()), static_cast<std::streamsize>(head.size() * sizeof(Record)))) {
+        throw std::runtime_error("Failed to read head file: " + headFilename);
+    }
+    inFile.close();
+
+    bool dirty = static_cast<size_t>(size) % sizeof(Record) != 0;
+
+    //head records are verified once here; a record that fails its crc ends the head like a torn write
+    size_t firstBad = verifyRecords(head.data(), head.size(), checksumAlgorithm);
+    if (firstBad != head.size())
+    {
+        head.resize(firstBad);
+        dirty = true;
+    }
+
+    //head records a sealed block already holds are whole blocks ending with the last one. records after them
+    //may repeat its last timestamp, so the count up to that timestamp only bounds them, and the block checks it
+    if (!blocks.empty())
+    {
+        int64_t lastSealed = blocks.back().header.lastTimestamp;
+        auto firstUnsealed = std::upper_bound(head.begin(), head.end(), lastSealed,
+                                              [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+        size_t stale = static_cast<size_t>(firstUnsealed - head.begin()) / blockCapacity * blockCapacity;
+        if (stale > 0)
+        {
+            std::vector<Record> lastBlock(blockCapacity);
+            decodeBlock(blocks.back(), lastBlock.data());
+            auto sameRecord = [](const Record& a, const Record& b) {
+                return a.timestamp == b.timestamp && std::memcmp(&a.value, &b.value, sizeof(double)) == 0;
+            };
+            while (stale > 0 && !std::equal(lastBlock.begin(), lastBlock.end(), head.begin() + static_cast<std::ptrdiff_t>(stale - blockCapacity), sameRecord))
+            {
+                stale -= blockCapacity;
+            }
+        }
+        if (stale > 0)
+        {
+            head.erase(head.begin(), head.begin() + static_cast<std::ptrdiff_t>(stale));
+            dirty = true;
+        }
+    }
+
+    if (dirty && !readOnly) rewriteHead(head);
+}
+
+void BlockFile::sync(bool dataOnly)
+{
+    //without deferred syncs sealed blocks are synced as they are written, so only head appends can be outstanding
+    if (blocksUnsynced || staleHeadRecords > 0)
+    {
+        syncSealed(dataOnly);
+        return;
+    }
+    if ((dataOnly ? ::fdatasync(headFd) : ::fsync(headFd)) != 0) {
+        throw std::runtime_error("fsync failed");
+    }
+}
+
+std::vector<int> BlockFile::releaseDescriptors()
+{
+    //sealed records the head file still holds are dropped when the file is next opened
+    std::vector<int> released{fd, headFd};
+    fd = -1;
+    headFd = -1;
+    return released;
+}
+
+void BlockFile::syncSealed(bool dataOnly)
+{
+    //the blocks reach disk before the head file drops the records they hold, which leaves it synced too
+    if (blocksUnsynced && (dataOnly ? ::fdatasync(fd) : ::fsync(fd)) != 0) {
+        throw std::runtime_error("fsync failed");
+    }
+    blocksUnsynced = false;
+
+    std::vector<Record> remainder;
+    {
+        std::lock_guard<std::mutex> lock(headMutex);
+        remainder = head;
+    }
+    rewriteHead(remainder);
+    staleHeadRecords = 0;
+}
+
+void BlockFile::rewriteHead(const std::vector<Record>& records)
+{
+    std::string tmpFilename = headFilename + ".tmp";
+    int tmpFd = ::open(tmpFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (tmpFd < 0) {
+        throw std::runtime_error("Failed to open head file: " + tmpFilename);
+    }
+
+    if (!records.empty()) writeAll(tmpFd, records.data(), records.size() * sizeof(Record));
+    if (::fsync(tmpFd) != 0) {
+        ::close(tmpFd);
+        throw std::runtime_error("fsync failed");
+    }
+    ::close(tmpFd);
+
+    if (::rename(tmpFilename.c_str(), headFilename.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace head file: " + headFilename);
+    }
+    syncDirectoryOf(headFilename);
+
+    if (headFd >= 0) ::close(headFd);
+    headFd = ::open(headFilename.c_str(), O_WRONLY | O_APPEND);
+    if (headFd < 0) {
+        throw std::runtime_error("Failed to open head file: " + headFilename);
+    }
+}
+
+std::vector<char> BlockFile::readPayload(const BlockInfo& block) const
+{
+    std::vector<char> payload(block.header.payloadBytes);
+    reader->read(payload.data(), payload.size(), block.offset + sizeof(BlockHeader));
+
+    if (block.header.encoding == RawColumns) return payload;
+
+    PayloadHeader payloadHeader{};
+    if (payload.size() < sizeof(PayloadHeader)) {
+        throw std::runtime_error("Corrupted compressed block");
+    }
+    std::memcpy(&payloadHeader, payload.data(), sizeof(PayloadHeader));
+
+    const char* body = payload.data() + sizeof(uint32_t);
+    if (checksumBytes(body, payload.size() - sizeof(uint32_t), checksumAlgorithm) != payloadHeader.checksum ||
+        payloadHeader.timestampBytes > payload.size() - sizeof(PayloadHeader)) {
+        throw std::runtime_error("Data corruption detected in block starting at timestamp: " + std::to_string(block.header.firstTimestamp));
+    }
+    return payload;
+}
+
+void BlockFile::decodeBlock(const BlockInfo& block, Record* out) const
+{
+    std::vector<char> payload = readPayload(block);
+
+    if (block.header.encoding == RawColumns)
+    {
+        const char* timestamps = payload.data();
+        const char* values = timestamps + blockCapacity * sizeof(int64_t);
+        const char* crcs = values + blockCapacity * sizeof(double);
+        for (size_t i = 0; i < blockCapacity; ++i)
+        {
+            std::memcpy(&out[i].timestamp, timestamps + i * sizeof(int64_t), sizeof(int64_t));
+            std::memcpy(&out[i].value, values + i * sizeof(double), sizeof(double));
+            std::memcpy(&out[i].crc, crcs + i * sizeof(uint32_t), sizeof(uint32_t));
+        }
+        verifyRows(out, blockCapacity, checksumAlgorithm);
+        return;
+    }
+
+    std::vector<int64_t> timestamps(blockCapacity);
+    std::vector<double> values(blockCapacity);
+    decodeColumns(block, payload, blockCapacity, timestamps.data(), values.data());
+
+    for (size_t i = 0; i < blockCapacity; ++i)
+    {
+        out[i] = Record{timestamps[i], values[i], 0};
+    }
+
+    //the payload checksum already covered these rows; per-record crcs are only rebuilt for files that promise them
+    if (!blockChecksums) fillRecordChecksums(out, blockCapacity, checksumAlgorithm);
+}
+
+void BlockFile::decodeColumns(const BlockInfo& block, const std::vector<char>& payload, size_t rows, int64_t* timestamps, double* values) const
+{
+    PayloadHeader payloadHeader{};
+    std::memcpy(&payloadHeader, payload.data(), sizeof(PayloadHeader));
+    const char* timestampData = payload.data() + sizeof(PayloadHeader);
+    const char* valueData = timestampData + payloadHeader.timestampBytes;
+    size_t valueBytes = payload.size() - sizeof(PayloadHeader) - payloadHeader.timestampBytes;
+
+    if (block.header.encoding == GorillaColumns)
+    {
+        if (timestamps) decodeTimestamps(timestampData, payloadHeader.timestampBytes, blockCapacity, timestamps);
+        if (values) decodeValues(valueData, valueBytes, rows, values);
+        return;
+    }
+
+    if (timestamps) std::memcpy(timestamps, timestampData, blockCapacity * sizeof(int64_t));
+    if (values) std::memcpy(values, valueData, rows * sizeof(double));
+}
+
+void BlockFile::readRows(const BlockInfo& block, size_t from, size_t to, Record* out) const
+{
+    //a payload checksum can only be checked over the whole block
+    if (block.header.encoding != RawColumns)
+    {
+        std::vector<Record> decoded(blockCapacity);
+        decodeBlock(block, decoded.data());
+        std::copy(decoded.begin() + static_cast<std::ptrdiff_t>(from), decoded.begin() + static_cast<std::ptrdiff_t>(to), out);
+        return;
+    }
+
+    size_t n = to - from;
+    std::vector<int64_t> timestamps(n);
+    std::vector<double> values(n);
+    std::vector<uint32_t> crcs(n);
+
+    uint64_t columns = block.offset + sizeof(BlockHeader);
+    reader->read(timestamps.data(), n * sizeof(int64_t), columns + from * sizeof(int64_t));
+    reader->read(values.data(), n * sizeof(double), columns + blockCapacity * sizeof(int64_t) + from * sizeof(double));
+    reader->read(crcs.data(), n * sizeof(uint32_t), columns + blockCapacity * (sizeof(int64_t) + sizeof(double)) + from * sizeof(uint32_t));
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i].timestamp = timestamps[i];
+        out[i].value = values[i];
+        out[i].crc = static_cast<int32_t>(crcs[i]);
+    }
+    verifyRows(out, n, checksumAlgorithm);
+}
+
+bool BlockFile::scanBlock(const BlockInfo& block, int64_t startTs, int64_t endTs, std::vector<Record>& out) const
+{
+    if (block.header.lastTimestamp < startTs) return false;
+
+    //only the timestamp column is searched; values are fetched or decoded up to the last matching row
+    std::vector<int64_t> timestamps(blockCapacity);
+    std::vector<char> payload;
+
+    if (block.header.encoding == RawColumns)
+    {
+        reader->read(timestamps.data(), blockCapacity * sizeof(int64_t), block.offset + sizeof(BlockHeader));
+    }
+    else
+    {
+        payload = readPayload(block);
+        decodeColumns(block, payload, 0, timestamps.data(), nullptr);
+    }
+
+    auto first = std::lower_bound(timestamps.begin(), timestamps.end(), startTs);
+    auto last = std::upper_bound(first, timestamps.end(), endTs);
+    size_t from = static_cast<size_t>(first - timestamps.begin());
+    size_t to = static_cast<size_t>(last - timestamps.begin());
+
+    if (from < to)
+    {
+        size_t offset = out.size();
+        out.resize(offset + (to - from));
+
+        if (block.header.encoding == RawColumns)
+        {
+            readRows(block, from, to, out.data() + offset);
+        }
+        else
+        {
+            std::vector<double> values(to);
+            decodeColumns(block, payload, to, nullptr, values.data());
+            for (size_t i = from; i < to; ++i)
+            {
+                out[offset + i - from] = Record{timestamps[i], values[i], 0};
+            }
+            if (!blockChecksums) fillRecordChecksums(out.data() + offset, to - from, checksumAlgorithm);
+        }
+    }
+
+    return to < blockCapacity;
+}
+
+void BlockFile::encodeBlock(const Record* records, std::vector<char>& out) const
+{
+    BlockHeader blockHeader{};
+    blockHeader.count = static_cast<uint32_t>(blockCapacity);
+    blockHeader.firstTimestamp = records[0].timestamp;
+    blockHeader.lastTimestamp = records[blockCapacity - 1].timestamp;
+
+    size_t offset = out.size();
+    out.resize(offset + sizeof(BlockHeader));
+
+    if (!compress && !blockChecksums)
+    {
+        blockHeader.encoding = RawColumns;
+        out.resize(offset + rawBlockBytes);
+
+        char* timestamps = out.data() + offset + sizeof(BlockHeader);
+        char* values = timestamps + blockCapacity * sizeof(int64_t);
+        char* crcs = values + blockCapacity * sizeof(double);
+        for (size_t i = 0; i < blockCapacity; ++i)
+        {
+            std::memcpy(timestamps + i * sizeof(int64_t), &records[i].timestamp, sizeof(int64_t));
+            std::memcpy(values + i * sizeof(double), &records[i].value, sizeof(double));
+            std::memcpy(crcs + i * sizeof(uint32_t), &records[i].crc, sizeof(uint32_t));
+        }
+    }
+    else
+    {
+        PayloadHeader payloadHeader{};
+        out.resize(out.size() + sizeof(PayloadHeader));
+        size_t timestampStart = out.size();
+
+        if (compress)
+        {
+            blockHeader.encoding = GorillaColumns;
+            encodeTimestamps(records, blockCapacity, out);
+            payloadHeader.timestampBytes = static_cast<uint32_t>(out.size() - timestampStart);
+            encodeValues(records, blockCapacity, out);
+        }
+        else
+        {
+            blockHeader.encoding = ChecksummedColumns;
+            payloadHeader.timestampBytes = static_cast<uint32_t>(blockCapacity * sizeof(int64_t));
+            out.resize(timestampStart + blockCapacity * (sizeof(int64_t) + sizeof(double)));
+
+            char* timestamps = out.data() + timestampStart;
+            char* values = timestamps + blockCapacity * sizeof(int64_t);
+            for (size_t i = 0; i < blockCapacity; ++i)
+            {
+                std::memcpy(timestamps + i * sizeof(int64_t), &records[i].timestamp, sizeof(int64_t));
+                std::memcpy(values + i * sizeof(double), &records[i].value, sizeof(double));
+            }
+        }
+
+        char* payload = out.data() + offset + sizeof(BlockHeader);
+        std::memcpy(payload + sizeof(uint32_t), &payloadHeader.timestampBytes, sizeof(uint32_t));
+        payloadHeader.checksum = checksumBytes(payload + sizeof(uint32_t), out.size() - (offset + sizeof(BlockHeader) + sizeof(uint32_t)), checksumAlgorithm);
+        std::memcpy(payload, &payloadHeader.checksum, sizeof(uint32_t));
+    }
+
+    blockHeader.payloadBytes = static_cast<uint32_t>(out.size() - offset - sizeof(BlockHeader));
+    blockHeader.checksum = headerChecksum(blockHeader);
+    std::memcpy(out.data() + offset, &blockHeader, sizeof(BlockHeader));
+}
+
+uint32_t BlockFile::headerChecksum(BlockHeader blockHeader) const
+{
+    blockHeader.checksum = 0;
+    return checksumBytes(&blockHeader, sizeof(BlockHeader), checksumAlgorithm);
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include "Record.hpp"
+#include "TSDBHeader.hpp"
+#include "BlockFormat.hpp"
+#include "FileReader.hpp"
+
+class BlockFile
+{
+public:
+    //constructor; with deferSync, sealing leaves its syncs to the next sync call. a read only file is
+    //recovered in memory and never written
+    BlockFile(const std::string& filename, ReadMode mode, bool compress, bool deferSync = false, bool readOnly = false);
+
+    //destructor
+    ~BlockFile();
+
+    BlockFile(const BlockFile&) = delete;
+    BlockFile& operator=(const BlockFile&) = delete;
+
+    static void create(const std::string& filename, const TSDBHeader& header, uint32_t blockCapacity);
+
+    //write functions
+    //head appends reach disk on sync; sealing a block syncs it before the head shrinks, unless syncs are
+    //deferred, when the head file keeps the sealed records until a sync has made the blocks durable
+    void append(std::span<const Record> batch);
+    void sync(bool dataOnly);
+
+    //hands over the descriptors of a file that takes no more writes, so it can be synced after it is renamed
+    std::vector<int> releaseDescriptors();
+
+    //read functions
+    std::vector<Record> readAll() const;
+    void readRange(size_t startIndex, int64_t startTs, int64_t endTs, std::vector<Record>& out) const;
+    size_t readRecords(size_t index, std::span<Record> out) const;
+    Record getRecord(size_t index) const;
+    int64_t getTimestamp(size_t index) const;
+    std::optional<Record> getLastRecord() const;
+
+    //getters
+    size_t getRecordCount() const;
+    size_t getBlockCapacity() const;
+    size_t getSealedBlockCount() const;
+
+private:
+    struct BlockInfo
+    {
+        uint64_t offset;
+        BlockHeader header;
+    };
+
+    const std::string filename;
+    const std::string headFilename;
+    const bool compress;
+    const bool deferSync;
+    const bool readOnly;
+    ChecksumAlgorithm checksumAlgorithm;
+    bool blockChecksums;
+    size_t blockCapacity;
+    size_t rawBlockBytes;
+    uint64_t dataEnd;
+    int fd = -1;
+    int headFd = -1;
+    std::unique_ptr<FileReader> reader;
+
+    //deferred mode: blocks written since the last sync, and head file records a sealed block already holds
+    bool blocksUnsynced = false;
+    size_t staleHeadRecords = 0;
+
+    //sealed blocks are immutable; records that do not yet fill a block live in the head file
+    mutable std::mutex headMutex;
+    std::vector<BlockInfo> blocks;
+    std::vector<Record> head;
+
+    //private methods
+    uint64_t dataStart() const;
+    BlockInfo getBlock(size_t block) const;
+    void recoverBlocks();
+    bool validPayloadSize(const BlockHeader& header) const;
+    bool validPayload(const BlockInfo& block) const;
+    void loadHead();
+    void rewriteHead(const std::vector<Record>& records);
+    void syncSealed(bool dataOnly);
+    std::vector<char> readPayload(const BlockInfo& block) const;
+    void decodeBlock(const BlockInfo& block, Record* out) const;
+    void decodeColumns(const BlockInfo& block, const std::vector<char>& payload, size_t rows, int64_t* timestamps, double* values) const;
+    void readRows(const BlockInfo& block, size_t from, size_t to, Record* out) const;
+    bool scanBlock(const BlockInfo& block, int64_t startTs, int64_t endTs, std::vector<Record>& out) const;
+    void encodeBlock(const Record* records, std::vector<char>& out) const;
+    uint32_t headerChecksum(BlockHeader blockHeader) const;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+//version 2 files: TSDBHeader, BlockFileHeader, then sealed blocks of exactly blockCapacity records.
+//a block stores a BlockHeader followed by payloadBytes of column data laid out according to its encoding.
+//the header checksum covers the header alone; compressed and block-checksummed payloads start with
+//a PayloadHeader whose checksum covers the rest of the payload.
+struct BlockFileHeader
+{
+    uint32_t blockCapacity;
+    uint32_t reserved;
+};
+
+struct BlockHeader
+{
+    uint32_t count;
+    uint32_t encoding;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint32_t payloadBytes;
+    uint32_t checksum;
+};
+
+enum BlockEncoding : uint32_t
+{
+    //timestamp, value and crc columns stored verbatim
+    RawColumns = 0,
+    //payload checksum, timestamp stream length, delta-of-delta timestamp stream, XOR value stream
+    GorillaColumns = 1,
+    //payload checksum, timestamp column length, timestamp and value columns without per-record crcs
+    ChecksummedColumns = 2
+};
+
+struct PayloadHeader
+{
+    uint32_t checksum;
+    uint32_t timestampBytes;
+};
+
+constexpr uint16_t columnarRecordSize = sizeof(int64_t) + sizeof(double) + sizeof(uint32_t);
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+
+//fold of the records in one sparse index interval
+struct BlockSummary
+{
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint64_t count;
+    double min;
+    double max;
+    double sum;
+    double first;
+    double last;
+};
@@ -0,0 +1,214 @@
+#include "Checksum.hpp"
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define TSDB_HAVE_SSE42_DISPATCH 1
+#endif
+
+namespace
+{
+    //reflected Castagnoli polynomial
+    const uint32_t crc32cPolynomial = 0x82F63B78;
+
+    //slicing-by-8 tables: table[k][b] is the crc of byte b followed by k zero bytes
+    constexpr std::array<std::array<uint32_t, 256>, 8> makeTables()
+    {
+        std::array<std::array<uint32_t, 256>, 8> tables{};
+        for (uint32_t b = 0; b < 256; ++b)
+        {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? crc32cPolynomial : 0);
+            }
+            tables[0][b] = crc;
+        }
+        for (size_t k = 1; k < 8; ++k)
+        {
+            for (uint32_t b = 0; b < 256; ++b)
+            {
+                uint32_t previous = tables[k - 1][b];
+                tables[k][b] = (previous >> 8) ^ tables[0][previous & 0xFF];
+            }
+        }
+        return tables;
+    }
+
+    constexpr std::array<std::array<uint32_t, 256>, 8> tables = makeTables();
+
+    uint32_t crc32cSoftware(uint32_t crc, const uint8_t* p, size_t bytes)
+    {
+        while (bytes >= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            word ^= crc;
+            crc = tables[7][word & 0xFF] ^ tables[6][(word >> 8) & 0xFF] ^
+                  tables[5][(word >> 16) & 0xFF] ^ tables[4][(word >> 24) & 0xFF] ^
+                  tables[3][(word >> 32) & 0xFF] ^ tables[2][(word >> 40) & 0xFF] ^
+                  tables[1][(word >> 48) & 0xFF] ^ tables[0][word >> 56];
+            p += 8;
+            bytes -= 8;
+        }
+        while (bytes-- > 0)
+        {
+            crc = (crc >> 8) ^ tables[0][(crc ^ *p++) & 0xFF];
+        }
+        return crc;
+    }
+
+    uint32_t recordCrc32cSoftware(const Record& r)
+    {
+        //timestamp and value are adjacent, so the payload is the first 16 bytes of the record
+        return ~crc32cSoftware(~0u, reinterpret_cast<const uint8_t*>(&r), sizeof(r.timestamp) + sizeof(r.value));
+    }
+
+#ifdef TSDB_HAVE_SSE42_DISPATCH
+    __attribute__((target("sse4.2")))
+    uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t bytes)
+    {
+        uint64_t crc64 = crc;
+        while (bytes >= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+            p += 8;
+            bytes -= 8;
+        }
+        crc = static_cast<uint32_t>(crc64);
+        while (bytes-- > 0)
+        {
+            crc = _mm_crc32_u8(crc, *p++);
+        }
+        return crc;
+    }
+
+    __attribute__((target("sse4.2")))
+    uint32_t recordCrc32cHardware(const Record& r)
+    {
+        uint64_t timestamp;
+        uint64_t value;
+        std::memcpy(&timestamp, &r.timestamp, sizeof(timestamp));
+        std::memcpy(&value, &r.value, sizeof(value));
+        uint64_t crc = _mm_crc32_u64(0xFFFFFFFFu, timestamp);
+        crc = _mm_crc32_u64(crc, value);
+        return ~static_cast<uint32_t>(crc);
+    }
+
+    //each record is an independent chain, so the loop keeps several crc32 instructions in flight
+    __attribute__((target("sse4.2")))
+    void recordCrc32cHardwareBatch(const Record* records, size_t count, uint32_t* out)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = recordCrc32cHardware(records[i]);
+        }
+    }
+#endif
+
+    uint32_t recordZlib(const Record& r)
+    {
+        uint32_t crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(&r.timestamp), sizeof(r.timestamp));
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(&r.value), sizeof(r.value));
+        return crc;
+    }
+}
+
+bool crc32cHardwareAvailable()
+{
+#ifdef TSDB_HAVE_SSE42_DISPATCH
+    static const bool available = __builtin_cpu_supports("sse4.2");
+    return available;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32c(const void* data, size_t bytes)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+#ifdef TSDB_HAVE_SSE42_DISPATCH
+    if (crc32cHardwareAvailable()) return ~crc32cHardware(~0u, p, bytes);
+#endif
+    return ~crc32cSoftware(~0u, p, bytes);
+}
+
+uint32_t checksumBytes(const void* data, size_t bytes, ChecksumAlgorithm algorithm)
+{
+    if (algorithm == ChecksumAlgorithm::Crc32c) return crc32c(data, bytes);
+
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    return crc32(crc, static_cast<const Bytef*>(data), static_cast<uInt>(bytes));
+}
+
+uint32_t recordChecksum(const Record& r, ChecksumAlgorithm algorithm)
+{
+    if (algorithm == ChecksumAlgorithm::Zlib) return recordZlib(r);
+#ifdef TSDB_HAVE_SSE42_DISPATCH
+    if (crc32cHardwareAvailable()) return recordCrc32cHardware(r);
+#endif
+    return recordCrc32cSoftware(r);
+}
+
+void recordChecksums(const Record* records, size_t count, ChecksumAlgorithm algorithm, uint32_t* out)
+{
+    if (algorithm == ChecksumAlgorithm::Zlib)
+    {
+        for (size_t i = 0; i < count; ++i) out[i] = recordZlib(records[i]);
+        return;
+    }
+#ifdef TSDB_HAVE_SSE42_DISPATCH
+    if (crc32cHardwareAvailable())
+    {
+        recordCrc32cHardwareBatch(records, count, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; ++i) out[i] = recordCrc32cSoftware(records[i]);
+}
+
+void fillRecordChecksums(Record* records, size_t count, ChecksumAlgorithm algorithm)
+{
+    const size_t chunk = 256;
+    uint32_t crcs[chunk];
+    for (size_t start = 0; start < count; start += chunk)
+    {
+        size_t n = std::min(chunk, count - start);
+        recordChecksums(records + start, n, algorithm, crcs);
+        for (size_t i = 0; i < n; ++i)
+        {
+            records[start + i].crc = static_cast<int32_t>(crcs[i]);
+        }
+    }
+}
+
+size_t verifyRecords(const Record* records, size_t count, ChecksumAlgorithm algorithm)
+{
+    const size_t chunk = 256;
+    uint32_t crcs[chunk];
+    for (size_t start = 0; start < count; start += chunk)
+    {
+        size_t n = std::min(chunk, count - start);
+        recordChecksums(records + start, n, algorithm, crcs);
+
+        //accumulate mismatches branch free and only search when the chunk is bad
+        uint32_t mismatch = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            mismatch |= crcs[i] ^ static_cast<uint32_t>(records[start + i].crc);
+        }
+        if (mismatch == 0) continue;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (crcs[i] != static_cast<uint32_t>(records[start + i].crc)) return start + i;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "Record.hpp"
+#include "StorageOptions.hpp"
+
+
+//checksums of raw bytes and of the (timestamp, value) payload of records
+uint32_t checksumBytes(const void* data, size_t bytes, ChecksumAlgorithm algorithm);
+uint32_t recordChecksum(const Record& r, ChecksumAlgorithm algorithm);
+
+//batch forms run one pass over the records; verifyRecords returns the index of the
+//first record whose crc does not match, or count when every record is intact
+void recordChecksums(const Record* records, size_t count, ChecksumAlgorithm algorithm, uint32_t* out);
+void fillRecordChecksums(Record* records, size_t count, ChecksumAlgorithm algorithm);
+size_t verifyRecords(const Record* records, size_t count, ChecksumAlgorithm algorithm);
+
+//CRC32C (Castagnoli); uses the SSE4.2 crc32 instruction when the cpu has it
+uint32_t crc32c(const void* data, size_t bytes);
+bool crc32cHardwareAvailable();
@@ -0,0 +1,68 @@
+#include "CompactionWorker.hpp"
+#include <algorithm>
+
+namespace
+{
+    //longest the thread sleeps between checks
+    const std::chrono::seconds idleRecheck{1};
+}
+
+CompactionWorker::CompactionWorker(int64_t age, size_t bytesPerSecond) : age(std::max<int64_t>(age, 0)), bytesPerSecond(bytesPerSecond)
+{
+}
+
+CompactionWorker::~CompactionWorker()
+{
+    stop();
+}
+
+void CompactionWorker::start(std::function<bool()> compactNext)
+{
+    if (age > 0) thread = std::thread(&CompactionWorker::loop, this, std::move(compactNext));
+}
+
+void CompactionWorker::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+void CompactionWorker::wake()
+{
+    wakeup.notify_one();
+}
+
+bool CompactionWorker::pace(std::chrono::steady_clock::time_point started, uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (bytesPerSecond > 0)
+    {
+        std::chrono::steady_clock::time_point due = started + std::chrono::microseconds(bytes * 1'000'000 / bytesPerSecond);
+        while (!stopping && std::chrono::steady_clock::now() < due) wakeup.wait_until(lock, due);
+    }
+    return !stopping;
+}
+
+void CompactionWorker::done(uint64_t sequence)
+{
+    nextToCompact = sequence + 1;
+}
+
+void CompactionWorker::loop(const std::function<bool()>& compactNext)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        lock.unlock();
+        while (compactNext())
+        {
+        }
+        lock.lock();
+
+        if (!stopping) wakeup.wait_for(lock, idleRecheck);
+    }
+}
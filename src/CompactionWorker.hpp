@@ -0,0 +1,68 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <span>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include "SegmentFiles.hpp"
+
+//the background thread that compacts an engine's cold segments, oldest first, shared by both engines. the
+//engine's compactNext does one segment's work and returns false when nothing is left to do or the thread
+//is stopping; the thread then sleeps until woken or the idle recheck, since segments also turn cold as
+//newer records are written. an age of 0 starts no thread
+class CompactionWorker
+{
+public:
+    CompactionWorker(int64_t age, size_t bytesPerSecond);
+
+    //destructor; stops the thread
+    ~CompactionWorker();
+
+    CompactionWorker(const CompactionWorker&) = delete;
+    CompactionWorker& operator=(const CompactionWorker&) = delete;
+
+    void start(std::function<bool()> compactNext);
+
+    //a compaction in progress is abandoned at its next pace; the engine stops the thread before it
+    //tears down what compactNext uses
+    void stop();
+    void wake();
+
+    //sleeping until the bytes read so far are due keeps the average rate at the limit; false once stopping
+    bool pace(std::chrono::steady_clock::time_point started, uint64_t bytes);
+
+    //the first segment not yet looked at is the only candidate, and only once it ends before the age limit
+    template <typename Segment, typename Sequence, typename LastTimestamp>
+    std::optional<Segment> candidate(std::span<const Segment> segments, int64_t newest, Sequence sequence,
+                                     LastTimestamp lastTimestamp) const
+    {
+        int64_t coldBefore = windowStart(newest, age);
+        for (const Segment& segment : segments)
+        {
+            if (sequence(segment) < nextToCompact) continue;
+            if (lastTimestamp(segment) < coldBefore) return segment;
+            break;
+        }
+        return std::nullopt;
+    }
+
+    //the segment has been compacted or skipped
+    void done(uint64_t sequence);
+
+private:
+    const int64_t age;
+    const size_t bytesPerSecond;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    //only the compaction thread touches it
+    uint64_t nextToCompact = 0;
+
+    void loop(const std::function<bool()>& compactNext);
+};
@@ -0,0 +1,273 @@
+#include "Compression.hpp"
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<char>& out) : out(out)
+        {
+        }
+
+        void write(uint64_t value, int bits)
+        {
+            while (bits > 0)
+            {
+                int space = 64 - used;
+                int take = bits < space ? bits : space;
+                uint64_t chunk = (value >> (bits - take)) & mask(take);
+                window |= chunk << (space - take);
+                used += take;
+                bits -= take;
+                if (used == 64) emit(8);
+            }
+        }
+
+        void finish()
+        {
+            if (used > 0) emit((used + 7) / 8);
+        }
+
+    private:
+        std::vector<char>& out;
+        uint64_t window = 0;
+        int used = 0;
+
+        static uint64_t mask(int bits)
+        {
+            return bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+        }
+
+        void emit(int bytes)
+        {
+            for (int i = 0; i < bytes; ++i)
+            {
+                out.push_back(static_cast<char>(window >> (56 - 8 * i)));
+            }
+            window = 0;
+            used = 0;
+        }
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const char* data, size_t bytes) : data(reinterpret_cast<const uint8_t*>(data)), bytes(bytes)
+        {
+        }
+
+        uint64_t read(int bits)
+        {
+            if (bits > 56)
+            {
+                uint64_t high = read(bits - 32);
+                return (high << 32) | read(32);
+            }
+
+            if (bits > available) refill();
+            if (bits > available) {
+                throw std::runtime_error("Corrupted compressed block");
+            }
+
+            uint64_t value = window >> (64 - bits);
+            window <<= bits;
+            available -= bits;
+            return value;
+        }
+
+        bool readBit()
+        {
+            return read(1) != 0;
+        }
+
+    private:
+        const uint8_t* data;
+        size_t bytes;
+        size_t position = 0;
+        uint64_t window = 0;
+        int available = 0;
+
+        void refill()
+        {
+            while (available <= 56 && position < bytes)
+            {
+                window |= static_cast<uint64_t>(data[position++]) << (56 - available);
+                available += 8;
+            }
+        }
+    };
+
+    int64_t signExtend(uint64_t value, int bits)
+    {
+        uint64_t sign = 1ULL << (bits - 1);
+        return static_cast<int64_t>((value ^ sign) - sign);
+    }
+
+    uint64_t bitsOf(double value)
+    {
+        return std::bit_cast<uint64_t>(value);
+    }
+}
+
+void encodeTimestamps(const Record* records, size_t count, std::vector<char>& out)
+{
+    if (count == 0) return;
+
+    BitWriter writer(out);
+    writer.write(static_cast<uint64_t>(records[0].timestamp), 64);
+
+    //deltas use wrapping unsigned arithmetic so any int64 sequence round-trips exactly
+    uint64_t previous = static_cast<uint64_t>(records[0].timestamp);
+    uint64_t previousDelta = 0;
+    for (size_t i = 1; i < count; ++i)
+    {
+        uint64_t current = static_cast<uint64_t>(records[i].timestamp);
+        uint64_t delta = current - previous;
+        int64_t dod = static_cast<int64_t>(delta - previousDelta);
+
+        if (dod == 0)
+        {
+            writer.write(0b0, 1);
+        }
+        else if (dod >= -64 && dod <= 63)
+        {
+            writer.write(0b10, 2);
+            writer.write(static_cast<uint64_t>(dod), 7);
+        }
+        else if (dod >= -256 && dod <= 255)
+        {
+            writer.write(0b110, 3);
+            writer.write(static_cast<uint64_t>(dod), 9);
+        }
+        else if (dod >= -2048 && dod <= 2047)
+        {
+            writer.write(0b1110, 4);
+            writer.write(static_cast<uint64_t>(dod), 12);
+        }
+        else
+        {
+            writer.write(0b1111, 4);
+            writer.write(static_cast<uint64_t>(dod), 64);
+        }
+
+        previous = current;
+        previousDelta = delta;
+    }
+    writer.finish();
+}
+
+void encodeValues(const Record* records, size_t count, std::vector<char>& out)
+{
+    if (count == 0) return;
+
+    BitWriter writer(out);
+    uint64_t previous = bitsOf(records[0].value);
+    writer.write(previous, 64);
+
+    int previousLeading = -1;
+    int previousTrailing = 0;
+    for (size_t i = 1; i < count; ++i)
+    {
+        uint64_t current = bitsOf(records[i].value);
+        uint64_t x = current ^ previous;
+        previous = current;
+
+        if (x == 0)
+        {
+            writer.write(0b0, 1);
+            continue;
+        }
+        writer.write(0b1, 1);
+
+        int leading = std::countl_zero(x);
+        int trailing = std::countr_zero(x);
+        if (leading > 31) leading = 31;
+
+        //reuse the previous window of meaningful bits when the new XOR fits inside it
+        if (previousLeading >= 0 && leading >= previousLeading && trailing >= previousTrailing)
+        {
+            writer.write(0b0, 1);
+            writer.write(x >> previousTrailing, 64 - previousLeading - previousTrailing);
+        }
+        else
+        {
+            int significant = 64 - leading - trailing;
+            writer.write(0b1, 1);
+            writer.write(static_cast<uint64_t>(leading), 5);
+            writer.write(static_cast<uint64_t>(significant == 64 ? 0 : significant), 6);
+            writer.write(x >> trailing, significant);
+            previousLeading = leading;
+            previousTrailing = trailing;
+        }
+    }
+    writer.finish();
+}
+
+void decodeTimestamps(const char* data, size_t bytes, size_t count, int64_t* out)
+{
+    if (count == 0) return;
+
+    BitReader reader(data, bytes);
+    uint64_t previous = reader.read(64);
+    uint64_t previousDelta = 0;
+    out[0] = static_cast<int64_t>(previous);
+
+    for (size_t i = 1; i < count; ++i)
+    {
+        int64_t dod;
+        if (!reader.readBit())
+        {
+            dod = 0;
+        }
+        else if (!reader.readBit())
+        {
+            dod = signExtend(reader.read(7), 7);
+        }
+        else if (!reader.readBit())
+        {
+            dod = signExtend(reader.read(9), 9);
+        }
+        else if (!reader.readBit())
+        {
+            dod = signExtend(reader.read(12), 12);
+        }
+        else
+        {
+            dod = static_cast<int64_t>(reader.read(64));
+        }
+
+        previousDelta += static_cast<uint64_t>(dod);
+        previous += previousDelta;
+        out[i] = static_cast<int64_t>(previous);
+    }
+}
+
+void decodeValues(const char* data, size_t bytes, size_t count, double* out)
+{
+    if (count == 0) return;
+
+    BitReader reader(data, bytes);
+    uint64_t previous = reader.read(64);
+    out[0] = std::bit_cast<double>(previous);
+
+    int leading = 0;
+    int trailing = 0;
+    for (size_t i = 1; i < count; ++i)
+    {
+        if (reader.readBit())
+        {
+            if (reader.readBit())
+            {
+                leading = static_cast<int>(reader.read(5));
+                int significant = static_cast<int>(reader.read(6));
+                if (significant == 0) significant = 64;
+                trailing = 64 - leading - significant;
+            }
+            previous ^= reader.read(64 - leading - trailing) << trailing;
+        }
+        out[i] = std::bit_cast<double>(previous);
+    }
+}
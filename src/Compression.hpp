@@ -0,0 +1,13 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "Record.hpp"
+
+//Gorilla style encodings: delta-of-delta for timestamps and XOR-with-previous for values.
+//each column is written as its own bit stream so timestamp-only scans never touch the values.
+void encodeTimestamps(const Record* records, size_t count, std::vector<char>& out);
+void encodeValues(const Record* records, size_t count, std::vector<char>& out);
+
+void decodeTimestamps(const char* data, size_t bytes, size_t count, int64_t* out);
+void decodeValues(const char* data, size_t bytes, size_t count, double* out);
@@ -0,0 +1,100 @@
+#include "FileReader.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+FileReader::FileReader(const std::string& filename, ReadMode mode) : filename(filename), mode(mode)
+{
+    if (mode != ReadMode::Stream)
+    {
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open data file for reading");
+        }
+    }
+
+    if (mode == ReadMode::Mmap)
+    {
+        mappedFile = std::make_shared<MappedFile>(filename);
+    }
+}
+
+FileReader::~FileReader()
+{
+    if (fd >= 0) ::close(fd);
+}
+
+void FileReader::read(void* dst, size_t bytes, uint64_t offset) const
+{
+    if (mode == ReadMode::Mmap)
+    {
+        if (offset + bytes > mappedFile->size()) mappedFile->remap(offset + bytes);
+        std::memcpy(dst, mappedFile->data() + offset, bytes);
+    }
+    else if (mode == ReadMode::Pread)
+    {
+        //positional reads share no file offset, so concurrent readers can use the same descriptor
+        char* out = static_cast<char*>(dst);
+        while (bytes > 0)
+        {
+            ssize_t n = ::pread(fd, out, bytes, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw std::runtime_error("Failed to read from file: " + filename);
+            }
+            out += n;
+            bytes -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+    }
+    else
+    {
+        std::ifstream inFile(filename, std::ios::binary);
+        if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+
+        inFile.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+        if (!inFile.read(static_cast<char*>(dst), static_cast<std::streamsize>(bytes))) {
+            throw std::runtime_error("Failed to read from file: " + filename);
+        }
+    }
+}
+
+uint64_t FileReader::size() const
+{
+    if (mode == ReadMode::Stream)
+    {
+        std::ifstream inFile(filename, std::ios::binary | std::ios::ate);
+        if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+        return static_cast<uint64_t>(inFile.tellg());
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("Failed to stat file: " + filename);
+    }
+    return static_cast<uint64_t>(st.st_size);
+}
+
+void FileReader::grow(uint64_t fileSize)
+{
+    if (mappedFile) mappedFile->remap(fileSize);
+}
+
+ReadMode FileReader::getMode() const
+{
+    return mode;
+}
+
+std::shared_ptr<const MappedFile> FileReader::getMapping() const
+{
+    return mappedFile;
+}
+
+int FileReader::getDescriptor() const
+{
+    return fd;
+}
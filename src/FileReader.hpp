@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "StorageOptions.hpp"
+#include "MappedFile.hpp"
+
+class FileReader
+{
+public:
+    //constructor
+    FileReader(const std::string& filename, ReadMode mode);
+
+    //destructor
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    //read functions
+    void read(void* dst, size_t bytes, uint64_t offset) const;
+    uint64_t size() const;
+
+    //extends the mapping after the file has grown (no-op unless memory mapped)
+    void grow(uint64_t fileSize);
+
+    //getters
+    ReadMode getMode() const;
+    //the mapping outlives the reader while anything still holds it; null unless memory mapped
+    std::shared_ptr<const MappedFile> getMapping() const;
+
+    //descriptor for positional reads issued elsewhere; -1 in stream mode
+    int getDescriptor() const;
+
+private:
+    const std::string filename;
+    const ReadMode mode;
+    int fd = -1;
+    std::shared_ptr<MappedFile> mappedFile;
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+
+//counters kept by the flush thread since the database was opened; times are in microseconds
+struct FlushStats
+{
+    uint64_t flushes;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t syncs;
+
+    //write-ahead log only: times logged records were moved to the data file and the log emptied
+    uint64_t checkpoints;
+
+    //why each flush ran: a lane crossed the record threshold or a durable append asked for it,
+    //the oldest queued record reached the latency deadline, or the database closed
+    uint64_t thresholdFlushes;
+    uint64_t deadlineFlushes;
+    uint64_t closeFlushes;
+
+    uint64_t largestBatch;
+    uint64_t totalFlushTime;
+    uint64_t longestFlushTime;
+
+    //from the first record of a batch reaching a lane until the batch is written (and synced when due)
+    uint64_t totalIngestLatency;
+    uint64_t longestIngestLatency;
+};
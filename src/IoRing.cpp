@@ -0,0 +1,268 @@
+#include "IoRing.hpp"
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define TSDB_HAVE_IO_URING 1
+#endif
+
+#ifdef TSDB_HAVE_IO_URING
+
+//the numbers are shared by every architecture but alpha; older libc headers may not name them yet
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+namespace
+{
+    template <typename T>
+    T* at(void* base, uint32_t offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+
+    //the read and write opcodes arrived in 5.6 together with probing, so a kernel that cannot be probed
+    //has a ring but not the operations queued on it
+    bool supportsOperations(int fd)
+    {
+        const unsigned probeOps = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, probeOps) < 0) return false;
+
+        for (unsigned op : {IORING_OP_WRITE, IORING_OP_READ, IORING_OP_FSYNC})
+        {
+            if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0) return false;
+        }
+        return true;
+    }
+}
+
+std::unique_ptr<IoRing> IoRing::create(unsigned entries)
+{
+    io_uring_params params{};
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) return nullptr;
+
+    std::unique_ptr<IoRing> ring(new IoRing());
+    ring->ringFd = fd;
+    ring->entries = params.sq_entries;
+    if (!supportsOperations(fd)) return nullptr;
+
+    //since 5.4 both rings share one mapping
+    ring->sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) ring->sqRingBytes = ring->cqRingBytes = std::max(ring->sqRingBytes, ring->cqRingBytes);
+
+    ring->sqRing = ::mmap(nullptr, ring->sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+    {
+        ring->sqRing = nullptr;
+        return nullptr;
+    }
+    if (singleMap)
+    {
+        ring->cqRing = ring->sqRing;
+    }
+    else
+    {
+        ring->cqRing = ::mmap(nullptr, ring->cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED)
+        {
+            ring->cqRing = nullptr;
+            return nullptr;
+        }
+    }
+
+    ring->sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = ::mmap(nullptr, ring->sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = nullptr;
+        return nullptr;
+    }
+
+    ring->sqTail = at<unsigned>(ring->sqRing, params.sq_off.tail);
+    ring->sqMask = at<unsigned>(ring->sqRing, params.sq_off.ring_mask);
+    ring->sqArray = at<unsigned>(ring->sqRing, params.sq_off.array);
+    ring->cqHead = at<unsigned>(ring->cqRing, params.cq_off.head);
+    ring->cqTail = at<unsigned>(ring->cqRing, params.cq_off.tail);
+    ring->cqMask = at<unsigned>(ring->cqRing, params.cq_off.ring_mask);
+    ring->cqes = at<void>(ring->cqRing, params.cq_off.cqes);
+    ring->expected.resize(params.sq_entries);
+    return ring;
+}
+
+IoRing::~IoRing()
+{
+    if (sqes) ::munmap(sqes, sqesBytes);
+    if (cqRing && cqRing != sqRing) ::munmap(cqRing, cqRingBytes);
+    if (sqRing) ::munmap(sqRing, sqRingBytes);
+    if (ringFd >= 0) ::close(ringFd);
+}
+
+void* IoRing::nextEntry()
+{
+    //completions are reaped before new work is queued, so the expected slots are free to reuse
+    if (queued + inFlight >= entries) return nullptr;
+
+    unsigned tail = *sqTail + queued;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    sqe->user_data = queued + inFlight;
+    sqArray[index] = index;
+    ++queued;
+    return sqe;
+}
+
+bool IoRing::queueWrite(int fd, const void* data, size_t bytes, uint64_t offset, bool linked)
+{
+    if (bytes > maxTransfer) return false;
+
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(bytes);
+    sqe->off = offset;
+    if (linked) sqe->flags = IOSQE_IO_LINK;
+    expected[sqe->user_data] = bytes;
+    return true;
+}
+
+bool IoRing::queueSync(int fd, bool dataOnly)
+{
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    if (dataOnly) sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    expected[sqe->user_data] = 0;
+    return true;
+}
+
+bool IoRing::queueRead(int fd, void* data, size_t bytes, uint64_t offset)
+{
+    if (bytes > maxTransfer) return false;
+
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(nextEntry());
+    if (!sqe) return false;
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(bytes);
+    sqe->off = offset;
+    expected[sqe->user_data] = bytes;
+    return true;
+}
+
+void IoRing::submit()
+{
+    if (queued == 0) return;
+
+    //the entries must be visible to the kernel before the tail that publishes them
+    __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+    unsigned count = queued;
+    inFlight += queued;
+    queued = 0;
+    enter(count, 0);
+}
+
+void IoRing::wait()
+{
+    submit();
+
+    std::string failure;
+    while (inFlight > 0)
+    {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            enter(0, 1);
+            continue;
+        }
+
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe* cqe = static_cast<const io_uring_cqe*>(cqes) + (head & *cqMask);
+            if (cqe->res < 0 && failure.empty())
+            {
+                failure = std::strerror(-cqe->res);
+            }
+            else if (cqe->res >= 0 && static_cast<size_t>(cqe->res) != expected[cqe->user_data] && failure.empty())
+            {
+                failure = "short transfer";
+            }
+            --inFlight;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if (!failure.empty()) throw std::runtime_error("io_uring operation failed: " + failure);
+}
+
+void IoRing::enter(unsigned submit, unsigned waitFor)
+{
+    unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true)
+    {
+        long consumed = ::syscall(__NR_io_uring_enter, ringFd, submit, waitFor, flags, nullptr, 0);
+        if (consumed >= 0)
+        {
+            //the kernel may take fewer entries than offered; the rest stay published past its head
+            submit -= std::min<unsigned>(static_cast<unsigned>(consumed), submit);
+            if (submit == 0) return;
+            continue;
+        }
+        //a failed call consumed nothing (one that submitted and was interrupted while waiting reports the
+        //count), so busy and interrupted calls are retried with the same entries
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+    }
+}
+
+unsigned IoRing::getCapacity() const
+{
+    return entries;
+}
+
+#else
+
+//without the kernel header there is no ring, and callers keep to the blocking calls
+std::unique_ptr<IoRing> IoRing::create(unsigned)
+{
+    return nullptr;
+}
+
+IoRing::~IoRing() = default;
+
+bool IoRing::queueWrite(int, const void*, size_t, uint64_t, bool) { return false; }
+bool IoRing::queueSync(int, bool) { return false; }
+bool IoRing::queueRead(int, void*, size_t, uint64_t) { return false; }
+void IoRing::submit() {}
+void IoRing::wait() {}
+unsigned IoRing::getCapacity() const { return 0; }
+
+#endif
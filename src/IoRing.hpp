@@ -0,0 +1,70 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+//minimal io_uring instance driven through the raw syscalls, so liburing is not needed. operations are
+//queued, handed to the kernel together and waited for together; a ring is used by one thread at a time.
+class IoRing
+{
+public:
+    //nullptr when the kernel offers no io_uring or lacks its read and write operations (before 5.6), or
+    //when seccomp or sysctl turn it off
+    static std::unique_ptr<IoRing> create(unsigned entries);
+
+    static constexpr size_t maxTransfer = std::numeric_limits<uint32_t>::max();
+
+    //destructor
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    //queue functions; false once the submission queue is full or a transfer is longer than maxTransfer,
+    //the most one entry can move. a linked write holds back the next operation until it has completed,
+    //and cancels it if it fails
+    bool queueWrite(int fd, const void* data, size_t bytes, uint64_t offset, bool linked);
+    bool queueSync(int fd, bool dataOnly);
+    bool queueRead(int fd, void* data, size_t bytes, uint64_t offset);
+
+    //hands the queued operations to the kernel without waiting for them
+    void submit();
+
+    //waits for every submitted operation; throws if any failed or moved fewer bytes than asked
+    void wait();
+
+    //getters
+    unsigned getCapacity() const;
+
+private:
+    IoRing() = default;
+
+    int ringFd = -1;
+    unsigned entries = 0;
+
+    //shared with the kernel: the submission ring, its entries and the completion ring
+    void* sqRing = nullptr;
+    size_t sqRingBytes = 0;
+    void* cqRing = nullptr;
+    size_t cqRingBytes = 0;
+    void* sqes = nullptr;
+    size_t sqesBytes = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    void* cqes = nullptr;
+
+    //bytes each queued operation must move, indexed by its user data; syncs expect 0
+    std::vector<size_t> expected;
+    unsigned queued = 0;
+    unsigned inFlight = 0;
+
+    void* nextEntry();
+    void enter(unsigned submit, unsigned waitFor);
+};
@@ -0,0 +1,161 @@
+#include "Kernels.hpp"
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TSDB_HAVE_AVX2_DISPATCH 1
+#endif
+
+namespace
+{
+    ValueStats combineLanes(const double* sums, const double* mins, const double* maxs)
+    {
+        return {(sums[0] + sums[1]) + (sums[2] + sums[3]),
+                std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3])),
+                std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3]))};
+    }
+
+    void reduceTail(const double* values, size_t from, size_t count, ValueStats& stats)
+    {
+        for (size_t i = from; i < count; ++i)
+        {
+            stats.sum += values[i];
+            stats.min = std::min(stats.min, values[i]);
+            stats.max = std::max(stats.max, values[i]);
+        }
+    }
+
+#ifdef TSDB_HAVE_AVX2_DISPATCH
+    __attribute__((target("avx2")))
+    ValueStats reduceValuesAvx2(const double* values, size_t count)
+    {
+        if (count < 4)
+        {
+            ValueStats stats{values[0], values[0], values[0]};
+            reduceTail(values, 1, count, stats);
+            return stats;
+        }
+
+        __m256d sum = _mm256_loadu_pd(values);
+        __m256d min = sum;
+        __m256d max = sum;
+        size_t i = 4;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256d v = _mm256_loadu_pd(values + i);
+            sum = _mm256_add_pd(sum, v);
+            //operand order matches std::min(acc, v) / std::max(acc, v) in the scalar kernel
+            min = _mm256_min_pd(v, min);
+            max = _mm256_max_pd(v, max);
+        }
+
+        alignas(32) double sums[4];
+        alignas(32) double mins[4];
+        alignas(32) double maxs[4];
+        _mm256_store_pd(sums, sum);
+        _mm256_store_pd(mins, min);
+        _mm256_store_pd(maxs, max);
+
+        ValueStats stats = combineLanes(sums, mins, maxs);
+        reduceTail(values, i, count, stats);
+        return stats;
+    }
+#endif
+}
+
+bool avx2Available()
+{
+#ifdef TSDB_HAVE_AVX2_DISPATCH
+    static const bool available = __builtin_cpu_supports("avx2");
+    return available;
+#else
+    return false;
+#endif
+}
+
+ValueStats reduceValues(const double* values, size_t count)
+{
+#ifdef TSDB_HAVE_AVX2_DISPATCH
+    if (avx2Available()) return reduceValuesAvx2(values, count);
+#endif
+    return reduceValuesScalar(values, count);
+}
+
+ValueStats reduceValuesScalar(const double* values, size_t count)
+{
+    if (count < 4)
+    {
+        ValueStats stats{values[0], values[0], values[0]};
+        reduceTail(values, 1, count, stats);
+        return stats;
+    }
+
+    double sums[4] = {values[0], values[1], values[2], values[3]};
+    double mins[4] = {values[0], values[1], values[2], values[3]};
+    double maxs[4] = {values[0], values[1], values[2], values[3]};
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+    {
+        for (size_t lane = 0; lane < 4; ++lane)
+        {
+            sums[lane] += values[i + lane];
+            mins[lane] = std::min(mins[lane], values[i + lane]);
+            maxs[lane] = std::max(maxs[lane], values[i + lane]);
+        }
+    }
+
+    ValueStats stats = combineLanes(sums, mins, maxs);
+    reduceTail(values, i, count, stats);
+    return stats;
+}
+
+void extractValues(const Record* records, size_t count, double* out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = records[i].value;
+    }
+}
+
+void mergeSortedRuns(std::vector<std::vector<Record>>& runs, std::vector<Record>& out)
+{
+    size_t total = 0;
+    for (const auto& run : runs) total += run.size();
+    out.reserve(total);
+
+    if (runs.size() == 1 && out.empty())
+    {
+        out.swap(runs.front());
+        return;
+    }
+
+    using Head = std::pair<int64_t, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<size_t> next(runs.size(), 0);
+    for (size_t run = 0; run < runs.size(); ++run)
+    {
+        if (!runs[run].empty()) heads.push({runs[run].front().timestamp, run});
+    }
+
+    while (!heads.empty())
+    {
+        size_t run = heads.top().second;
+        heads.pop();
+
+        //take the run's records up to the next smallest head in one go
+        int64_t limit = heads.empty() ? std::numeric_limits<int64_t>::max() : heads.top().first;
+        const std::vector<Record>& records = runs[run];
+        size_t position = next[run];
+        do
+        {
+            out.push_back(records[position++]);
+        } while (position < records.size() &&
+                 (records[position].timestamp < limit || (records[position].timestamp == limit && !heads.empty() && run < heads.top().second)));
+
+        next[run] = position;
+        if (position < records.size()) heads.push({records[position].timestamp, run});
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Record.hpp"
+
+
+struct ValueStats
+{
+    double sum;
+    double min;
+    double max;
+};
+
+//sum, min and max of count values in one pass (count must be positive). the AVX2 kernel is used
+//when the cpu has it; the scalar kernel keeps the same four-lane order so both give identical results.
+ValueStats reduceValues(const double* values, size_t count);
+ValueStats reduceValuesScalar(const double* values, size_t count);
+bool avx2Available();
+
+//copies the value column out of a run of records so the reductions can stream over it
+void extractValues(const Record* records, size_t count, double* out);
+
+//k-way merge of runs already sorted by timestamp into out; equal timestamps keep run order.
+//the runs may be left empty or moved from
+void mergeSortedRuns(std::vector<std::vector<Record>>& runs, std::vector<Record>& out);
@@ -0,0 +1,114 @@
+#include "LearnedIndex.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    //caps how many records a reopen has to read back to refit the last open segment
+    const size_t maxSegmentRecords = 1 << 16;
+
+    size_t predict(const LearnedSegment& segment, int64_t timestamp, size_t bound)
+    {
+        //one extra record of slack absorbs rounding in the prediction
+        double predicted = static_cast<double>(segment.firstIndex) +
+                           segment.slope * (static_cast<double>(timestamp) - static_cast<double>(segment.firstTimestamp)) -
+                           static_cast<double>(segment.maxError) - 1;
+        if (!(predicted > static_cast<double>(segment.firstIndex))) return segment.firstIndex;
+        if (predicted >= static_cast<double>(bound)) return bound;
+        return std::max<size_t>(segment.firstIndex, static_cast<size_t>(predicted));
+    }
+}
+
+LearnedIndex::LearnedIndex(size_t maxError) : maxError(maxError)
+{
+}
+
+void LearnedIndex::add(int64_t timestamp, size_t index)
+{
+    if (!fitting)
+    {
+        start(timestamp, index);
+        return;
+    }
+    if (timestamp <= lastTimestamp) return;
+
+    double dt = static_cast<double>(timestamp) - static_cast<double>(firstTimestamp);
+    double offset = static_cast<double>(index - firstIndex);
+    double low = std::max(minSlope, (offset - static_cast<double>(maxError)) / dt);
+    double high = std::min(maxSlope, (offset + static_cast<double>(maxError)) / dt);
+
+    if (low > high || index - firstIndex >= maxSegmentRecords)
+    {
+        closed.push_back({firstTimestamp, firstIndex, index, fittedSlope(), maxError});
+        start(timestamp, index);
+        return;
+    }
+
+    minSlope = low;
+    maxSlope = high;
+    lastTimestamp = timestamp;
+    lastIndex = index;
+}
+
+void LearnedIndex::assign(std::vector<LearnedSegment> segments)
+{
+    closed = std::move(segments);
+    fitting = false;
+}
+
+size_t LearnedIndex::resumeIndex() const
+{
+    return closed.empty() ? 0 : closed.back().endIndex;
+}
+
+std::optional<size_t> LearnedIndex::lowerBound(int64_t timestamp) const
+{
+    //the open segment's points are past every closed segment
+    if (fitting && timestamp >= firstTimestamp)
+    {
+        LearnedSegment segment{firstTimestamp, firstIndex, lastIndex, fittedSlope(), maxError};
+        return predict(segment, timestamp, lastIndex);
+    }
+
+    auto next = std::upper_bound(closed.begin(), closed.end(), timestamp,
+                                 [](int64_t ts, const LearnedSegment& s) { return ts < s.firstTimestamp; });
+    if (next == closed.begin()) return std::nullopt;
+
+    //past a segment's last point the next match is at the latest where the next segment starts
+    const LearnedSegment& segment = *(next - 1);
+    return predict(segment, timestamp, segment.endIndex);
+}
+
+const std::vector<LearnedSegment>& LearnedIndex::closedSegments() const
+{
+    return closed;
+}
+
+size_t LearnedIndex::segmentCount() const
+{
+    return closed.size() + (fitting ? 1 : 0);
+}
+
+size_t LearnedIndex::getMaxError() const
+{
+    return maxError;
+}
+
+void LearnedIndex::start(int64_t timestamp, size_t index)
+{
+    fitting = true;
+    firstTimestamp = timestamp;
+    firstIndex = index;
+    lastTimestamp = timestamp;
+    lastIndex = index;
+    minSlope = 0;
+    maxSlope = std::numeric_limits<double>::infinity();
+}
+
+double LearnedIndex::fittedSlope() const
+{
+    //a single point has no upper bound on its slope; any slope fits it
+    if (std::isinf(maxSlope)) return minSlope;
+    return (minSlope + maxSlope) / 2;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+//one line of the learned index: from firstTimestamp on, the first record of a timestamp sits within
+//maxError of firstIndex + slope * (timestamp - firstTimestamp). it covers records up to endIndex.
+struct LearnedSegment
+{
+    int64_t firstTimestamp;
+    uint64_t firstIndex;
+    uint64_t endIndex;
+    double slope;
+    uint64_t maxError;
+};
+
+//piecewise linear map from timestamp to record index, fitted greedily as records arrive.
+//each segment keeps the range of slopes that fits every point so far and closes once that range
+//is empty, so near regular series need a handful of segments where the sparse index needs one
+//entry per interval. lookups return a record index that never passes the first match.
+class LearnedIndex
+{
+public:
+    explicit LearnedIndex(size_t maxError);
+
+    //records arrive in timestamp order; only the first record of each timestamp becomes a point
+    void add(int64_t timestamp, size_t index);
+
+    //restores persisted segments; records from resumeIndex() on must then be added again
+    void assign(std::vector<LearnedSegment> segments);
+    size_t resumeIndex() const;
+
+    //an index at or before the first record whose timestamp is not below the given one
+    std::optional<size_t> lowerBound(int64_t timestamp) const;
+
+    //segments that no later add can change; the segment being fitted is not included
+    const std::vector<LearnedSegment>& closedSegments() const;
+    size_t segmentCount() const;
+    size_t getMaxError() const;
+
+private:
+    const size_t maxError;
+    std::vector<LearnedSegment> closed;
+
+    //segment being fitted
+    bool fitting = false;
+    int64_t firstTimestamp = 0;
+    size_t firstIndex = 0;
+    int64_t lastTimestamp = 0;
+    size_t lastIndex = 0;
+    double minSlope = 0;
+    double maxSlope = 0;
+
+    void start(int64_t timestamp, size_t index);
+    double fittedSlope() const;
+};
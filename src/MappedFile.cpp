@@ -0,0 +1,79 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace
+{
+    const size_t minimumCapacity = 1 << 20;
+
+    size_t roundToPage(size_t bytes)
+    {
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        return (bytes + page - 1) / page * page;
+    }
+}
+
+MappedFile::MappedFile(const std::string& filename) : filename(filename)
+{
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file for mapping: " + filename);
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file for mapping: " + filename);
+    }
+
+    remap(static_cast<size_t>(st.st_size));
+}
+
+MappedFile::~MappedFile()
+{
+    for (const Region& region : regions)
+    {
+        ::munmap(region.address, region.capacity);
+    }
+    ::close(fd);
+}
+
+void MappedFile::remap(size_t fileSize)
+{
+    std::lock_guard<std::mutex> lock(remapMutex);
+
+    if (fileSize <= capacity)
+    {
+        mappedSize.store(std::max(fileSize, mappedSize.load(std::memory_order_relaxed)), std::memory_order_release);
+        return;
+    }
+
+    //over-allocate so appends only trigger a new mapping every time the file doubles
+    size_t newCapacity = roundToPage(std::max({fileSize, capacity * 2, minimumCapacity}));
+
+    void* address = ::mmap(nullptr, newCapacity, PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        throw std::runtime_error("Failed to map file: " + filename);
+    }
+    ::madvise(address, newCapacity, MADV_SEQUENTIAL);
+
+    regions.push_back({address, newCapacity});
+    capacity = newCapacity;
+
+    base.store(static_cast<const char*>(address), std::memory_order_release);
+    mappedSize.store(fileSize, std::memory_order_release);
+}
+
+const char* MappedFile::data() const
+{
+    return base.load(std::memory_order_acquire);
+}
+
+size_t MappedFile::size() const
+{
+    return mappedSize.load(std::memory_order_acquire);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+
+class MappedFile
+{
+public:
+    //constructor
+    explicit MappedFile(const std::string& filename);
+
+    //destructor
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    //grows the mapping so that the first fileSize bytes are addressable
+    void remap(size_t fileSize);
+
+    //getters
+    const char* data() const;
+    size_t size() const;
+
+private:
+    struct Region
+    {
+        void* address;
+        size_t capacity;
+    };
+
+    const std::string filename;
+    int fd;
+
+    //regions are only released on destruction so previously returned views stay valid
+    std::vector<Region> regions;
+    std::mutex remapMutex;
+
+    std::atomic<const char*> base{nullptr};
+    std::atomic<size_t> mappedSize{0};
+    size_t capacity = 0;
+};
@@ -0,0 +1,69 @@
+#include "Memtable.hpp"
+#include <algorithm>
+
+void Memtable::insert(std::vector<Record>& run)
+{
+    if (run.empty()) return;
+
+    auto byTimestamp = [](const Record& a, const Record& b) { return a.timestamp < b.timestamp; };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (records.empty())
+    {
+        records.swap(run);
+        return;
+    }
+
+    size_t held = records.size();
+    records.insert(records.end(), run.begin(), run.end());
+    if (run.front().timestamp < records[held - 1].timestamp)
+    {
+        std::inplace_merge(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(held), records.end(), byTimestamp);
+    }
+}
+
+std::vector<Record> Memtable::takeThrough(int64_t timestamp)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto end = std::upper_bound(records.begin(), records.end(), timestamp,
+                                [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+    std::vector<Record> taken;
+    if (end == records.end())
+    {
+        taken.swap(records);
+        return taken;
+    }
+    taken.assign(records.begin(), end);
+    records.erase(records.begin(), end);
+    return taken;
+}
+
+void Memtable::readRange(int64_t startTs, int64_t endTs, std::vector<Record>& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto begin = std::lower_bound(records.begin(), records.end(), startTs,
+                                  [](const Record& r, int64_t ts) { return r.timestamp < ts; });
+    auto end = std::upper_bound(begin, records.end(), endTs,
+                                [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+    out.insert(out.end(), begin, end);
+}
+
+std::optional<Record> Memtable::first() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (records.empty()) return std::nullopt;
+    return records.front();
+}
+
+std::optional<Record> Memtable::last() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (records.empty()) return std::nullopt;
+    return records.back();
+}
+
+size_t Memtable::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return records.size();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include "Record.hpp"
+
+//records drained from the ingest lanes that the flush thread has not yet written, kept in timestamp
+//order so reads can merge them with the file. runs newer than everything held are appended; a late
+//run is merged into place after the records it shares timestamps with, so nothing drained is dropped.
+class Memtable
+{
+public:
+    Memtable() = default;
+    Memtable(const Memtable&) = delete;
+    Memtable& operator=(const Memtable&) = delete;
+
+    //run must be sorted by timestamp
+    void insert(std::vector<Record>& run);
+
+    //moves the records at or before the timestamp out for writing
+    std::vector<Record> takeThrough(int64_t timestamp);
+
+    //appends the records within [startTs, endTs] to out
+    void readRange(int64_t startTs, int64_t endTs, std::vector<Record>& out) const;
+
+    std::optional<Record> first() const;
+    std::optional<Record> last() const;
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Record> records;
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+//bounded lock-free queue for many producers and one consumer.
+//a producer claims a position with one fetch_add and publishes its value through the slot's sequence
+//number, so producers never wait on each other; they only wait when the ring is full. the consumer
+//takes values in position order and stops at the first slot that is claimed but not yet published.
+template <typename T>
+class MpscRing
+{
+    static_assert(std::is_trivially_copyable_v<T>, "ring values are copied in and out of shared slots");
+
+public:
+    //capacity is rounded up to a power of two
+    explicit MpscRing(size_t capacity) : capacity(roundUp(capacity)), mask(this->capacity - 1), slots(new Slot[this->capacity])
+    {
+        for (size_t i = 0; i < this->capacity; ++i)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    //returns the value's position; positions are handed out in claim order starting at 0
+    uint64_t push(const T& value)
+    {
+        uint64_t position = tail.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots[position & mask];
+
+        //the slot is free once the consumer has moved its sequence on to this lap
+        while (slot.sequence.load(std::memory_order_acquire) != position)
+        {
+            std::this_thread::yield();
+        }
+
+        slot.value = value;
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return position;
+    }
+
+    //claims count consecutive positions with one fetch_add and returns the first; count must not exceed the capacity
+    uint64_t push(const T* values, size_t count)
+    {
+        uint64_t first = tail.fetch_add(count, std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Slot& slot = slots[(first + i) & mask];
+            while (slot.sequence.load(std::memory_order_acquire) != first + i)
+            {
+                std::this_thread::yield();
+            }
+
+            slot.value = values[i];
+            slot.sequence.store(first + i + 1, std::memory_order_release);
+        }
+        return first;
+    }
+
+    //single consumer: appends every published value from the consumer position on and returns how many
+    size_t drain(std::vector<T>& out)
+    {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        size_t taken = 0;
+        while (true)
+        {
+            Slot& slot = slots[position & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) break;
+
+            out.push_back(slot.value);
+            slot.sequence.store(position + capacity, std::memory_order_release);
+            ++position;
+            ++taken;
+        }
+        head.store(position, std::memory_order_release);
+        return taken;
+    }
+
+    //values before this position have been drained
+    uint64_t drained() const
+    {
+        return head.load(std::memory_order_acquire);
+    }
+
+    //claimed values not yet drained; a snapshot that may be stale by the time it is used
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    //producers and the consumer write different counters, so they sit on separate cache lines
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> head{0};
+
+    static size_t roundUp(size_t capacity)
+    {
+        size_t rounded = 1;
+        while (rounded < capacity) rounded <<= 1;
+        return rounded;
+    }
+};
@@ -0,0 +1,46 @@
+#include "RangeCursor.hpp"
+#include "Storage.hpp"
+#include <algorithm>
+
+RangeCursor::RangeCursor(const Storage& storage, size_t startIndex, size_t endIndex, int64_t startTs, int64_t endTs, size_t chunkSize,
+                         std::vector<Record> unflushed)
+    : storage(storage), index(startIndex), endIndex(endIndex), startTs(startTs), endTs(endTs), buffer(chunkSize),
+      unflushed(std::move(unflushed))
+{
+    finished = index >= endIndex;
+}
+
+std::span<const Record> RangeCursor::next()
+{
+    auto byTimestamp = [](const Record& r, int64_t ts) { return r.timestamp < ts; };
+
+    while (!finished)
+    {
+        size_t n = storage.readCursorRecords(index, endIndex, buffer);
+        index += n;
+        if (n == 0 || index >= endIndex) finished = true;
+
+        //only the first chunk can start before the range and only the last can run past it
+        auto first = std::lower_bound(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(n), startTs, byTimestamp);
+        auto last = std::upper_bound(first, buffer.begin() + static_cast<std::ptrdiff_t>(n), endTs,
+                                     [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+        if (last != buffer.begin() + static_cast<std::ptrdiff_t>(n)) finished = true;
+
+        if (first != last) return {&*first, static_cast<size_t>(last - first)};
+    }
+
+    //the unflushed records were already cut to the range when the cursor opened
+    if (unflushedPosition < unflushed.size())
+    {
+        size_t n = std::min(buffer.size(), unflushed.size() - unflushedPosition);
+        std::span<const Record> chunk(unflushed.data() + unflushedPosition, n);
+        unflushedPosition += n;
+        return chunk;
+    }
+    return {};
+}
+
+bool RangeCursor::done() const
+{
+    return finished && unflushedPosition >= unflushed.size();
+}
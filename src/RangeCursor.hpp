@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include "Record.hpp"
+
+class Storage;
+
+//walks a time range in fixed size chunks so memory stays bounded by the chunk size.
+//checksums are verified chunk by chunk as records are read; the storage must outlive the cursor.
+//records that were not yet flushed when the cursor opened are copied then and come last, in chunks of the same size.
+class RangeCursor
+{
+public:
+    //returns the next chunk of records in the range, or an empty span once it is exhausted
+    std::span<const Record> next();
+
+    bool done() const;
+
+private:
+    friend class Storage;
+
+    RangeCursor(const Storage& storage, size_t startIndex, size_t endIndex, int64_t startTs, int64_t endTs, size_t chunkSize,
+                std::vector<Record> unflushed);
+
+    //positions count the records retention has dropped, so they stay put when segments are dropped
+    const Storage& storage;
+    size_t index;
+    size_t endIndex;
+    int64_t startTs;
+    int64_t endTs;
+    bool finished = false;
+    std::vector<Record> buffer;
+    std::vector<Record> unflushed;
+    size_t unflushedPosition = 0;
+};
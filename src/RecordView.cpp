@@ -0,0 +1,58 @@
+#include "RecordView.hpp"
+#include <cstring>
+#include <utility>
+
+RecordView::RecordView(std::span<const char> bytes, std::shared_ptr<const void> owner) : data(bytes), owner(std::move(owner))
+{
+}
+
+Record RecordView::operator[](size_t index) const
+{
+    Record record;
+    std::memcpy(&record, data.data() + index * sizeof(Record), sizeof(Record));
+    return record;
+}
+
+Record RecordView::front() const
+{
+    return (*this)[0];
+}
+
+Record RecordView::back() const
+{
+    return (*this)[size() - 1];
+}
+
+int64_t RecordView::timestamp(size_t index) const
+{
+    int64_t ts;
+    std::memcpy(&ts, data.data() + index * sizeof(Record) + offsetof(Record, timestamp), sizeof(ts));
+    return ts;
+}
+
+void RecordView::copyTo(std::vector<Record>& out) const
+{
+    size_t count = size();
+    out.resize(out.size() + count);
+    if (count > 0) std::memcpy(out.data() + out.size() - count, data.data(), count * sizeof(Record));
+}
+
+RecordView RecordView::subview(size_t index, size_t count) const
+{
+    return RecordView(data.subspan(index * sizeof(Record), count * sizeof(Record)), owner);
+}
+
+size_t RecordView::size() const
+{
+    return data.size() / sizeof(Record);
+}
+
+bool RecordView::empty() const
+{
+    return data.empty();
+}
+
+std::span<const char> RecordView::bytes() const
+{
+    return data;
+}
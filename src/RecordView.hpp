@@ -0,0 +1,36 @@
+#pragma once
+#include <span>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include "Record.hpp"
+
+//records read in place from a memory mapped file. the row layout data section starts right after the
+//10 byte header, so records in the mapping are not aligned for Record; they are copied out on access
+//instead of being referenced, which keeps the view itself zero-copy. the view shares ownership of the
+//mapping, so it stays readable after the file rolls over or the database closes
+class RecordView
+{
+public:
+    //constructor
+    RecordView() = default;
+    RecordView(std::span<const char> bytes, std::shared_ptr<const void> owner);
+
+    //read functions
+    Record operator[](size_t index) const;
+    Record front() const;
+    Record back() const;
+    int64_t timestamp(size_t index) const;
+    void copyTo(std::vector<Record>& out) const;
+    RecordView subview(size_t index, size_t count) const;
+
+    //getters
+    size_t size() const;
+    bool empty() const;
+    std::span<const char> bytes() const;
+
+private:
+    std::span<const char> data;
+    std::shared_ptr<const void> owner;
+};
@@ -0,0 +1,93 @@
+#include "SegmentFiles.hpp"
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+
+int64_t windowStart(int64_t newest, int64_t window)
+{
+    return newest < std::numeric_limits<int64_t>::min() + window ? std::numeric_limits<int64_t>::min() : newest - window;
+}
+
+int64_t segmentWindow(int64_t timestamp, int64_t duration)
+{
+    return timestamp / duration - (timestamp % duration < 0 ? 1 : 0);
+}
+
+std::string segmentFilename(const std::string& filename, uint64_t sequence)
+{
+    return filename + ".seg" + std::to_string(sequence);
+}
+
+std::vector<SegmentFile> listSegmentFiles(const std::string& filename)
+{
+    //anything after the prefix that does not start with a sequence is left alone
+    std::filesystem::path path(filename);
+    std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    std::string prefix = path.filename().string() + ".seg";
+
+    std::vector<SegmentFile> found;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+    {
+        std::string name = entry.path().filename().string();
+        size_t digits = prefix.size();
+        while (digits < name.size() && name[digits] >= '0' && name[digits] <= '9') ++digits;
+        if (!name.starts_with(prefix) || digits == prefix.size()) continue;
+
+        found.push_back({std::stoull(name.substr(prefix.size(), digits - prefix.size())), name.substr(digits), entry.path()});
+    }
+    return found;
+}
+
+void writeAll(int fd, const void* data, size_t bytes)
+{
+    ssize_t written = ::write(fd, data, bytes);
+    if (written != static_cast<ssize_t>(bytes)) {
+        throw std::runtime_error("Partial write");
+    }
+}
+
+void syncFile(int fd, bool dataOnly)
+{
+    if ((dataOnly ? ::fdatasync(fd) : ::fsync(fd)) != 0) {
+        throw std::runtime_error("fsync failed");
+    }
+}
+
+void syncDirectoryOf(const std::string& filename)
+{
+    std::filesystem::path parent = std::filesystem::path(filename).parent_path();
+    int dirFd = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd < 0) return;
+    ::fsync(dirFd);
+    ::close(dirFd);
+}
+
+UnsyncedFiles::~UnsyncedFiles()
+{
+    for (int fd : fds) ::close(fd);
+}
+
+void UnsyncedFiles::add(int fd)
+{
+    fds.push_back(fd);
+}
+
+void UnsyncedFiles::add(const std::vector<int>& added)
+{
+    fds.insert(fds.end(), added.begin(), added.end());
+}
+
+bool UnsyncedFiles::empty() const
+{
+    return fds.empty();
+}
+
+void UnsyncedFiles::sync(bool dataOnly)
+{
+    while (!fds.empty())
+    {
+        syncFile(fds.back(), dataOnly);
+        ::close(fds.back());
+        fds.pop_back();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+//file handling both engines share for a segmented store: the active file rolls over into sealed segments
+//named <file>.seg<sequence>, which retention drops from the front and compaction rewrites in place
+
+//oldest timestamp within the window of the newest one, saturating at the bottom of the range
+int64_t windowStart(int64_t newest, int64_t window);
+
+//segment windows start at multiples of the duration, below zero too
+int64_t segmentWindow(int64_t timestamp, int64_t duration);
+
+std::string segmentFilename(const std::string& filename, uint64_t sequence);
+
+//every file named <file>.seg<sequence><suffix> next to the file; sidecars and compaction copies have a suffix
+struct SegmentFile
+{
+    uint64_t sequence;
+    std::string suffix;
+    std::filesystem::path path;
+};
+std::vector<SegmentFile> listSegmentFiles(const std::string& filename);
+
+void writeAll(int fd, const void* data, size_t bytes);
+
+//fsync also flushes metadata such as the modification time, which fdatasync skips
+void syncFile(int fd, bool dataOnly);
+void syncDirectoryOf(const std::string& filename);
+
+//retention drops segments from the front, oldest first: those that end before the age limit allows, then
+//more while the files held add up to more than the byte limit. a limit of 0 is off
+template <typename Segment, typename LastTimestamp, typename Bytes>
+size_t expiredSegments(const std::vector<Segment>& segments, size_t candidates, int64_t newest, int64_t retentionAge,
+                       size_t retentionBytes, uint64_t held, LastTimestamp lastTimestamp, Bytes bytes)
+{
+    int64_t oldestKept = windowStart(newest, retentionAge);
+    size_t drop = 0;
+    while (drop < candidates &&
+           ((retentionAge > 0 && lastTimestamp(segments[drop]) < oldestKept) || (retentionBytes > 0 && held > retentionBytes)))
+    {
+        if (retentionBytes > 0) held -= bytes(segments[drop]);
+        ++drop;
+    }
+    return drop;
+}
+
+//descriptors of sealed files whose sync was put off; syncing by descriptor reaches a file after it is renamed
+class UnsyncedFiles
+{
+public:
+    UnsyncedFiles() = default;
+    ~UnsyncedFiles();
+
+    UnsyncedFiles(const UnsyncedFiles&) = delete;
+    UnsyncedFiles& operator=(const UnsyncedFiles&) = delete;
+
+    //takes ownership of the descriptors
+    void add(int fd);
+    void add(const std::vector<int>& fds);
+    bool empty() const;
+
+    //each file is closed once it is synced; after a failure the rest stay for the next attempt
+    void sync(bool dataOnly);
+
+private:
+    std::vector<int> fds;
+};
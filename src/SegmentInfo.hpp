@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+//manifest entry of a sealed segment: the records once held by the active file, renamed to
+//<file>.seg<sequence> when it rolled over. entries are kept oldest first.
+struct SegmentInfo
+{
+    uint64_t sequence;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint64_t recordCount;
+};
@@ -0,0 +1,147 @@
+#include "SeriesCatalog.hpp"
+#include "SeriesFormat.hpp"
+#include "Checksum.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <mutex>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace
+{
+    uint32_t entryChecksum(uint32_t id, const std::string& name)
+    {
+        std::string bytes(2 * sizeof(uint32_t) + name.size(), '\0');
+        uint32_t length = static_cast<uint32_t>(name.size());
+        std::memcpy(bytes.data(), &id, sizeof(id));
+        std::memcpy(bytes.data() + sizeof(id), &length, sizeof(length));
+        std::memcpy(bytes.data() + 2 * sizeof(uint32_t), name.data(), name.size());
+        return crc32c(bytes.data(), bytes.size());
+    }
+}
+
+SeriesCatalog::SeriesCatalog(const std::string& filename) : filename(filename)
+{
+    load();
+
+    fd = ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open catalog file: " + filename);
+    }
+}
+
+SeriesCatalog::~SeriesCatalog()
+{
+    if (fd >= 0) ::close(fd);
+}
+
+uint32_t SeriesCatalog::getOrCreate(const std::string& name)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+    }
+
+    if (name.empty() || name.size() > maxSeriesNameLength) {
+        throw std::runtime_error("Series names must be 1 to " + std::to_string(maxSeriesNameLength) + " bytes");
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+
+    uint32_t id = static_cast<uint32_t>(names.size());
+    CatalogEntry entry{id, static_cast<uint32_t>(name.size()), entryChecksum(id, name)};
+    std::string bytes(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    bytes += name;
+    if (::write(fd, bytes.data(), bytes.size()) != static_cast<ssize_t>(bytes.size())) {
+        throw std::runtime_error("Partial write");
+    }
+
+    ids.emplace(name, id);
+    names.push_back(name);
+    dirty = true;
+    return id;
+}
+
+std::optional<uint32_t> SeriesCatalog::find(const std::string& name) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it == ids.end()) return std::nullopt;
+    return it->second;
+}
+
+std::string SeriesCatalog::getName(uint32_t id) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if (id >= names.size()) throw std::out_of_range("Series id out of range");
+    return names[id];
+}
+
+std::vector<std::string> SeriesCatalog::getNames() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return names;
+}
+
+size_t SeriesCatalog::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return names.size();
+}
+
+void SeriesCatalog::sync()
+{
+    //entries written before the flag is cleared are covered by this sync; later ones set it again
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (!dirty) return;
+        dirty = false;
+    }
+
+    if (::fdatasync(fd) != 0) {
+        throw std::runtime_error("fsync failed");
+    }
+}
+
+void SeriesCatalog::load()
+{
+    std::ifstream inFile(filename, std::ios::binary | std::ios::ate);
+    if (!inFile.is_open()) return;
+
+    std::streamoff fileSize = inFile.tellg();
+    inFile.seekg(0, std::ios::beg);
+
+    //entries are trusted up to the first torn, corrupt or out of sequence one
+    std::streamoff valid = 0;
+    CatalogEntry entry{};
+    while (inFile.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+    {
+        if (entry.id != names.size() || entry.nameLength == 0 || entry.nameLength > maxSeriesNameLength) break;
+
+        std::string name(entry.nameLength, '\0');
+        if (!inFile.read(name.data(), static_cast<std::streamsize>(name.size()))) break;
+        if (entry.checksum != entryChecksum(entry.id, name) || ids.count(name) != 0) break;
+
+        ids.emplace(name, entry.id);
+        names.push_back(std::move(name));
+        valid = inFile.tellg();
+    }
+    inFile.close();
+
+    if (valid != fileSize)
+    {
+        int rwFd = ::open(filename.c_str(), O_WRONLY);
+        if (rwFd < 0) {
+            throw std::runtime_error("Failed to open file for truncation");
+        }
+        if (::ftruncate(rwFd, static_cast<off_t>(valid)) != 0) {
+            ::close(rwFd);
+            throw std::runtime_error("Failed to truncate catalog file");
+        }
+        ::close(rwFd);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+
+//on-disk map from series name to a dense id, appended as series are created.
+//new entries are written straight away but only reach disk on sync, which the engine runs before it
+//writes any data that refers to them; a torn or corrupt trailing entry is cut off on open.
+class SeriesCatalog
+{
+public:
+    //constructor
+    explicit SeriesCatalog(const std::string& filename);
+
+    //destructor
+    ~SeriesCatalog();
+
+    SeriesCatalog(const SeriesCatalog&) = delete;
+    SeriesCatalog& operator=(const SeriesCatalog&) = delete;
+
+    //returns the id of the series, adding it when the name is new
+    uint32_t getOrCreate(const std::string& name);
+    std::optional<uint32_t> find(const std::string& name) const;
+    std::string getName(uint32_t id) const;
+    std::vector<std::string> getNames() const;
+    size_t size() const;
+
+    //syncs entries added since the last call
+    void sync();
+
+private:
+    const std::string filename;
+    int fd = -1;
+    bool dirty = false;
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> names;
+
+    void load();
+};
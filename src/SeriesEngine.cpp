@@ -0,0 +1,1158 @@
+#include "SeriesEngine.hpp"
+#include "Checksum.hpp"
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace
+{
+    //longest the flush thread sleeps while nothing is queued
+    const std::chrono::seconds idleRecheck{1};
+
+    //the catalog is a member, so the directory has to exist before the constructor body runs
+    std::string catalogFilename(const std::string& directory)
+    {
+        std::filesystem::create_directories(directory);
+        return (std::filesystem::path(directory) / "catalog").string();
+    }
+
+    std::string chunkFilename(const std::string& directory)
+    {
+        return (std::filesystem::path(directory) / "series.tsdb").string();
+    }
+
+    TSDBHeader chunkFileHeader(ChecksumAlgorithm algorithm, uint8_t mark)
+    {
+        TSDBHeader header{{}, chunkFileVersion, {static_cast<uint8_t>(algorithm), mark, 0}, static_cast<uint16_t>(sizeof(Record))};
+        std::memcpy(header.magic, chunkFileMagic, sizeof(header.magic));
+        return header;
+    }
+
+    TSDBHeader readHeader(const std::string& filename)
+    {
+        TSDBHeader header{};
+        std::ifstream inFile(filename, std::ios::binary);
+        if (!inFile.read(reinterpret_cast<char*>(&header), sizeof(TSDBHeader))) {
+            throw std::runtime_error("File too small to contain valid chunk file header: " + filename);
+        }
+        if (std::memcmp(header.magic, chunkFileMagic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("Invalid chunk file magic number: " + filename);
+        }
+        if (header.version != chunkFileVersion) {
+            throw std::runtime_error("Unsupported chunk file version: " + filename);
+        }
+        if (header.reserved[0] > static_cast<uint8_t>(ChecksumAlgorithm::Crc32c)) {
+            throw std::runtime_error("Unsupported checksum algorithm: " + filename);
+        }
+        if (header.recordSize != sizeof(Record)) {
+            throw std::runtime_error("Record size mismatch: " + filename);
+        }
+        return header;
+    }
+}
+
+SeriesEngine::SeriesEngine(const std::string& directory, const SeriesEngineOptions& options) : directory(directory),
+    dataFilename(chunkFilename(directory)), checksumAlgorithm(options.checksumAlgorithm), catalog(catalogFilename(directory)),
+    segmentDuration(std::max<int64_t>(options.segmentDuration, 0)), segmentBytes(options.segmentBytes),
+    retentionAge(std::max<int64_t>(options.retentionAge, 0)), retentionBytes(options.retentionBytes),
+    compactor(options.compactionAge, options.compactionBytesPerSecond), reorderWindow(std::max<int64_t>(options.reorderWindow, 0)),
+    chunkRecords(std::max<size_t>(options.chunkRecords, 1)), maxChunkAge(options.maxChunkAge),
+    fullChunksPerFlush(std::max<size_t>(options.flushThresholdRecords / chunkRecords, 1)),
+    syncSchedule(options.durability, options.syncInterval), writeAheadLog(options.writeAheadLog),
+    maxLogLatency(options.maxLogLatency), checkpointRecords(std::max<size_t>(options.checkpointRecords, 1)),
+    checkpointInterval(options.checkpointInterval), logFilename((std::filesystem::path(directory) / "wal").string())
+{
+    std::vector<uint64_t> sealed = listSegments();
+    openDataFile(options, sealed);
+
+    for (uint32_t id = 0; id < catalog.size(); ++id)
+    {
+        series.push_back(std::make_unique<Series>(id));
+    }
+    recoverChunks(sealed);
+    if (writeAheadLog || std::filesystem::exists(logFilename)) openWriteAheadLog();
+
+    flushThread = std::thread(&SeriesEngine::flushLoop, this);
+    compactor.start([this]() { return compactNext(); });
+}
+
+SeriesEngine::~SeriesEngine()
+{
+    //a compaction in progress is abandoned; its segment stays as it was
+    compactor.stop();
+
+    {
+        std::lock_guard<std::mutex> lock(flushWakeupMutex);
+        running = false;
+    }
+    flushWakeup.notify_one();
+    if (flushThread.joinable()) flushThread.join();
+
+    //a destructor cannot throw, so a failure here is only kept
+    if (!flushFailed)
+    {
+        try
+        {
+            flush(true);
+        }
+        catch (...)
+        {
+            failFlushes(std::current_exception());
+        }
+    }
+
+    if (fd >= 0) ::close(fd);
+}
+
+bool SeriesEngine::append(const std::string& name, Record r)
+{
+    throwIfFlushFailed();
+    Series& s = seriesFor(name);
+    r.crc = static_cast<int32_t>(recordChecksum(r, checksumAlgorithm));
+
+    size_t before;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!acceptable(s, r.timestamp)) return false;
+        before = s.pending.size();
+        queue(s, r);
+    }
+    queued(s, before, before + 1);
+    return true;
+}
+
+BatchAppendResult SeriesEngine::appendBatch(const std::string& name, std::span<const Record> records)
+{
+    if (records.empty()) return {0, 0};
+    throwIfFlushFailed();
+
+    Series& s = seriesFor(name);
+    std::vector<Record> accepted(records.begin(), records.end());
+    fillRecordChecksums(accepted.data(), accepted.size(), checksumAlgorithm);
+
+    //as for Storage, each record is checked against the records accepted before it
+    size_t before;
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        before = s.pending.size();
+        for (const Record& r : accepted)
+        {
+            if (!acceptable(s, r.timestamp)) continue;
+            queue(s, r);
+            ++count;
+        }
+    }
+    if (count > 0) queued(s, before, before + count);
+    return {count, records.size() - count};
+}
+
+std::future<bool> SeriesEngine::appendDurable(const std::string& name, Record r)
+{
+    std::promise<bool> promise;
+    std::future<bool> future = promise.get_future();
+    Series& s = seriesFor(name);
+    r.crc = static_cast<int32_t>(recordChecksum(r, checksumAlgorithm));
+
+    //as for Storage, the record commits the series' reorder window up to it
+    size_t before;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!acceptable(s, r.timestamp))
+        {
+            promise.set_value(false);
+            return future;
+        }
+        before = s.pending.size();
+        queue(s, r);
+        s.committed = r.timestamp;
+    }
+    queued(s, before, before + 1);
+
+    {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (flushFailure)
+        {
+            promise.set_exception(flushFailure);
+            return future;
+        }
+        durableWaiters.push_back({&s, r.timestamp, std::move(promise)});
+    }
+    signalFlush(true);
+    return future;
+}
+
+std::vector<Record> SeriesEngine::readRange(const std::string& name, int64_t startTs, int64_t endTs) const
+{
+    if (startTs > endTs) throw std::runtime_error("Invalid time range");
+
+    std::vector<Record> records;
+    Series* s = findSeries(name);
+    if (!s) return records;
+
+    auto byTimestamp = [](const Record& r, int64_t ts) { return r.timestamp < ts; };
+    auto afterTimestamp = [](int64_t ts, const Record& r) { return ts < r.timestamp; };
+
+    //chunks are listed in timestamp order, so the ones overlapping the range are a contiguous run;
+    //listed chunks never change, so they are read after the lock is released from the files found under it
+    std::vector<std::pair<ChunkInfo, std::shared_ptr<FileReader>>> chunks;
+    std::vector<Record> unflushed;
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        auto first = std::lower_bound(s->chunks.begin(), s->chunks.end(), startTs,
+                                      [](const ChunkInfo& c, int64_t ts) { return c.lastTimestamp < ts; });
+        for (auto it = first; it != s->chunks.end() && it->firstTimestamp <= endTs; ++it)
+        {
+            chunks.emplace_back(*it, fileFor(*it));
+        }
+        for (const std::vector<Record>* queue : {&s->flushing, &s->pending})
+        {
+            auto begin = std::lower_bound(queue->begin(), queue->end(), startTs, byTimestamp);
+            unflushed.insert(unflushed.end(), begin, std::upper_bound(begin, queue->end(), endTs, afterTimestamp));
+        }
+    }
+
+    for (const auto& [chunk, file] : chunks)
+    {
+        readChunk(*file, chunk, startTs, endTs, records);
+    }
+    records.insert(records.end(), unflushed.begin(), unflushed.end());
+    return records;
+}
+
+std::optional<Record> SeriesEngine::readFromTime(const std::string& name, int64_t timestamp) const
+{
+    std::vector<Record> result = readRange(name, timestamp, timestamp);
+    if (result.empty()) return std::nullopt;
+    return result.front();
+}
+
+std::optional<Record> SeriesEngine::getLastRecord(const std::string& name) const
+{
+    Series* s = findSeries(name);
+    if (!s) return std::nullopt;
+
+    ChunkInfo last;
+    std::shared_ptr<FileReader> file;
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        if (!s->pending.empty()) return s->pending.back();
+        if (!s->flushing.empty()) return s->flushing.back();
+        if (s->chunks.empty()) return std::nullopt;
+        last = s->chunks.back();
+        file = fileFor(last);
+    }
+
+    std::vector<Record> records;
+    readChunk(*file, last, last.lastTimestamp, last.lastTimestamp, records);
+    return records.back();
+}
+
+std::vector<std::string> SeriesEngine::getSeriesNames() const
+{
+    return catalog.getNames();
+}
+
+size_t SeriesEngine::getSeriesCount() const
+{
+    return catalog.size();
+}
+
+size_t SeriesEngine::getChunkCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(seriesMutex);
+    size_t count = 0;
+    for (const auto& s : series)
+    {
+        std::lock_guard<std::mutex> seriesLock(s->mutex);
+        count += s->chunks.size();
+    }
+    return count;
+}
+
+size_t SeriesEngine::getSegmentCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(fileMutex);
+    return segments.size();
+}
+
+ChecksumAlgorithm SeriesEngine::getChecksumAlgorithm() const
+{
+    return checksumAlgorithm;
+}
+
+void SeriesEngine::removeFiles(const std::string& directory)
+{
+    std::filesystem::remove(std::filesystem::path(directory) / "catalog");
+    std::filesystem::remove(chunkFilename(directory));
+    std::filesystem::remove(std::filesystem::path(directory) / "wal");
+
+    std::error_code ignored;
+    std::string prefix = std::filesystem::path(chunkFilename(directory)).filename().string() + ".seg";
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ignored))
+    {
+        if (entry.path().filename().string().starts_with(prefix)) std::filesystem::remove(entry.path());
+    }
+    std::filesystem::remove(directory, ignored);
+}
+
+std::vector<uint64_t> SeriesEngine::listSegments() const
+{
+    //sealed segments are found by name; compaction copies carry a suffix and are left alone
+    std::vector<uint64_t> sealed;
+    for (const SegmentFile& file : listSegmentFiles(dataFilename))
+    {
+        if (file.suffix.empty()) sealed.push_back(file.sequence);
+    }
+    std::sort(sealed.begin(), sealed.end());
+    return sealed;
+}
+
+void SeriesEngine::openDataFile(const SeriesEngineOptions& options, const std::vector<uint64_t>& sealed)
+{
+    //a crash right after a rollover leaves no active file; the new one keeps the segments' algorithm
+    TSDBHeader header = chunkFileHeader(options.checksumAlgorithm, 0);
+    if (std::filesystem::exists(dataFilename))
+    {
+        header = readHeader(dataFilename);
+    }
+    else
+    {
+        if (!sealed.empty()) header = readHeader(segmentFilename(dataFilename, sealed.back()));
+        std::ofstream outFile(dataFilename, std::ios::binary);
+        if (!outFile.is_open()) {
+            throw std::runtime_error("Failed to open file for writing: " + dataFilename);
+        }
+        outFile.write(reinterpret_cast<const char*>(&header), sizeof(TSDBHeader));
+    }
+
+    checksumAlgorithm = static_cast<ChecksumAlgorithm>(header.reserved[0]);
+
+    fd = ::open(dataFilename.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open data file");
+    }
+}
+
+void SeriesEngine::createDataFile(const TSDBHeader& header)
+{
+    fd = ::open(dataFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open data file");
+    }
+    if (::write(fd, &header, sizeof(TSDBHeader)) != static_cast<ssize_t>(sizeof(TSDBHeader))) {
+        throw std::runtime_error("Partial write");
+    }
+}
+
+void SeriesEngine::recoverChunks(const std::vector<uint64_t>& sealed)
+{
+    //each file picks up the series where the one before it left off
+    std::vector<int64_t> lastTimestamps(series.size(), std::numeric_limits<int64_t>::min());
+    for (uint64_t sequence : sealed)
+    {
+        std::string filename = segmentFilename(dataFilename, sequence);
+        if (readHeader(filename).reserved[0] != static_cast<uint8_t>(checksumAlgorithm)) {
+            throw std::runtime_error("Checksum algorithm mismatch: " + filename);
+        }
+        auto file = std::make_shared<FileReader>(filename, ReadMode::Pread);
+        ChunkFile segment = recoverFile(filename, *file, lastTimestamps);
+        segment.sequence = sequence;
+        segments.push_back(segment);
+        readers.emplace(segment.key, file);
+    }
+
+    auto file = std::make_shared<FileReader>(dataFilename, ReadMode::Pread);
+    active = recoverFile(dataFilename, *file, lastTimestamps);
+    active.sequence = sealed.empty() ? 0 : sealed.back() + 1;
+    readers.emplace(active.key, file);
+    dataEnd = active.bytes;
+
+    for (size_t id = 0; id < series.size(); ++id)
+    {
+        series[id]->lastTimestamp = lastTimestamps[id];
+        series[id]->committed = lastTimestamps[id];
+        newestWritten = std::max(newestWritten.load(), lastTimestamps[id]);
+    }
+}
+
+SeriesEngine::ChunkFile SeriesEngine::recoverFile(const std::string& filename, const FileReader& file, std::vector<int64_t>& lastTimestamps)
+{
+    uint64_t fileSize = file.size();
+    ChunkFile found{0, nextFileKey++, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), sizeof(TSDBHeader)};
+
+    //walk the chunk headers; the first torn or inconsistent one marks the end of the valid data
+    struct Walked
+    {
+        ChunkHeader header;
+        ChunkInfo chunk;
+    };
+    std::vector<Walked> walked;
+    std::vector<int64_t> seen = lastTimestamps;
+    uint64_t offset = sizeof(TSDBHeader);
+    while (offset + sizeof(ChunkHeader) <= fileSize)
+    {
+        ChunkHeader h{};
+        file.read(&h, sizeof(ChunkHeader), offset);
+
+        uint64_t end = offset + sizeof(ChunkHeader) + static_cast<uint64_t>(h.count) * sizeof(Record);
+        bool valid = h.checksum == headerChecksum(h) &&
+                     h.count > 0 &&
+                     h.firstTimestamp <= h.lastTimestamp &&
+                     end <= fileSize &&
+                     h.seriesId < series.size() &&
+                     h.firstTimestamp > seen[h.seriesId];
+        if (!valid) break;
+
+        walked.push_back({h, {offset, h.count, found.key, h.firstTimestamp, h.lastTimestamp}});
+        seen[h.seriesId] = h.lastTimestamp;
+        offset = end;
+    }
+
+    //chunks after the last flush marker belong to a flush that did not finish; the last finished flush
+    //may still have been torn mid-payload, so its records are verified and it is dropped whole if any fail
+    size_t keep = walked.size();
+    while (keep > 0 && !(walked[keep - 1].header.flags & ChunkEndsFlush)) --keep;
+    while (keep > 0)
+    {
+        size_t begin = keep - 1;
+        while (begin > 0 && !(walked[begin - 1].header.flags & ChunkEndsFlush)) --begin;
+
+        bool intact = true;
+        std::vector<Record> records;
+        for (size_t i = begin; i < keep && intact; ++i)
+        {
+            records.resize(walked[i].chunk.count);
+            file.read(records.data(), records.size() * sizeof(Record), walked[i].chunk.offset + sizeof(ChunkHeader));
+            intact = verifyRecords(records.data(), records.size(), checksumAlgorithm) == records.size() &&
+                     records.front().timestamp == walked[i].chunk.firstTimestamp &&
+                     records.back().timestamp == walked[i].chunk.lastTimestamp;
+        }
+        if (intact) break;
+        keep = begin;
+    }
+
+    for (size_t i = 0; i < keep; ++i)
+    {
+        const ChunkInfo& chunk = walked[i].chunk;
+        series[walked[i].header.seriesId]->chunks.push_back(chunk);
+        lastTimestamps[walked[i].header.seriesId] = chunk.lastTimestamp;
+        found.oldestTimestamp = std::min(found.oldestTimestamp, chunk.firstTimestamp);
+        found.newestTimestamp = std::max(found.newestTimestamp, chunk.lastTimestamp);
+        found.bytes = chunk.offset + sizeof(ChunkHeader) + chunk.count * sizeof(Record);
+    }
+
+    if (found.bytes != fileSize && ::truncate(filename.c_str(), static_cast<off_t>(found.bytes)) != 0)
+    {
+        throw std::runtime_error("Failed to truncate chunk file");
+    }
+    return found;
+}
+
+bool SeriesEngine::rollDue(int64_t newest, uint64_t bytes) const
+{
+    //an empty active file never rolls, so a flush bigger than segmentBytes still gets written
+    if (dataEnd == sizeof(TSDBHeader)) return false;
+    if (segmentBytes > 0 && dataEnd + bytes > segmentBytes) return true;
+    return segmentDuration > 0 && segmentWindow(newest, segmentDuration) > segmentWindow(active.oldestTimestamp, segmentDuration);
+}
+
+void SeriesEngine::rollSegment()
+{
+    //the sealed file keeps its open descriptor, so a later sync still covers what it was owed
+    TSDBHeader header = chunkFileHeader(checksumAlgorithm, 0);
+    if (std::rename(dataFilename.c_str(), segmentFilename(dataFilename, active.sequence).c_str()) != 0) {
+        throw std::runtime_error("Failed to seal segment: " + dataFilename);
+    }
+    if (chunksUnsynced)
+    {
+        sealedUnsynced.add(fd);
+    }
+    else
+    {
+        ::close(fd);
+    }
+    fd = -1;
+    directoryUnsynced = true;
+    createDataFile(header);
+
+    ChunkFile sealed = active;
+    sealed.bytes = dataEnd;
+    active = {sealed.sequence + 1, nextFileKey++, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), sizeof(TSDBHeader)};
+    dataEnd = sizeof(TSDBHeader);
+    auto file = std::make_shared<FileReader>(dataFilename, ReadMode::Pread);
+
+    std::unique_lock<std::shared_mutex> lock(fileMutex);
+    segments.push_back(sealed);
+    readers.emplace(active.key, file);
+}
+
+void SeriesEngine::enforceRetention()
+{
+    if (retentionAge == 0 && retentionBytes == 0) return;
+
+    //segments leave from the front, so their chunks are at the front of every series that has any
+    std::lock_guard<std::mutex> changeLock(segmentChangeMutex);
+    std::vector<ChunkFile> expired;
+    {
+        std::shared_lock<std::shared_mutex> lock(fileMutex);
+        uint64_t held = dataEnd;
+        for (const ChunkFile& segment : segments) held += segment.bytes;
+        size_t drop = expiredSegments(segments, segments.size(), newestWritten.load(), retentionAge, retentionBytes, held,
+                                      [](const ChunkFile& segment) { return segment.newestTimestamp; },
+                                      [](const ChunkFile& segment) { return segment.bytes; });
+        expired.assign(segments.begin(), segments.begin() + static_cast<std::ptrdiff_t>(drop));
+    }
+    if (expired.empty()) return;
+
+    //chunks are unlisted before their files are closed, so a reader that still finds a chunk finds its file
+    auto isExpired = [&](const ChunkInfo& chunk) {
+        return std::any_of(expired.begin(), expired.end(), [&](const ChunkFile& segment) { return segment.key == chunk.file; });
+    };
+    {
+        std::shared_lock<std::shared_mutex> lock(seriesMutex);
+        for (const auto& s : series)
+        {
+            std::lock_guard<std::mutex> seriesLock(s->mutex);
+            auto kept = std::find_if_not(s->chunks.begin(), s->chunks.end(), isExpired);
+            s->chunks.erase(s->chunks.begin(), kept);
+        }
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(fileMutex);
+        segments.erase(segments.begin(), segments.begin() + static_cast<std::ptrdiff_t>(expired.size()));
+        for (const ChunkFile& segment : expired) readers.erase(segment.key);
+    }
+
+    //a reader still holding a dropped file keeps reading it after the unlink
+    for (const ChunkFile& segment : expired) std::filesystem::remove(segmentFilename(dataFilename, segment.sequence));
+}
+
+bool SeriesEngine::compactNext()
+{
+    std::optional<ChunkFile> next;
+    {
+        std::shared_lock<std::shared_mutex> lock(fileMutex);
+        next = compactor.candidate(std::span<const ChunkFile>(segments), newestWritten.load(),
+                                   [](const ChunkFile& segment) { return segment.sequence; },
+                                   [](const ChunkFile& segment) { return segment.newestTimestamp; });
+    }
+    if (!next) return false;
+
+    std::string segmentFile = segmentFilename(dataFilename, next->sequence);
+    try
+    {
+        if (readHeader(segmentFile).reserved[1] != compactedSegmentMark && !compactSegment(*next)) return false;
+    }
+    catch (const std::exception&)
+    {
+        //the segment stays in place and is still read correctly, so a failed compaction only skips it
+        std::filesystem::remove(segmentFile + ".compact");
+    }
+    compactor.done(next->sequence);
+    return true;
+}
+
+bool SeriesEngine::compactSegment(const ChunkFile& segment)
+{
+    std::shared_ptr<FileReader> source;
+    {
+        std::shared_lock<std::shared_mutex> lock(fileMutex);
+        auto found = readers.find(segment.key);
+        if (found == readers.end()) return true;
+        source = found->second;
+    }
+
+    //a sealed segment's chunks only leave with the whole segment, so they are listed once up front
+    std::vector<std::pair<Series*, std::vector<ChunkInfo>>> merged;
+    {
+        std::shared_lock<std::shared_mutex> lock(seriesMutex);
+        for (const auto& s : series)
+        {
+            std::lock_guard<std::mutex> seriesLock(s->mutex);
+            std::vector<ChunkInfo> chunks;
+            std::copy_if(s->chunks.begin(), s->chunks.end(), std::back_inserter(chunks),
+                         [&](const ChunkInfo& chunk) { return chunk.file == segment.key; });
+            if (!chunks.empty()) merged.emplace_back(s.get(), std::move(chunks));
+        }
+    }
+
+    std::string compacted = segmentFilename(dataFilename, segment.sequence) + ".compact";
+    int out = ::open(compacted.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        throw std::runtime_error("Failed to open file for writing: " + compacted);
+    }
+
+    //each series goes out as one flagged chunk, so recovery checks no more than the last one
+    uint64_t offset = sizeof(TSDBHeader);
+    uint64_t bytesRead = 0;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    try
+    {
+        TSDBHeader header = chunkFileHeader(checksumAlgorithm, compactedSegmentMark);
+        if (::write(out, &header, sizeof(TSDBHeader)) != static_cast<ssize_t>(sizeof(TSDBHeader))) {
+            throw std::runtime_error("Partial write");
+        }
+
+        std::vector<Record> records;
+        for (auto& [s, chunks] : merged)
+        {
+            records.clear();
+            for (const ChunkInfo& chunk : chunks)
+            {
+                size_t before = records.size();
+                records.resize(before + chunk.count);
+                source->read(records.data() + before, chunk.count * sizeof(Record), chunk.offset + sizeof(ChunkHeader));
+            }
+            size_t bad = verifyRecords(records.data(), records.size(), checksumAlgorithm);
+            if (bad != records.size()) {
+                throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(records[bad].timestamp));
+            }
+
+            //a chunk counts its records in 32 bits, so a series holding more than that takes several
+            chunks.clear();
+            for (size_t first = 0; first < records.size();)
+            {
+                size_t count = std::min<size_t>(records.size() - first, std::numeric_limits<uint32_t>::max());
+                const Record* run = records.data() + first;
+                ChunkHeader h{s->id, static_cast<uint32_t>(count), run[0].timestamp, run[count - 1].timestamp,
+                              static_cast<uint32_t>(ChunkEndsFlush), 0};
+                h.checksum = headerChecksum(h);
+                std::vector<char> buffer(reinterpret_cast<const char*>(&h), reinterpret_cast<const char*>(&h) + sizeof(h));
+                buffer.insert(buffer.end(), reinterpret_cast<const char*>(run), reinterpret_cast<const char*>(run + count));
+                if (::write(out, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size())) {
+                    throw std::runtime_error("Partial write");
+                }
+
+                chunks.push_back({offset, h.count, 0, h.firstTimestamp, h.lastTimestamp});
+                offset += buffer.size();
+                first += count;
+            }
+            bytesRead += records.size() * sizeof(Record);
+            if (!compactor.pace(started, bytesRead))
+            {
+                ::close(out);
+                std::filesystem::remove(compacted);
+                return false;
+            }
+        }
+
+        //the rewrite replaces data that may already be durable, so it is synced whatever the mode
+        syncFile(out, false);
+    }
+    catch (...)
+    {
+        ::close(out);
+        throw;
+    }
+    ::close(out);
+
+    swapCompactedSegment(segment, compacted, offset, merged);
+    return true;
+}
+
+void SeriesEngine::swapCompactedSegment(const ChunkFile& segment, const std::string& compacted, uint64_t bytes,
+                                        const std::vector<std::pair<Series*, std::vector<ChunkInfo>>>& merged)
+{
+    std::string segmentFile = segmentFilename(dataFilename, segment.sequence);
+    auto file = std::make_shared<FileReader>(compacted, ReadMode::Pread);
+    uint32_t key = nextFileKey++;
+
+    std::lock_guard<std::mutex> changeLock(segmentChangeMutex);
+    {
+        std::unique_lock<std::shared_mutex> lock(fileMutex);
+        auto position = std::find_if(segments.begin(), segments.end(), [&](const ChunkFile& kept) { return kept.key == segment.key; });
+        if (position == segments.end())
+        {
+            //retention dropped the segment while it was being compacted
+            lock.unlock();
+            std::filesystem::remove(compacted);
+            return;
+        }
+        position->key = key;
+        position->bytes = bytes;
+        readers.emplace(key, file);
+    }
+
+    //both files are open while the series switch over, so every chunk a reader finds can be read; the
+    //segment's chunks sit together in each series since they only leave with the segment
+    for (const auto& [s, chunks] : merged)
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        auto first = std::find_if(s->chunks.begin(), s->chunks.end(), [&](const ChunkInfo& chunk) { return chunk.file == segment.key; });
+        auto last = std::find_if(first, s->chunks.end(), [&](const ChunkInfo& chunk) { return chunk.file != segment.key; });
+        std::vector<ChunkInfo> replacement = chunks;
+        for (ChunkInfo& chunk : replacement) chunk.file = key;
+        first = s->chunks.erase(first, last);
+        s->chunks.insert(first, replacement.begin(), replacement.end());
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(fileMutex);
+        readers.erase(segment.key);
+    }
+
+    //renaming is the switch on disk; readers still holding the old file finish on its unlinked copy
+    std::filesystem::rename(compacted, segmentFile);
+    syncDirectoryOf(dataFilename);
+}
+
+void SeriesEngine::syncFiles()
+{
+    sealedUnsynced.sync(syncSchedule.dataOnly());
+    syncSchedule.sync(fd);
+    if (directoryUnsynced)
+    {
+        syncDirectoryOf(dataFilename);
+        directoryUnsynced = false;
+    }
+    chunksUnsynced = false;
+    if (!log)
+    {
+        unsynced = false;
+        syncSchedule.synced();
+    }
+}
+
+uint32_t SeriesEngine::headerChecksum(ChunkHeader header) const
+{
+    header.checksum = 0;
+    return checksumBytes(&header, sizeof(ChunkHeader), checksumAlgorithm);
+}
+
+SeriesEngine::Series* SeriesEngine::findSeries(const std::string& name) const
+{
+    std::optional<uint32_t> id = catalog.find(name);
+    if (!id.has_value()) return nullptr;
+
+    std::shared_lock<std::shared_mutex> lock(seriesMutex);
+    return *id < series.size() ? series[*id].get() : nullptr;
+}
+
+SeriesEngine::Series& SeriesEngine::seriesFor(const std::string& name)
+{
+    uint32_t id = catalog.getOrCreate(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(seriesMutex);
+        if (id < series.size()) return *series[id];
+    }
+
+    //ids are dense, so a new series may also bring in others created concurrently
+    std::unique_lock<std::shared_mutex> lock(seriesMutex);
+    while (series.size() <= id)
+    {
+        series.push_back(std::make_unique<Series>(static_cast<uint32_t>(series.size())));
+    }
+    return *series[id];
+}
+
+bool SeriesEngine::acceptable(const Series& s, int64_t timestamp) const
+{
+    //without a window the floor already holds a series to strictly increasing timestamps
+    if (timestamp <= std::max(s.committed, windowStart(s.lastTimestamp, reorderWindow))) return false;
+    auto byTimestamp = [](const Record& r, int64_t ts) { return r.timestamp < ts; };
+    auto held = std::lower_bound(s.pending.begin(), s.pending.end(), timestamp, byTimestamp);
+    return held == s.pending.end() || held->timestamp != timestamp;
+}
+
+void SeriesEngine::queue(Series& s, const Record& r)
+{
+    //a late record is placed among those its series still holds
+    auto byTimestamp = [](int64_t ts, const Record& held) { return ts < held.timestamp; };
+    s.pending.insert(std::upper_bound(s.pending.begin(), s.pending.end(), r.timestamp, byTimestamp), r);
+    s.lastTimestamp = std::max(s.lastTimestamp, r.timestamp);
+    if (log) s.unlogged.push_back(r);
+}
+
+void SeriesEngine::queued(const Series& s, size_t before, size_t after)
+{
+    //the first pending record lists the series and may set an earlier age deadline
+    if (before == 0)
+    {
+        bool wasEmpty;
+        {
+            std::lock_guard<std::mutex> lock(dirtyMutex);
+            wasEmpty = dirty.empty();
+            dirty.push_back({s.id, std::chrono::steady_clock::now()});
+        }
+        if (wasEmpty) signalFlush(false);
+    }
+
+    //the first record since the log was last written starts its latency deadline
+    if (log && !logPending.load(std::memory_order_relaxed) && !logPending.exchange(true))
+    {
+        {
+            std::lock_guard<std::mutex> lock(flushWakeupMutex);
+            unloggedSince = std::chrono::steady_clock::now();
+        }
+        flushWakeup.notify_one();
+    }
+
+    //a series filling its chunk counts once; enough full chunks flush now
+    if (before < chunkRecords && after >= chunkRecords && fullChunks.fetch_add(1) + 1 >= fullChunksPerFlush)
+    {
+        signalFlush(true);
+    }
+}
+
+void SeriesEngine::signalFlush(bool requested)
+{
+    {
+        std::lock_guard<std::mutex> lock(flushWakeupMutex);
+        if (requested) flushRequested = true;
+    }
+    flushWakeup.notify_one();
+}
+
+std::optional<std::chrono::steady_clock::time_point> SeriesEngine::oldestDirty()
+{
+    std::lock_guard<std::mutex> lock(dirtyMutex);
+    if (dirty.empty()) return std::nullopt;
+    return dirty.front().since;
+}
+
+void SeriesEngine::waitForFlush()
+{
+    std::unique_lock<std::mutex> lock(flushWakeupMutex);
+    while (running && !flushRequested)
+    {
+        //the earliest of the chunk age, log latency and periodic sync deadlines that apply
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::optional<std::chrono::steady_clock::time_point> due = oldestDirty();
+        if (due.has_value()) *due += maxChunkAge;
+        if (logPending && (!due || unloggedSince + maxLogLatency < *due)) due = unloggedSince + maxLogLatency;
+        if (!due && syncSchedule.getMode() == DurabilityMode::Periodic && unsynced) due = syncSchedule.deadline();
+
+        if (due.has_value())
+        {
+            if (now >= *due) break;
+            flushWakeup.wait_until(lock, *due);
+        }
+        else if (flushWakeup.wait_for(lock, idleRecheck) == std::cv_status::timeout)
+        {
+            break;
+        }
+    }
+    flushRequested = false;
+}
+
+void SeriesEngine::flushLoop()
+{
+    //retention is checked on open and after every flush, including the idle rechecks
+    try
+    {
+        enforceRetention();
+    }
+    catch (...)
+    {
+        failFlushes(std::current_exception());
+    }
+
+    while (true)
+    {
+        waitForFlush();
+        if (!running) break;
+        if (flushFailed) continue;
+
+        try
+        {
+            flush(false);
+            enforceRetention();
+        }
+        catch (...)
+        {
+            failFlushes(std::current_exception());
+        }
+    }
+}
+
+void SeriesEngine::failFlushes(std::exception_ptr failure)
+{
+    std::lock_guard<std::mutex> lock(failureMutex);
+    if (!flushFailure) flushFailure = failure;
+    flushFailed = true;
+    for (DurableWaiter& waiter : durableWaiters) waiter.promise.set_exception(flushFailure);
+    durableWaiters.clear();
+}
+
+void SeriesEngine::throwIfFlushFailed()
+{
+    if (!flushFailed) return;
+
+    std::lock_guard<std::mutex> lock(failureMutex);
+    std::rethrow_exception(flushFailure);
+}
+
+void SeriesEngine::flush(bool closing)
+{
+    //a waiter's record is queued before it registers, so this flush takes or logs it
+    std::vector<std::promise<bool>> waiters = takeWaiters();
+    bool waiting = closing || !waiters.empty();
+    try
+    {
+        if (!log)
+        {
+            writeChunks(takeSeries(closing, nullptr));
+            if (unsynced && syncSchedule.due(waiting, 0)) syncFiles();
+        }
+        else
+        {
+            //every record a flush takes is logged first, so syncing the log makes the flush durable and the
+            //chunk files are only synced by the checkpoint that empties the log
+            logPending = false;
+            bool checkpointing = closing || checkpointDue();
+            std::vector<LogEntry> unlogged;
+            std::vector<Series*> taken = takeSeries(checkpointing, &unlogged);
+            appendToLog(unlogged);
+            writeChunks(taken);
+            if (checkpointing)
+            {
+                checkpoint();
+            }
+            else if (unsynced && syncSchedule.due(waiting, 0))
+            {
+                syncLog();
+            }
+        }
+    }
+    catch (...)
+    {
+        //the error sticks before any waiter wakes, so a caller that sees its append fail cannot append again
+        failFlushes(std::current_exception());
+        for (std::promise<bool>& waiter : waiters) waiter.set_exception(std::current_exception());
+        throw;
+    }
+    for (std::promise<bool>& waiter : waiters) waiter.set_value(true);
+}
+
+std::vector<std::promise<bool>> SeriesEngine::takeWaiters()
+{
+    std::vector<std::promise<bool>> taken;
+    std::lock_guard<std::mutex> lock(failureMutex);
+    for (DurableWaiter& waiter : durableWaiters) taken.push_back(std::move(waiter.promise));
+    durableWaiters.clear();
+    return taken;
+}
+
+std::vector<SeriesEngine::Series*> SeriesEngine::takeSeries(bool all, std::vector<LogEntry>* unlogged)
+{
+    //series whose chunk is full, whose oldest record has aged out or that a durable append committed are
+    //taken, the rest stay listed in order. the pending records the reorder window has left behind become
+    //the flushing run, which only this thread changes until the chunks are listed; the rest are listed again
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::vector<Series*> taken;
+    size_t full = 0;
+    {
+        std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+        std::deque<DirtySeries> kept;
+        for (const DirtySeries& entry : dirty)
+        {
+            Series* s;
+            {
+                std::shared_lock<std::shared_mutex> lock(seriesMutex);
+                s = series[entry.id].get();
+            }
+            std::lock_guard<std::mutex> lock(s->mutex);
+            if (unlogged)
+            {
+                for (const Record& r : s->unlogged) unlogged->push_back({s->id, logChecksum(s->id, r), r});
+                s->unlogged.clear();
+            }
+            if (!all && s->pending.size() < chunkRecords && now < entry.since + maxChunkAge &&
+                s->pending.front().timestamp > s->committed)
+            {
+                kept.push_back(entry);
+                continue;
+            }
+
+            int64_t limit = all ? s->lastTimestamp : std::max(s->committed, windowStart(s->lastTimestamp, reorderWindow));
+            auto end = std::upper_bound(s->pending.begin(), s->pending.end(), limit,
+                                        [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+            if (end == s->pending.begin())
+            {
+                kept.push_back({entry.id, now});
+                continue;
+            }
+
+            bool wasFull = s->pending.size() >= chunkRecords;
+            s->flushing.assign(s->pending.begin(), end);
+            s->pending.erase(s->pending.begin(), end);
+            s->committed = std::max(s->committed, limit);
+            if (wasFull && s->pending.size() < chunkRecords) ++full;
+            if (!s->pending.empty()) kept.push_back({entry.id, now});
+            taken.push_back(s);
+        }
+        dirty.swap(kept);
+    }
+    fullChunks.fetch_sub(full);
+    return taken;
+}
+
+void SeriesEngine::writeChunks(const std::vector<Series*>& taken)
+{
+    if (taken.empty()) return;
+
+    //the whole flush goes to one file, so a segment limit it would cross rolls the file over first
+    int64_t oldest = std::numeric_limits<int64_t>::max();
+    int64_t newest = std::numeric_limits<int64_t>::min();
+    uint64_t flushBytes = 0;
+    for (const Series* s : taken)
+    {
+        oldest = std::min(oldest, s->flushing.front().timestamp);
+        newest = std::max(newest, s->flushing.back().timestamp);
+        flushBytes += sizeof(ChunkHeader) + s->flushing.size() * sizeof(Record);
+    }
+    if (rollDue(newest, flushBytes)) rollSegment();
+
+    //every series goes out as one chunk, and the whole flush as one write
+    std::vector<char> buffer;
+    std::vector<ChunkInfo> written;
+    for (size_t i = 0; i < taken.size(); ++i)
+    {
+        const std::vector<Record>& run = taken[i]->flushing;
+        ChunkHeader h{taken[i]->id, static_cast<uint32_t>(run.size()), run.front().timestamp, run.back().timestamp,
+                      i + 1 == taken.size() ? static_cast<uint32_t>(ChunkEndsFlush) : 0u, 0};
+        h.checksum = headerChecksum(h);
+
+        written.push_back({dataEnd + buffer.size(), h.count, active.key, h.firstTimestamp, h.lastTimestamp});
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&h), reinterpret_cast<const char*>(&h) + sizeof(h));
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(run.data()), reinterpret_cast<const char*>(run.data() + run.size()));
+    }
+
+    //catalog entries reach disk before any chunk that refers to them
+    catalog.sync();
+
+    ssize_t bytes = ::write(fd, buffer.data(), buffer.size());
+    if (bytes != static_cast<ssize_t>(buffer.size())) {
+        throw std::runtime_error("Partial write");
+    }
+    dataEnd += buffer.size();
+    active.oldestTimestamp = std::min(active.oldestTimestamp, oldest);
+    active.newestTimestamp = std::max(active.newestTimestamp, newest);
+    newestWritten = std::max(newestWritten.load(), newest);
+    chunksUnsynced = true;
+    if (!log) unsynced = true;
+
+    for (size_t i = 0; i < taken.size(); ++i)
+    {
+        std::lock_guard<std::mutex> lock(taken[i]->mutex);
+        taken[i]->chunks.push_back(written[i]);
+
+        //released rather than cleared so a series that goes quiet holds no buffer
+        std::vector<Record>().swap(taken[i]->flushing);
+    }
+}
+
+void SeriesEngine::openWriteAheadLog()
+{
+    log = std::make_unique<WriteAheadLog<LogEntry>>(logFilename);
+
+    //the log ends at a torn or corrupt entry, which only a crash mid-write leaves; a series' entries are in
+    //the order they were appended, which the reorder window lets run back
+    std::vector<LogEntry> entries = log->recover([this](const std::vector<LogEntry>& logged) {
+        size_t valid = 0;
+        for (; valid < logged.size(); ++valid)
+        {
+            const LogEntry& entry = logged[valid];
+            if (entry.seriesId >= series.size() || entry.checksum != logChecksum(entry.seriesId, entry.record) ||
+                static_cast<uint32_t>(entry.record.crc) != recordChecksum(entry.record, checksumAlgorithm))
+            {
+                break;
+            }
+        }
+        return valid;
+    });
+
+    //records a checkpoint wrote before it could empty the log are already in chunks, and every record a
+    //flush left out of them is newer than what it wrote
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Series& s = *series[entries[i].seriesId];
+        const Record& r = entries[i].record;
+        if (r.timestamp <= s.committed) continue;
+        if (s.pending.empty()) dirty.push_back({s.id, now});
+        auto byTimestamp = [](int64_t ts, const Record& held) { return ts < held.timestamp; };
+        s.pending.insert(std::upper_bound(s.pending.begin(), s.pending.end(), r.timestamp, byTimestamp), r);
+        s.lastTimestamp = std::max(s.lastTimestamp, r.timestamp);
+        if (s.pending.size() == chunkRecords) ++fullChunks;
+    }
+
+    //without the log from now on, what it held goes to chunks before anything newer
+    if (!writeAheadLog)
+    {
+        writeChunks(takeSeries(true, nullptr));
+        checkpoint();
+        log.reset();
+        std::filesystem::remove(logFilename);
+    }
+}
+
+uint32_t SeriesEngine::logChecksum(uint32_t seriesId, const Record& r) const
+{
+    uint32_t covered[2] = {seriesId, static_cast<uint32_t>(r.crc)};
+    return checksumBytes(covered, sizeof(covered), checksumAlgorithm);
+}
+
+void SeriesEngine::appendToLog(const std::vector<LogEntry>& entries)
+{
+    if (entries.empty()) return;
+
+    //catalog entries reach disk before any log entry that refers to them
+    catalog.sync();
+
+    log->append(entries);
+    unsynced = true;
+}
+
+bool SeriesEngine::checkpointDue() const
+{
+    size_t held = log->size();
+    return held > 0 && (held >= checkpointRecords || std::chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval);
+}
+
+void SeriesEngine::checkpoint()
+{
+    //the log is emptied only once the chunk files hold its records durably
+    if (chunksUnsynced || directoryUnsynced || !sealedUnsynced.empty()) syncFiles();
+    log->clear();
+    unsynced = false;
+    lastCheckpoint = std::chrono::steady_clock::now();
+    syncSchedule.synced();
+}
+
+void SeriesEngine::syncLog()
+{
+    log->sync(syncSchedule.dataOnly());
+    unsynced = false;
+    syncSchedule.synced();
+}
+
+std::shared_ptr<FileReader> SeriesEngine::fileFor(const ChunkInfo& chunk) const
+{
+    std::shared_lock<std::shared_mutex> lock(fileMutex);
+    return readers.at(chunk.file);
+}
+
+void SeriesEngine::readChunk(const FileReader& file, const ChunkInfo& chunk, int64_t startTs, int64_t endTs, std::vector<Record>& out) const
+{
+    std::vector<Record> records(chunk.count);
+    file.read(records.data(), records.size() * sizeof(Record), chunk.offset + sizeof(ChunkHeader));
+
+    auto begin = std::lower_bound(records.begin(), records.end(), startTs,
+                                  [](const Record& r, int64_t ts) { return r.timestamp < ts; });
+    auto end = std::upper_bound(begin, records.end(), endTs,
+                                [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+
+    size_t count = static_cast<size_t>(end - begin);
+    size_t bad = verifyRecords(records.data() + (begin - records.begin()), count, checksumAlgorithm);
+    if (bad != count) {
+        throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(begin[bad].timestamp));
+    }
+    out.insert(out.end(), begin, end);
+}
@@ -0,0 +1,239 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <span>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+#include <limits>
+#include <exception>
+#include <future>
+#include "Record.hpp"
+#include "TSDBHeader.hpp"
+#include "SeriesFormat.hpp"
+#include "SeriesCatalog.hpp"
+#include "SeriesEngineOptions.hpp"
+#include "FileReader.hpp"
+#include "BatchAppendResult.hpp"
+#include "SegmentFiles.hpp"
+#include "CompactionWorker.hpp"
+#include "SyncSchedule.hpp"
+#include "WriteAheadLog.hpp"
+
+//many named series in one directory: a catalog maps names to ids and every series shares one active chunk
+//file and one flush thread, so file descriptors and threads stay fixed as series are added. per series only
+//the queued records and the location of its chunks are kept in memory; records are queued per series
+//until they fill a chunk or age out, so a series' data sits in a few large chunks rather than one per flush.
+//the chunk file rolls over into sealed segments, which retention drops whole and compaction rewrites with
+//each series' chunks merged into one, as Storage does with its files. with a write-ahead log, queued records
+//are logged and synced in one sequential file and reach chunks at their own pace.
+class SeriesEngine
+{
+public:
+    //constructor
+    explicit SeriesEngine(const std::string& directory, const SeriesEngineOptions& options = {});
+
+    //destructor
+    ~SeriesEngine();
+
+    SeriesEngine(const SeriesEngine&) = delete;
+    SeriesEngine& operator=(const SeriesEngine&) = delete;
+
+    //write functions; a series is created by its first append and keeps its own reorder window. once a
+    //flush has failed append and appendBatch throw its error and appendDurable futures fail with it
+    bool append(const std::string& series, Record r);
+    BatchAppendResult appendBatch(const std::string& series, std::span<const Record> records);
+    std::future<bool> appendDurable(const std::string& series, Record r);
+
+    //read functions; records are visible as soon as they are appended and unknown series read as empty
+    std::vector<Record> readRange(const std::string& series, int64_t startTs, int64_t endTs) const;
+    std::optional<Record> readFromTime(const std::string& series, int64_t timestamp) const;
+    std::optional<Record> getLastRecord(const std::string& series) const;
+
+    //getters
+    std::vector<std::string> getSeriesNames() const;
+    size_t getSeriesCount() const;
+    size_t getChunkCount() const;
+    size_t getSegmentCount() const;
+    ChecksumAlgorithm getChecksumAlgorithm() const;
+
+    //deletes the catalog, chunk file, sealed segments and log of an engine directory
+    static void removeFiles(const std::string& directory);
+
+private:
+    //file is the key of the chunk file holding the chunk
+    struct ChunkInfo
+    {
+        uint64_t offset;
+        uint32_t count;
+        uint32_t file;
+        int64_t firstTimestamp;
+        int64_t lastTimestamp;
+    };
+
+    //a sealed segment is the active file renamed to series.tsdb.seg<sequence> when it rolled over. files
+    //are named by a key given out on open rather than by sequence, so a file can be replaced by a new one
+    struct ChunkFile
+    {
+        uint64_t sequence;
+        uint32_t key;
+        int64_t oldestTimestamp;
+        int64_t newestTimestamp;
+        uint64_t bytes;
+    };
+
+    //records move from pending to flushing when a flush takes them and leave flushing once their chunk
+    //is listed, all under the series mutex, so readers always find each record in exactly one place.
+    //pending is in timestamp order; records at or before committed are final. unlogged holds the records
+    //not yet in the write-ahead log in the order they were appended
+    struct Series
+    {
+        explicit Series(uint32_t id) : id(id) {}
+        const uint32_t id;
+        std::mutex mutex;
+        int64_t lastTimestamp = std::numeric_limits<int64_t>::min();
+        int64_t committed = std::numeric_limits<int64_t>::min();
+        std::vector<Record> pending;
+        std::vector<Record> unlogged;
+        std::vector<Record> flushing;
+        std::vector<ChunkInfo> chunks;
+    };
+
+    const std::string directory;
+    const std::string dataFilename;
+    ChecksumAlgorithm checksumAlgorithm;
+    SeriesCatalog catalog;
+
+    //sealed segments oldest first and a reader per file key, changed under the exclusive file lock. readers
+    //look a chunk's file up while holding its series mutex, and retention unlists chunks before it closes
+    //their file, so a listed chunk's file stays open while it is read
+    mutable std::shared_mutex fileMutex;
+    std::vector<ChunkFile> segments;
+    std::unordered_map<uint32_t, std::shared_ptr<FileReader>> readers;
+    std::atomic<uint32_t> nextFileKey{0};
+
+    //held while retention drops segments or compaction swaps one, so the two never interleave
+    std::mutex segmentChangeMutex;
+
+    //the active file; only the flush thread and the destructor touch it after the open
+    ChunkFile active{};
+    int fd = -1;
+    uint64_t dataEnd = 0;
+    std::atomic<int64_t> newestWritten{std::numeric_limits<int64_t>::min()};
+    const int64_t segmentDuration;
+    const size_t segmentBytes;
+    const int64_t retentionAge;
+    const size_t retentionBytes;
+
+    //background compaction
+    CompactionWorker compactor;
+
+    //indexed by series id; entries are never removed, so a pointer stays valid once looked up
+    const int64_t reorderWindow;
+    mutable std::shared_mutex seriesMutex;
+    std::vector<std::unique_ptr<Series>> series;
+
+    //series with pending records in the order they got their first one, each listed once until a flush
+    //takes it; the front sets the next chunk age deadline
+    struct DirtySeries
+    {
+        uint32_t id;
+        std::chrono::steady_clock::time_point since;
+    };
+    std::mutex dirtyMutex;
+    std::deque<DirtySeries> dirty;
+
+    //flushing
+    std::atomic<bool> running{true};
+    std::thread flushThread;
+    const size_t chunkRecords;
+    const std::chrono::milliseconds maxChunkAge;
+    const size_t fullChunksPerFlush;
+    std::atomic<size_t> fullChunks{0};
+    std::mutex flushWakeupMutex;
+    std::condition_variable flushWakeup;
+    bool flushRequested = false;
+
+    //durable appends waiting on the sync of the flush that takes their record
+    struct DurableWaiter
+    {
+        Series* series;
+        int64_t timestamp;
+        std::promise<bool> promise;
+    };
+
+    //the first failed flush is kept and rethrown by every later append; after it nothing more is written,
+    //and records it had taken stay readable from memory. failureMutex guards the waiters too
+    std::atomic<bool> flushFailed{false};
+    std::exception_ptr flushFailure;
+    std::mutex failureMutex;
+    std::vector<DurableWaiter> durableWaiters;
+
+    //durability; only touched by the flush thread and the destructor. unsynced covers what the mode syncs,
+    //the log when there is one and the chunk files otherwise
+    SyncSchedule syncSchedule;
+    bool unsynced = false;
+    bool chunksUnsynced = false;
+
+    //a rolled file keeps its descriptor until the next sync covers it, together with the rename
+    UnsyncedFiles sealedUnsynced;
+    bool directoryUnsynced = false;
+
+    //write-ahead log; the flush thread and the open and close write it. producers only raise logPending,
+    //and the first of them since the last log write sets unloggedSince under the wakeup mutex
+    const bool writeAheadLog;
+    const std::chrono::milliseconds maxLogLatency;
+    const size_t checkpointRecords;
+    const std::chrono::milliseconds checkpointInterval;
+    const std::string logFilename;
+    std::unique_ptr<WriteAheadLog<LogEntry>> log;
+    std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+    std::atomic<bool> logPending{false};
+    std::chrono::steady_clock::time_point unloggedSince;
+
+    //private methods
+    std::vector<uint64_t> listSegments() const;
+    void openDataFile(const SeriesEngineOptions& options, const std::vector<uint64_t>& sealed);
+    void createDataFile(const TSDBHeader& header);
+    void recoverChunks(const std::vector<uint64_t>& sealed);
+    ChunkFile recoverFile(const std::string& filename, const FileReader& file, std::vector<int64_t>& lastTimestamps);
+    bool rollDue(int64_t newest, uint64_t bytes) const;
+    void rollSegment();
+    void enforceRetention();
+    bool compactNext();
+    bool compactSegment(const ChunkFile& segment);
+    void swapCompactedSegment(const ChunkFile& segment, const std::string& compacted, uint64_t bytes,
+                              const std::vector<std::pair<Series*, std::vector<ChunkInfo>>>& merged);
+    void syncFiles();
+    uint32_t headerChecksum(ChunkHeader header) const;
+    Series* findSeries(const std::string& name) const;
+    Series& seriesFor(const std::string& name);
+    bool acceptable(const Series& s, int64_t timestamp) const;
+    void queue(Series& s, const Record& r);
+    void queued(const Series& s, size_t before, size_t after);
+    void signalFlush(bool requested);
+    std::optional<std::chrono::steady_clock::time_point> oldestDirty();
+    void waitForFlush();
+    void flushLoop();
+    void flush(bool closing);
+    std::vector<std::promise<bool>> takeWaiters();
+    std::vector<Series*> takeSeries(bool all, std::vector<LogEntry>* unlogged);
+    void writeChunks(const std::vector<Series*>& taken);
+    void openWriteAheadLog();
+    uint32_t logChecksum(uint32_t seriesId, const Record& r) const;
+    void appendToLog(const std::vector<LogEntry>& entries);
+    bool checkpointDue() const;
+    void checkpoint();
+    void syncLog();
+    void failFlushes(std::exception_ptr failure);
+    void throwIfFlushFailed();
+    std::shared_ptr<FileReader> fileFor(const ChunkInfo& chunk) const;
+    void readChunk(const FileReader& file, const ChunkInfo& chunk, int64_t startTs, int64_t endTs, std::vector<Record>& out) const;
+};
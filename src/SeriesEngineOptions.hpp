@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <chrono>
+#include <cstdint>
+#include "StorageOptions.hpp"
+
+struct SeriesEngineOptions
+{
+    //checksum used when the chunk file is created; an existing file keeps the algorithm in its header
+    ChecksumAlgorithm checksumAlgorithm = ChecksumAlgorithm::Crc32c;
+
+    //a series is written as one chunk once it holds chunkRecords records or its oldest queued record has
+    //waited maxChunkAge; bigger chunks mean fewer and cheaper reads for longer exposure to a crash
+    size_t chunkRecords = 128;
+    std::chrono::milliseconds maxChunkAge{1000};
+
+    //full chunks are held back until this many records are waiting in them, so one write covers many series
+    size_t flushThresholdRecords = 65536;
+
+    //as for Storage, per series: records this far behind the newest one in their series are accepted
+    int64_t reorderWindow = 0;
+
+    //as for Storage, in timestamp units and bytes: the chunk file rolls over to a new segment before a flush
+    //that would take it past segmentBytes or whose newest record falls in a later segmentDuration window than
+    //its oldest one. retention drops the oldest sealed segments once all their records are more than
+    //retentionAge older than the newest one written, or while the chunk files take more than retentionBytes.
+    //0 turns a limit off
+    int64_t segmentDuration = 0;
+    size_t segmentBytes = 0;
+    int64_t retentionAge = 0;
+    size_t retentionBytes = 0;
+
+    //a background thread rewrites sealed segments whose records are all more than compactionAge older than
+    //the newest one written, merging each series' chunks in the segment into one, and swaps the segment in
+    //whole. it reads at most compactionBytesPerSecond; an age of 0 leaves compaction off and a rate of 0
+    //leaves it unthrottled
+    int64_t compactionAge = 0;
+    size_t compactionBytesPerSecond = 32 << 20;
+
+    //flushes log every queued record, with its series, to a sequential wal file in the directory and sync
+    //only that, so records are durable once the oldest unlogged one has waited maxLogLatency, whatever
+    //the chunk age. a checkpoint writes every queued series out as a chunk, syncs the chunk files and
+    //empties the log once checkpointRecords are logged or checkpointInterval has passed, and on close;
+    //opening replays what the log holds past the chunks
+    bool writeAheadLog = false;
+    std::chrono::milliseconds maxLogLatency{5};
+    size_t checkpointRecords = 1 << 16;
+    std::chrono::milliseconds checkpointInterval{1000};
+
+    //as for Storage; one sync covers every series in the flush
+    DurabilityMode durability = DurabilityMode::Fsync;
+    std::chrono::milliseconds syncInterval{100};
+};
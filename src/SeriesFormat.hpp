@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include "Record.hpp"
+
+//series engine directories hold a catalog file, the active chunk file, sealed segments and a log.
+//catalog: CatalogEntry followed by nameLength bytes of name, one per series in id order; the checksum
+//covers the id, the length and the name.
+//chunk file: TSDBHeader with its own magic, so neither engine opens the other's files, then chunks; a chunk is a ChunkHeader followed by count records of
+//one series in timestamp order. the header checksum covers the header alone and every record carries
+//its own crc, as in the row layout. the last chunk a flush writes is flagged, so recovery can tell
+//where a torn flush begins. sealed segments are chunk files too; a compacted one has one chunk per
+//series, each flagged, and is marked in TSDBHeader::reserved[1].
+//log: one LogEntry per logged record, each series' entries in timestamp order. the checksum covers the
+//series id and the record's crc, which covers the record; the log ends at the first entry that fails.
+struct CatalogEntry
+{
+    uint32_t id;
+    uint32_t nameLength;
+    uint32_t checksum;
+};
+
+struct ChunkHeader
+{
+    uint32_t seriesId;
+    uint32_t count;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint32_t flags;
+    uint32_t checksum;
+};
+
+struct LogEntry
+{
+    uint32_t seriesId;
+    uint32_t checksum;
+    Record record;
+};
+
+enum ChunkFlags : uint32_t
+{
+    ChunkEndsFlush = 1
+};
+
+constexpr char chunkFileMagic[4] = {'T', 'S', 'C', 'K'};
+constexpr uint8_t chunkFileVersion = 1;
+constexpr uint8_t compactedSegmentMark = 1;
+constexpr uint32_t maxSeriesNameLength = 255;
@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <span>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+#include <unistd.h>
+#include <fcntl.h>
+
+//append-only array of fixed size entries kept next to a database file.
+//sidecars hold derived data that can be rebuilt from the main file, so writes are not fsynced;
+//owners validate what load() returns against the data and rewrite the file when it disagrees.
+//an owner whose sidecar is the only copy of its data calls sync() after appending and rewrites it durably.
+template <typename T>
+class SidecarFile
+{
+    static_assert(std::is_trivially_copyable_v<T>, "sidecar entries are written as raw bytes");
+
+public:
+    explicit SidecarFile(const std::string& filename) : filename(filename)
+    {
+    }
+
+    ~SidecarFile()
+    {
+        if (fd >= 0) ::close(fd);
+    }
+
+    SidecarFile(const SidecarFile&) = delete;
+    SidecarFile& operator=(const SidecarFile&) = delete;
+
+    //whole entries only; a torn trailing entry is ignored
+    std::vector<T> load() const
+    {
+        std::vector<T> entries;
+        std::ifstream inFile(filename, std::ios::binary | std::ios::ate);
+        if (!inFile.is_open()) return entries;
+
+        std::streamoff size = inFile.tellg();
+        entries.resize(static_cast<size_t>(size) / sizeof(T));
+        inFile.seekg(0, std::ios::beg);
+        if (!entries.empty() && !inFile.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(T)))) {
+            entries.clear();
+        }
+        return entries;
+    }
+
+    void append(std::span<const T> entries)
+    {
+        if (entries.empty()) return;
+        if (fd < 0) open();
+
+        size_t bytes = entries.size() * sizeof(T);
+        if (::write(fd, entries.data(), bytes) != static_cast<ssize_t>(bytes)) {
+            throw std::runtime_error("Partial write");
+        }
+    }
+
+    void sync()
+    {
+        if (fd >= 0 && ::fdatasync(fd) != 0) {
+            throw std::runtime_error("fsync failed");
+        }
+    }
+
+    //a durable rewrite syncs the new contents before they replace the old ones
+    void rewrite(std::span<const T> entries, bool durable = false)
+    {
+        std::string tmpFilename = filename + ".tmp";
+        {
+            std::ofstream outFile(tmpFilename, std::ios::binary | std::ios::trunc);
+            if (!outFile.is_open()) {
+                throw std::runtime_error("Failed to open file for writing: " + tmpFilename);
+            }
+            outFile.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(T)));
+        }
+        if (durable)
+        {
+            int tmpFd = ::open(tmpFilename.c_str(), O_RDONLY);
+            bool synced = tmpFd >= 0 && ::fdatasync(tmpFd) == 0;
+            if (tmpFd >= 0) ::close(tmpFd);
+            if (!synced) {
+                throw std::runtime_error("fsync failed");
+            }
+        }
+        std::filesystem::rename(tmpFilename, filename);
+
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    static void remove(const std::string& filename)
+    {
+        std::filesystem::remove(filename);
+    }
+
+private:
+    const std::string filename;
+    int fd = -1;
+
+    void open()
+    {
+        fd = ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open sidecar file: " + filename);
+        }
+
+        //drop a torn trailing entry so appends stay aligned with what load() returns
+        off_t size = ::lseek(fd, 0, SEEK_END);
+        if (size > 0 && size % static_cast<off_t>(sizeof(T)) != 0 &&
+            ::ftruncate(fd, size - size % static_cast<off_t>(sizeof(T))) != 0) {
+            throw std::runtime_error("Failed to truncate sidecar file: " + filename);
+        }
+    }
+};
@@ -0,0 +1,93 @@
+#include "SparseIndex.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+    //the tail is searched with a plain binary search, so it is kept to a small share of the entries
+    const size_t minimumTail = 64;
+    const size_t tailFraction = 8;
+}
+
+void SparseIndex::append(IndexEntry entry)
+{
+    sorted.push_back(entry);
+
+    size_t pending = sorted.size() - treeSize;
+    if (pending > minimumTail && pending * tailFraction > treeSize) rebuild();
+}
+
+void SparseIndex::assign(std::vector<IndexEntry> entries)
+{
+    sorted = std::move(entries);
+    rebuild();
+}
+
+std::optional<size_t> SparseIndex::findLast(int64_t timestamp) const
+{
+    if (sorted.size() > treeSize && sorted[treeSize].timestamp <= timestamp)
+    {
+        auto next = std::upper_bound(sorted.begin() + static_cast<std::ptrdiff_t>(treeSize), sorted.end(), timestamp,
+                                     [](int64_t ts, const IndexEntry& e) { return ts < e.timestamp; });
+        return static_cast<size_t>(next - sorted.begin()) - 1;
+    }
+
+    //descend to the first timestamp after the key; the comparison result picks the child
+    size_t node = 1;
+    while (node <= treeSize)
+    {
+        __builtin_prefetch(tree + node * 8);
+        node = 2 * node + (tree[node] <= timestamp);
+    }
+    //strip the trailing right turns and the final left turn to land on that node (0 when every timestamp is smaller)
+    node >>= __builtin_ffsll(static_cast<long long>(~node));
+
+    size_t next = node == 0 ? treeSize : ranks[node];
+    if (next == 0) return std::nullopt;
+    return next - 1;
+}
+
+const std::vector<IndexEntry>& SparseIndex::entries() const
+{
+    return sorted;
+}
+
+const IndexEntry& SparseIndex::operator[](size_t position) const
+{
+    return sorted[position];
+}
+
+size_t SparseIndex::size() const
+{
+    return sorted.size();
+}
+
+bool SparseIndex::empty() const
+{
+    return sorted.empty();
+}
+
+void SparseIndex::rebuild()
+{
+    const size_t lineEntries = 64 / sizeof(int64_t);
+
+    treeSize = sorted.size();
+    treeStorage.assign(treeSize + 1 + lineEntries, 0);
+    ranks.assign(treeSize + 1, 0);
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(treeStorage.data());
+    tree = treeStorage.data() + (((64 - address % 64) % 64) / sizeof(int64_t));
+
+    size_t position = 0;
+    fill(position, 1);
+}
+
+void SparseIndex::fill(size_t& position, size_t node)
+{
+    //an in-order walk of the implicit tree visits the nodes in sorted order
+    if (node > treeSize) return;
+    fill(position, 2 * node);
+    tree[node] = sorted[position].timestamp;
+    ranks[node] = position++;
+    fill(position, 2 * node + 1);
+}
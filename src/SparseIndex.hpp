@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include "IndexEntry.hpp"
+
+//sparse index entries in timestamp order plus a search tree over their timestamps.
+//the tree holds only timestamps in Eytzinger (breadth first) order, so the top levels share a few
+//cache lines and each lookup is a branchless descent with the next levels prefetched.
+//appends land in a sorted tail that is folded into the tree once it outgrows a fraction of it.
+class SparseIndex
+{
+public:
+    SparseIndex() = default;
+    SparseIndex(const SparseIndex&) = delete;
+    SparseIndex& operator=(const SparseIndex&) = delete;
+
+    void append(IndexEntry entry);
+    void assign(std::vector<IndexEntry> entries);
+
+    //position of the last entry whose timestamp is at or before the given one
+    std::optional<size_t> findLast(int64_t timestamp) const;
+
+    const std::vector<IndexEntry>& entries() const;
+    const IndexEntry& operator[](size_t position) const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    std::vector<IndexEntry> sorted;
+
+    //1-based tree; tree[0] sits on a cache line boundary so each node's descendants three levels
+    //down (8k to 8k+7) share one line
+    std::vector<int64_t> treeStorage;
+    int64_t* tree = nullptr;
+    std::vector<size_t> ranks;
+    size_t treeSize = 0;
+
+    void rebuild();
+    void fill(size_t& position, size_t node);
+};
@@ -1,398 +1,2121 @@
 #include "Storage.hpp"
+#include "Checksum.hpp"
+#include "Kernels.hpp"
 #include <fstream>
 #include <sstream>
 #include <limits>
 #include <cstdint>
 #include <optional>
-#include <zlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include <filesystem>
+#include <ranges>
 
+namespace
+{
+    const int64_t notPublishing = std::numeric_limits<int64_t>::max();
+
+    //upper bound on records fetched per positional read during range scans
+    const size_t maxChunkRecords = 4096;
+
+    //records each producer's lane holds between flushes before that producer has to wait
+    const size_t laneCapacity = 1 << 14;
+
+    //longest the flush thread sleeps while nothing is queued
+    const std::chrono::seconds idleRecheck{1};
+
+    //blocks compaction encodes per pass; each pass costs one fsync
+    const size_t compactionBlocksPerPass = 64;
+
+    //the flush thread queues at most a write and the sync linked to it; range scans keep up to
+    //readRingEntries chunk reads in flight
+    const unsigned flushRingEntries = 4;
+    const unsigned readRingEntries = 16;
+
+    //readers run concurrently and a ring takes one thread at a time, so each reading thread gets its own;
+    //null where the kernel has no io_uring
+    IoRing* readRing()
+    {
+        thread_local std::unique_ptr<IoRing> ring = IoRing::create(readRingEntries);
+        return ring.get();
+    }
+
+    //lanes are cached per thread by storage id, which unlike an address is never reused
+    std::atomic<uint64_t> nextStorageId{0};
+
+    //files that move with the active file; sidecars go first, so a segment whose data file exists is complete
+    const char* const activeFileSuffixes[] = {".head", ".sum", ".idx", ".lrn", ""};
+
+    //the algorithm is fixed when the file is created; segments rolled from it keep it
+    ChecksumAlgorithm fileChecksumAlgorithm(const std::string& filename, const StorageOptions& options)
+    {
+        std::ifstream inFile(filename, std::ios::binary);
+        if (!inFile.is_open()) return options.checksumAlgorithm;
+        return static_cast<ChecksumAlgorithm>(Storage::validateAndReadHeader(inFile, filename).reserved[0]);
+    }
+
+    //bytes the data file and the sidecars that move with it take on disk
+    uint64_t diskBytes(const std::string& base)
+    {
+        uint64_t bytes = 0;
+        for (const char* suffix : activeFileSuffixes)
+        {
+            std::error_code error;
+            uintmax_t size = std::filesystem::file_size(base + suffix, error);
+            if (!error) bytes += size;
+        }
+        return bytes;
+    }
+}
+
+Storage::Storage(const std::string& filename, size_t sparseIndexStep) : Storage(filename, StorageOptions{sparseIndexStep})
+{
+}
+
+Storage::Storage(const std::string& filename, const StorageOptions& options) : Storage(filename, options, false)
+{
+}
 
-Storage::Storage(const std::string& filename, size_t sparseIndexStep) : filename(filename), sparseIndexStep(sparseIndexStep)
+Storage::Storage(const std::string& filename, const StorageOptions& options, bool readOnly) : filename(filename), options(options), readOnly(readOnly),
+    checksumAlgorithm(fileChecksumAlgorithm(filename, options)), reorderWindow(std::max<int64_t>(options.reorderWindow, 0)),
+    readMode(options.readMode), sparseIndexStep(options.sparseIndexStep),
+    storageId(nextStorageId.fetch_add(1)), laneOwner(std::make_shared<LaneOwner>()),
+    segmentDuration(std::max<int64_t>(options.segmentDuration, 0)), segmentBytes(options.segmentBytes),
+    retentionAge(std::max<int64_t>(options.retentionAge, 0)), retentionBytes(options.retentionBytes),
+    compactor(options.compactionAge, options.compactionBytesPerSecond),
+    flushThreshold(std::clamp<size_t>(options.flushThresholdRecords, 1, laneCapacity / 2)), maxFlushLatency(options.maxFlushLatency),
+    writeAheadLog(options.writeAheadLog), checkpointRecords(std::max<size_t>(options.checkpointRecords, 1)), checkpointInterval(options.checkpointInterval),
+    syncSchedule(options.durability, options.syncInterval, options.syncBytes),
+    ioBackend(options.ioBackend)
 {
     lastTimestamp = std::numeric_limits<int64_t>::min();
+    laneOwner->storage = this;
+
+    //only the manifest is read for sealed segments; their files wait until a query needs them
+    if (!readOnly) loadSegments();
+
+    openActiveFile();
+
+    std::optional<Record> lastRecord = lastPersistedRecord();
+    if (lastRecord.has_value())
+    {
+        lastTimestamp = lastRecord->timestamp;
+    }
+    else if (!segments.empty())
+    {
+        lastTimestamp = segments.back().lastTimestamp;
+    }
+    acceptAfter = lastTimestamp.load();
+    newestAccepted = lastTimestamp.load();
+    writtenThrough = lastTimestamp;
+
+    //a log left by an earlier open is replayed even when this one runs without it
+    if (!readOnly && (writeAheadLog || std::filesystem::exists(filename + ".wal"))) openWriteAheadLog();
 
-    flushThread = std::thread(&Storage::flushLoop, this);
+    if (!readOnly && ioBackend == IoBackend::IoUring) ring = IoRing::create(flushRingEntries);
 
+    if (!readOnly) flushThread = std::thread(&Storage::flushLoop, this);
+    if (!readOnly) compactor.start([this]() { return compactNext(); });
+}
+
+void Storage::openActiveFile()
+{
     std::ifstream inFile(filename, std::ios::binary);
     if (inFile.is_open()) {
         header = validateAndReadHeader(inFile, filename);
-        recordCount = recoverPartialWriteAndReturnRecordCount(inFile);
+        if (header.version == 1)
+        {
+            recordCount = recoverPartialWriteAndReturnRecordCount(inFile);
+        }
+    }
+    else if (readOnly)
+    {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    else if (options.formatVersion == 2)
+    {
+        createActiveFile({'T', 'S', 'D', 'B', 2, {static_cast<uint8_t>(options.checksumAlgorithm), static_cast<uint8_t>(options.checksumGranularity), 0}, columnarRecordSize});
+    }
+    else if (options.checksumGranularity == ChecksumGranularity::PerBlock)
+    {
+        throw std::runtime_error("Block checksums require the version 2 block layout");
     }
     else
     {
-        header = {'T', 'S', 'D', 'B', 1, {0, 0, 0}, static_cast<uint16_t>(sizeof(Record))};
-        std::ofstream outFile(filename, std::ios::binary | std::ios::app);
-        if (!outFile.is_open()) {
-            throw std::runtime_error("Failed to open file for writing: " + filename);
-        }
-        outFile.write(reinterpret_cast<const char*>(&header), sizeof(TSDBHeader));
-        outFile.close();
-        recordCount = 0;
+        createActiveFile({'T', 'S', 'D', 'B', 1, {static_cast<uint8_t>(options.checksumAlgorithm), 0, 0}, static_cast<uint16_t>(sizeof(Record))});
     }
+    inFile.close();
+
+    if (header.version == 2)
+    {
+        //the block capacity recorded in the file doubles as the sparse index step; sealing syncs only where
+        //every batch is synced anyway, and otherwise waits for the sync the mode or the log checkpoint makes
+        bool deferSync = writeAheadLog || syncSchedule.getMode() == DurabilityMode::Periodic || syncSchedule.getMode() == DurabilityMode::Buffered;
+        blockFile = std::make_unique<BlockFile>(filename, readMode, options.compressBlocks, deferSync, readOnly);
+        sparseIndexStep = blockFile->getBlockCapacity();
+        recordCount = blockFile->getRecordCount();
+    }
+    else
+    {
+        if (!readOnly)
+        {
+            fd = ::open(filename.c_str(),
+                        O_WRONLY | O_APPEND | O_CREAT,
+                        0644);
 
-    fd = ::open(filename.c_str(),
-                O_WRONLY | O_APPEND | O_CREAT,
-                0644);
+            if (fd < 0) {
+                throw std::runtime_error("Failed to open data file");
+            }
+        }
 
-    if (fd < 0) {
-        throw std::runtime_error("Failed to open data file");
+        reader = std::make_unique<FileReader>(filename, readMode);
     }
 
-    std::optional<Record> lastRecord = getLastRecord();
-    if (lastRecord.has_value())
+    buildSparseIndex();
+
+    if (!blockFile && options.learnedIndexError > 0) loadLearnedIndex(options.learnedIndexError);
+
+    loadSummaries();
+}
+
+void Storage::createActiveFile(const TSDBHeader& fileHeader)
+{
+    SidecarFile<BlockSummary>::remove(filename + ".sum");
+    SidecarFile<IndexEntry>::remove(filename + ".idx");
+    SidecarFile<LearnedSegment>::remove(filename + ".lrn");
+    header = fileHeader;
+
+    if (header.version == 2)
     {
-        lastTimestamp = lastRecord->timestamp;
+        BlockFile::create(filename, header, static_cast<uint32_t>(sparseIndexStep));
+        return;
     }
 
-    buildSparseIndex();
+    std::ofstream outFile(filename, std::ios::binary | std::ios::app);
+    if (!outFile.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + filename);
+    }
+    outFile.write(reinterpret_cast<const char*>(&header), sizeof(TSDBHeader));
+    outFile.close();
+    recordCount = 0;
 }
 
 Storage::~Storage()
 {
-    running = false;
+    //threads that exit from now on keep their lanes to themselves; one handing its lane back finishes first
+    {
+        std::lock_guard<std::mutex> lock(laneOwner->mutex);
+        laneOwner->storage = nullptr;
+    }
+
+    compactor.stop();
+
+    {
+        std::lock_guard<std::mutex> lock(flushWakeupMutex);
+        running = false;
+    }
+    flushWakeup.notify_one();
     if (flushThread.joinable()) flushThread.join();
-    ::close(fd);
+
+    //records appended while the last flush was in progress would otherwise be dropped; after a failed
+    //flush nothing more is written
+    if (!flushFailed && !readOnly)
+    {
+        try
+        {
+            std::chrono::steady_clock::time_point queuedSince = recordsQueued ? firstQueued : std::chrono::steady_clock::now();
+            flushAndRecord(queuedSince, false, true);
+            if (unsyncedBytes > 0) syncToDisk();
+        }
+        catch (...)
+        {
+            failFlushes(std::current_exception());
+        }
+    }
+
+    if (fd >= 0) ::close(fd);
 }
 
 bool Storage::append(Record r)
 {
-    if (r.timestamp <= lastTimestamp) return false;
+    throwIfFlushFailed();
+    IngestLane& lane = laneForThisThread();
+    lane.publishing.store(r.timestamp);
+    if (!acceptable(lane, r.timestamp))
+    {
+        lane.publishing.store(notPublishing, std::memory_order_release);
+        return false;
+    }
+
+    r.crc = computeCRC(r);
+
+    noteAccepted(lane, r.timestamp);
+    uint64_t position = lane.ring.push(r);
+    lane.publishing.store(notPublishing, std::memory_order_release);
+    signalPublished(lane, position, 1);
+    return true;
+}
+
+BatchAppendResult Storage::appendBatch(std::span<const Record> records)
+{
+    if (records.empty()) return {0, 0};
+    throwIfFlushFailed();
+
+    auto byTimestamp = [](const Record& a, const Record& b) { return a.timestamp < b.timestamp; };
+    IngestLane& lane = laneForThisThread();
+    lane.publishing.store(std::min_element(records.begin(), records.end(), byTimestamp)->timestamp);
+
+    //a batch already in increasing order past everything this producer wrote is taken whole; otherwise
+    //each record is checked against the records accepted before it, just as separate appends would be
+    std::vector<Record> accepted;
+    auto notIncreasing = [](const Record& a, const Record& b) { return a.timestamp >= b.timestamp; };
+    int64_t first = records.front().timestamp;
+    if (first > acceptFloor(lane) && first > lane.newest &&
+        std::adjacent_find(records.begin(), records.end(), notIncreasing) == records.end())
+    {
+        accepted.assign(records.begin(), records.end());
+        for (const Record& r : records) noteAccepted(lane, r.timestamp);
+    }
+    else
+    {
+        accepted.reserve(records.size());
+        for (const Record& r : records)
+        {
+            if (!acceptable(lane, r.timestamp)) continue;
+            accepted.push_back(r);
+            noteAccepted(lane, r.timestamp);
+        }
+    }
+
+    fillRecordChecksums(accepted.data(), accepted.size(), checksumAlgorithm);
+
+    //large batches go in pieces so the flusher can drain the lane while the rest is published
+    size_t piece = lane.ring.getCapacity() / 2;
+    for (size_t offset = 0; offset < accepted.size(); offset += piece)
+    {
+        size_t count = std::min(piece, accepted.size() - offset);
+        uint64_t first = lane.ring.push(accepted.data() + offset, count);
+        signalPublished(lane, first, count);
+    }
+    lane.publishing.store(notPublishing, std::memory_order_release);
+
+    return {accepted.size(), records.size() - accepted.size()};
+}
+
+std::future<bool> Storage::appendDurable(Record r)
+{
+    std::promise<bool> promise;
+    std::future<bool> future = promise.get_future();
+    IngestLane& lane = laneForThisThread();
+    lane.publishing.store(r.timestamp);
+    if (!acceptable(lane, r.timestamp))
+    {
+        lane.publishing.store(notPublishing, std::memory_order_release);
+        promise.set_value(false);
+        return future;
+    }
 
     r.crc = computeCRC(r);
 
+    //the promise completes with the sync of the batch that writes the record, which commits the reorder
+    //window up to it; records newer than it stay open to every producer
+    noteAccepted(lane, r.timestamp);
+    uint64_t position = lane.ring.push(r);
+    raiseAcceptAfter(r.timestamp);
+    lane.publishing.store(notPublishing, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(waiterMutex);
+        if (flushFailure)
+        {
+            promise.set_exception(flushFailure);
+            return future;
+        }
+        durableWaiters.push_back({&lane, position, r.timestamp, std::move(promise)});
+    }
+
+    //group commit: whatever else is queued when the flusher wakes is written and synced with this record
+    signalFlush(true, true);
+    return future;
+}
+
+std::vector<Record> Storage::readAll() const {
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    drainForRead();
+
+    std::vector<Record> records;
+    for (const std::shared_ptr<const Storage>& segment : overlappingSegments(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()))
+    {
+        std::vector<Record> sealed = segment->readAll();
+        records.insert(records.end(), sealed.begin(), sealed.end());
+    }
+
+    //block files verify what they decode, so only the row layout is checked here
+    if (blockFile)
+    {
+        std::vector<Record> active = blockFile->readAll();
+        records.insert(records.end(), active.begin(), active.end());
+    }
+    else
+    {
+        uint64_t dataSize = reader->size() - sizeof(TSDBHeader);
+        if (dataSize % sizeof(Record) != 0) {
+            throw std::runtime_error("Corrupted TSDB file: misaligned record section");
+        }
+
+        size_t sealed = records.size();
+        records.resize(sealed + dataSize / sizeof(Record));
+        reader->read(records.data() + sealed, dataSize, sizeof(TSDBHeader));
+
+        verifyCRCs(std::span<const Record>(records).subspan(sealed));
+    }
+
+    mergeMemtable(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), records);
+    return records;
+}
+
+std::vector<Record> Storage::readRange(int64_t startTs, int64_t endTs) const
+{
+    if (startTs > endTs) throw std::runtime_error("Invalid time range");
+
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    drainForRead();
+
+    //segments outside the range are never opened
+    std::vector<Record> records;
+    for (const std::shared_ptr<const Storage>& segment : overlappingSegments(startTs, endTs))
+    {
+        std::vector<Record> sealed = segment->readRange(startTs, endTs);
+        records.insert(records.end(), sealed.begin(), sealed.end());
+    }
+    readPersistedRange(startTs, endTs, records);
+    mergeMemtable(startTs, endTs, records);
+    return records;
+}
+
+void Storage::readPersistedRange(int64_t startTs, int64_t endTs, std::vector<Record>& records) const
+{
+    if (!blockFile && readMode == ReadMode::Mmap)
+    {
+        size_t persisted = records.size();
+        mappedRange(startTs, endTs).copyTo(records);
+        verifyCRCs(std::span<const Record>(records).subspan(persisted));
+        return;
+    }
+
+    if (startTs > lastTimestamp) return;
+
+    if (sparseIndex.empty()) return;
+
+    if (endTs < sparseIndex[0].timestamp) return;
+
+    startTs = std::max(sparseIndex[0].timestamp, startTs);
+    endTs = std::min(lastTimestamp.load(), endTs);
+
+    std::optional<size_t> startRecord = findStartRecordIndex(startTs);
+    if (!startRecord.has_value()) return;
+
+    if (blockFile)
+    {
+        blockFile->readRange(*startRecord, startTs, endTs, records);
+        return;
+    }
+
+    size_t index = *startRecord;
+    size_t count = recordCount;
+
+    //records from the sparse index entry past endTs on are newer than it, so the reads can stop there
+    IoRing* scanRing = ioBackend == IoBackend::IoUring && reader->getDescriptor() >= 0 ? readRing() : nullptr;
+    if (scanRing)
+    {
+        std::optional<size_t> last = sparseIndex.findLast(endTs);
+        size_t end = last.has_value() && *last + 1 < sparseIndex.size() ? sparseIndex[*last + 1].recordIndex : count;
+        readChunksInFlight(*scanRing, index, std::min(end, count), startTs, endTs, records);
+        return;
+    }
+
+    std::vector<Record> chunk(std::min(sparseIndexStep, maxChunkRecords));
+
+    //a learned start sits within a couple of error bounds of the first match, so the first read covers just that
+    size_t window = learnedIndex ? std::min(chunk.size(), 2 * learnedIndex->getMaxError() + 2) : chunk.size();
+    while (index < count)
+    {
+        size_t n = std::min(window, count - index);
+        window = chunk.size();
+        reader->read(chunk.data(), n * sizeof(Record), recordOffset(index));
+
+        auto begin = std::lower_bound(chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(n), startTs,
+                                      [](const Record& r, int64_t ts) { return r.timestamp < ts; });
+        auto end = std::upper_bound(begin, chunk.begin() + static_cast<std::ptrdiff_t>(n), endTs,
+                                    [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+        verifyCRCs(std::span<const Record>(begin, end));
+        records.insert(records.end(), begin, end);
+
+        if (end != chunk.begin() + static_cast<std::ptrdiff_t>(n)) return;
+        index += n;
+    }
+}
+
+void Storage::readChunksInFlight(IoRing& readRing, size_t index, size_t end, int64_t startTs, int64_t endTs, std::vector<Record>& records) const
+{
+    //each round reads up to one chunk per ring entry into consecutive slots, so it is filtered as one run
+    size_t roundRecords = readRing.getCapacity() * maxChunkRecords;
+    std::vector<Record> round(std::min(roundRecords, end - std::min(index, end)));
+    while (index < end)
+    {
+        size_t n = std::min(roundRecords, end - index);
+        for (size_t queued = 0; queued < n; queued += maxChunkRecords)
+        {
+            size_t chunk = std::min(maxChunkRecords, n - queued);
+            //a read the ring cannot take is made with a plain pread instead
+            uint64_t offset = recordOffset(index + queued);
+            if (!readRing.queueRead(reader->getDescriptor(), round.data() + queued, chunk * sizeof(Record), offset))
+            {
+                reader->read(round.data() + queued, chunk * sizeof(Record), offset);
+            }
+        }
+        readRing.wait();
+
+        auto begin = std::lower_bound(round.begin(), round.begin() + static_cast<std::ptrdiff_t>(n), startTs,
+                                      [](const Record& r, int64_t ts) { return r.timestamp < ts; });
+        auto last = std::upper_bound(begin, round.begin() + static_cast<std::ptrdiff_t>(n), endTs,
+                                     [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+        verifyCRCs(std::span<const Record>(begin, last));
+        records.insert(records.end(), begin, last);
+
+        if (last != round.begin() + static_cast<std::ptrdiff_t>(n)) return;
+        index += n;
+    }
+}
+
+void Storage::mergeMemtable(int64_t startTs, int64_t endTs, std::vector<Record>& records) const
+{
+    //memtable records are newer than the file unless a producer lost a race with a flush; logged ones sit between
+    size_t persisted = records.size();
+    logged.readRange(startTs, endTs, records);
+    memtable.readRange(startTs, endTs, records);
+    if (persisted > 0 && persisted < records.size() && records[persisted].timestamp < records[persisted - 1].timestamp)
+    {
+        std::inplace_merge(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(persisted), records.end(),
+                           [](const Record& a, const Record& b) { return a.timestamp < b.timestamp; });
+    }
+}
+
+RecordView Storage::readRangeView(int64_t startTs, int64_t endTs) const
+{
+    if (readMode != ReadMode::Mmap) throw std::runtime_error("Zero-copy reads require mmap read mode");
+
+    if (blockFile) throw std::runtime_error("Zero-copy reads require the version 1 row layout");
+
+    if (startTs > endTs) throw std::runtime_error("Invalid time range");
+
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    if (!segments.empty() && startTs <= segments.back().lastTimestamp)
+    {
+        throw std::runtime_error("Zero-copy reads cannot reach sealed segments");
+    }
+    RecordView view = mappedRange(startTs, endTs);
+    verifyCRCs(view);
+    return view;
+}
+
+RecordView Storage::mappedRange(int64_t startTs, int64_t endTs) const
+{
+    //a start before the first indexed timestamp begins the scan at record 0
+    size_t first = findStartRecordIndex(startTs).value_or(0);
+    RecordView mapped = mappedRecords();
+    size_t count = mapped.size();
+
+    std::ranges::iota_view<size_t, size_t> scanned(std::min(first, count), std::min(count, first + sparseIndexStep));
+    size_t begin = *std::ranges::partition_point(scanned, [&](size_t i) { return mapped.timestamp(i) < startTs; });
+    std::ranges::iota_view<size_t, size_t> rest(begin, count);
+    size_t end = *std::ranges::partition_point(rest, [&](size_t i) { return mapped.timestamp(i) <= endTs; });
+
+    return mapped.subview(begin, end - begin);
+}
+
+size_t Storage::readRecords(size_t index, std::span<Record> out) const
+{
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    return readIndexedRecords(index, out);
+}
+
+size_t Storage::readCursorRecords(size_t& position, size_t endPosition, std::span<Record> out) const
+{
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    position = std::max<size_t>(position, droppedRecords);
+    if (position >= endPosition) return 0;
+    return readIndexedRecords(position - droppedRecords, out.first(std::min(out.size(), endPosition - position)));
+}
+
+size_t Storage::readIndexedRecords(size_t index, std::span<Record> out) const
+{
+    if (index >= sealedRecords) return readActiveRecords(index - sealedRecords, out);
+
+    //a read stops at the end of the segment holding its first record
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (index < segments[i].recordCount) return openSegment(i)->readRecords(index, out);
+        index -= segments[i].recordCount;
+    }
+    return 0;
+}
+
+size_t Storage::readActiveRecords(size_t index, std::span<Record> out) const
+{
+    size_t count = recordCount;
+    if (index >= count) return 0;
+
+    size_t n = std::min(out.size(), count - index);
+    if (blockFile) return blockFile->readRecords(index, out.first(n));
+
+    reader->read(out.data(), n * sizeof(Record), recordOffset(index));
+    verifyCRCs(out.first(n));
+    return n;
+}
+
+std::optional<Record> Storage::readFromTime(int64_t timestamp) const
+{
+    std::vector<Record> result = readRange(timestamp, timestamp);
+    if (result.empty()) return std::nullopt;
+    return result.front();
+}
+
+std::optional<Record> Storage::getLastRecord() const
+{
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    drainForRead();
+
+    std::optional<Record> last = lastPersistedRecord();
+    if (!last && !segments.empty()) last = openSegment(segments.size() - 1)->getLastRecord();
+
+    std::optional<Record> unflushed = memtable.last();
+    if (!unflushed) unflushed = logged.last();
+    if (unflushed && (!last || unflushed->timestamp > last->timestamp)) return unflushed;
+    return last;
+}
+
+std::optional<Record> Storage::lastPersistedRecord() const
+{
+    std::optional<Record> last;
+    if (blockFile)
+    {
+        last = blockFile->getLastRecord();
+    }
+    else if (recordCount > 0)
+    {
+        last.emplace();
+        reader->read(&*last, sizeof(Record), recordOffset(recordCount - 1));
+        verifyCRC(*last);
+    }
+    return last;
+}
+
+Record Storage::getRecord(size_t index) const
+{
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    if (index >= sealedRecords + recordCount) throw std::out_of_range("Record index out of range");
+
+    if (index < sealedRecords)
+    {
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            if (index < segments[i].recordCount) return openSegment(i)->getRecord(index);
+            index -= segments[i].recordCount;
+        }
+    }
+    index -= sealedRecords;
+
+    if (blockFile) return blockFile->getRecord(index);
+
+    Record record;
+    reader->read(&record, sizeof(Record), recordOffset(index));
+    verifyCRC(record);
+
+    return record;
+}
+
+RangeCursor Storage::cursor(int64_t startTs, int64_t endTs, size_t chunkSize) const
+{
+    if (startTs > endTs) throw std::runtime_error("Invalid time range");
+    if (chunkSize == 0) throw std::runtime_error("Cursor chunk size must be positive");
+
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    drainForRead();
+
+    //records appended after the cursor is opened are not visited; unflushed ones are copied now and
+    //handed out after the file
+    //indexes run through the sealed segments, so the start is found in the first one that reaches startTs
+    size_t count = sealedRecords + recordCount;
+    size_t startIndex = count;
+    size_t base = 0;
+    size_t segment = 0;
+    while (segment < segments.size() && segments[segment].lastTimestamp < startTs) base += segments[segment++].recordCount;
+    if (segment < segments.size())
+    {
+        if (segments[segment].firstTimestamp <= endTs) startIndex = base + openSegment(segment)->findStartRecordIndex(startTs).value_or(0);
+    }
+    else if (recordCount > 0 && !sparseIndex.empty() && startTs <= lastTimestamp.load() && endTs >= sparseIndex[0].timestamp)
+    {
+        startIndex = sealedRecords + findStartRecordIndex(startTs).value_or(0);
+    }
+
+    std::vector<Record> unflushed;
+    logged.readRange(startTs, endTs, unflushed);
+    memtable.readRange(startTs, endTs, unflushed);
+
+    return RangeCursor(*this, droppedRecords + startIndex, droppedRecords + count, startTs, endTs, chunkSize, std::move(unflushed));
+}
+
+BlockSummary Storage::summarize(int64_t startTs, int64_t endTs) const
+{
+    if (startTs > endTs) throw std::runtime_error("Invalid time range");
+
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    drainForRead();
+
+    BlockSummary total{};
+    for (const std::shared_ptr<const Storage>& segment : overlappingSegments(startTs, endTs))
+    {
+        mergeSummary(total, segment->summarize(startTs, endTs));
+    }
+    if (!sparseIndex.empty() && startTs <= lastTimestamp.load() && endTs >= sparseIndex[0].timestamp)
+    {
+        mergeSummary(total, summarizePersisted(startTs, endTs));
+    }
+
+    //unflushed records follow the file, so they fold in last
+    std::vector<Record> unflushed;
+    logged.readRange(startTs, endTs, unflushed);
+    memtable.readRange(startTs, endTs, unflushed);
+    for (const Record& r : unflushed) addToSummary(total, r);
+    return total;
+}
+
+BlockSummary Storage::summarizePersisted(int64_t startTs, int64_t endTs) const
+{
+    BlockSummary total{};
+    size_t firstInterval = findStartRecordIndex(startTs).value_or(0) / sparseIndexStep;
+
+    std::vector<BlockSummary> intervals;
+    {
+        std::lock_guard<std::mutex> lock(summaryMutex);
+        if (firstInterval < summaries.size())
+        {
+            intervals.assign(summaries.begin() + static_cast<std::ptrdiff_t>(firstInterval), summaries.end());
+        }
+        intervals.push_back(tailSummary);
+    }
+
+    //intervals wholly inside the range fold their summary; only the partial ones at either end read records
+    for (size_t i = 0; i < intervals.size(); ++i)
+    {
+        const BlockSummary& interval = intervals[i];
+        if (interval.count == 0 || interval.lastTimestamp < startTs) continue;
+        if (interval.firstTimestamp > endTs) break;
+
+        if (interval.firstTimestamp >= startTs && interval.lastTimestamp <= endTs)
+        {
+            mergeSummary(total, interval);
+        }
+        else
+        {
+            size_t index = (firstInterval + i) * sparseIndexStep;
+            mergeSummary(total, summarizeRecords(index, interval.count, startTs, endTs));
+        }
+    }
+    return total;
+}
+
+std::optional<double> Storage::aggregate(int64_t startTs, int64_t endTs, AggregateFunction fn) const
+{
+    return evaluate(summarize(startTs, endTs), fn);
+}
+
+std::vector<DownsampleRow> Storage::downsample(int64_t startTs, int64_t endTs, int64_t bucketWidth, AggregateFunction fn) const
+{
+    if (startTs > endTs) throw std::runtime_error("Invalid time range");
+    if (bucketWidth <= 0) throw std::runtime_error("Bucket width must be positive");
+
+    //buckets are [startTs + k * bucketWidth, startTs + (k + 1) * bucketWidth); unsigned offsets keep the
+    //arithmetic defined for ranges that span the whole int64 domain
+    const uint64_t width = static_cast<uint64_t>(bucketWidth);
+    auto bucketOf = [&](int64_t ts) { return (static_cast<uint64_t>(ts) - static_cast<uint64_t>(startTs)) / width; };
+
+    std::vector<DownsampleRow> rows;
+    BlockSummary bucket{};
+    uint64_t bucketIndex = 0;
+    auto emit = [&]() {
+        if (bucket.count == 0) return;
+        std::optional<double> value = evaluate(bucket, fn);
+        rows.push_back({static_cast<int64_t>(static_cast<uint64_t>(startTs) + bucketIndex * width), *value});
+        bucket = {};
+    };
+
+    std::vector<double> values;
+    RangeCursor cursor = this->cursor(startTs, endTs, maxChunkRecords);
+    for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next())
+    {
+        values.resize(chunk.size());
+        extractValues(chunk.data(), chunk.size(), values.data());
+
+        //records are sorted, so each bucket is one contiguous run that the kernel reduces at once
+        size_t i = 0;
+        while (i < chunk.size())
+        {
+            uint64_t index = bucketOf(chunk[i].timestamp);
+            size_t end = static_cast<size_t>(std::partition_point(chunk.begin() + static_cast<std::ptrdiff_t>(i), chunk.end(),
+                                                                  [&](const Record& r) { return bucketOf(r.timestamp) == index; }) - chunk.begin());
+
+            if (index != bucketIndex) emit();
+            bucketIndex = index;
+
+            ValueStats stats = reduceValues(values.data() + i, end - i);
+            BlockSummary run{chunk[i].timestamp, chunk[end - 1].timestamp, end - i,
+                             stats.min, stats.max, stats.sum, chunk[i].value, chunk[end - 1].value};
+            mergeSummary(bucket, run);
+            i = end;
+        }
+    }
+    emit();
+
+    return rows;
+}
+
+int64_t Storage::getLastTimestamp() const
+{
+    drainForRead();
+    return lastTimestamp;
+}
+
+TSDBHeader Storage::getHeader() const
+{
+    return header;
+}
+
+size_t Storage::getRecordCount() const
+{
+    return sealedRecords + recordCount;
+}
+
+size_t Storage::getSparseIndexStep() const
+{
+    return sparseIndexStep;
+}
+
+ReadMode Storage::getReadMode() const
+{
+    return readMode;
+}
+
+DurabilityMode Storage::getDurability() const
+{
+    return syncSchedule.getMode();
+}
+
+IoBackend Storage::getIoBackend() const
+{
+    //io_uring only once the kernel has handed out a ring
+    return ring ? IoBackend::IoUring : IoBackend::Blocking;
+}
+
+FlushStats Storage::getFlushStats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return flushStats;
+}
+
+ChecksumAlgorithm Storage::getChecksumAlgorithm() const
+{
+    return checksumAlgorithm;
+}
+
+size_t Storage::getLearnedSegmentCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    return learnedIndex ? learnedIndex->segmentCount() : 0;
+}
+
+std::vector<SegmentInfo> Storage::getSegments() const
+{
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    return segments;
+}
+
+size_t Storage::getLaneCount() const
+{
+    std::lock_guard<std::mutex> lock(laneMutex);
+    return lanes.size();
+}
+
+size_t Storage::getOpenSegmentCount() const
+{
+    std::lock_guard<std::mutex> lock(segmentMutex);
+    return static_cast<size_t>(std::count_if(openSegments.begin(), openSegments.end(),
+                                             [](const std::shared_ptr<const Storage>& segment) { return segment != nullptr; }));
+}
+
+const std::vector<IndexEntry>& Storage::getSparseIndex() const
+{
+    return sparseIndex.entries();
+}
+
+TSDBHeader Storage::validateAndReadHeader(std::ifstream& inFile, std::string filename)
+{
+    if (inFile.is_open()) {
+
+        inFile.seekg(0, std::ios::end);
+        std::streampos fileSize = inFile.tellg();
+
+        if (fileSize < static_cast<std::streampos>(sizeof(TSDBHeader))) {
+            throw std::runtime_error("File too small to contain valid TSDB header: " + filename);
+        }
+
+        TSDBHeader temporaryHeader;
+        inFile.seekg(0, std::ios::beg);
+
+        if (!inFile.read(reinterpret_cast<char*>(&temporaryHeader), sizeof(TSDBHeader))) {
+            throw std::runtime_error("Failed to read TSDB header: " + filename);
+        }
+
+        if (temporaryHeader.magic[0] != 'T' || temporaryHeader.magic[1] != 'S' ||
+            temporaryHeader.magic[2] != 'D' || temporaryHeader.magic[3] != 'B') {
+            throw std::runtime_error("Invalid TSDB file magic number: " + filename);
+            }
+
+        if (temporaryHeader.version != 1 && temporaryHeader.version != 2) {
+            throw std::runtime_error("Unsupported TSDB file version: " + filename);
+        }
+
+        if (temporaryHeader.reserved[0] > static_cast<uint8_t>(ChecksumAlgorithm::Crc32c)) {
+            throw std::runtime_error("Unsupported checksum algorithm: " + filename);
+        }
+
+        if (temporaryHeader.reserved[1] > static_cast<uint8_t>(ChecksumGranularity::PerBlock) ||
+            (temporaryHeader.version == 1 && temporaryHeader.reserved[1] != 0)) {
+            throw std::runtime_error("Unsupported checksum granularity: " + filename);
+        }
+
+        uint16_t expectedRecordSize = temporaryHeader.version == 1 ? sizeof(Record) : columnarRecordSize;
+        if (temporaryHeader.recordSize != expectedRecordSize) {
+            throw std::runtime_error("Record size mismatch: " + filename);
+        }
+
+        return temporaryHeader;
+    }
+    throw std::runtime_error("File doesn't exist: " + filename);
+}
+
+void Storage::removeFiles(const std::string& filename)
+{
+    for (const SegmentInfo& segment : SidecarFile<SegmentInfo>(filename + ".manifest").load())
+    {
+        removeFiles(segmentFilename(filename, segment.sequence));
+        removeFiles(segmentFilename(filename, segment.sequence) + ".compact");
+    }
+
+    for (const char* suffix : {"", ".head", ".sum", ".idx", ".lrn", ".manifest", ".wal"})
+    {
+        std::filesystem::remove(filename + suffix);
+    }
+}
+
+void Storage::loadSegments()
+{
+    //the manifest is the only record of the sealed segments, so it is checked rather than rebuilt
+    manifestFile = std::make_unique<SidecarFile<SegmentInfo>>(filename + ".manifest");
+    segments = manifestFile->load();
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        const SegmentInfo& segment = segments[i];
+        if (segment.recordCount == 0 || segment.firstTimestamp > segment.lastTimestamp ||
+            (i > 0 && (segment.sequence <= segments[i - 1].sequence || segment.firstTimestamp < segments[i - 1].lastTimestamp)))
+        {
+            throw std::runtime_error("Corrupted segment manifest: " + filename);
+        }
+        sealedRecords += segment.recordCount;
+    }
+    nextSequence = segments.empty() ? 0 : segments.back().sequence + 1;
+
+    //a crash between recording a segment and renaming the active file to it leaves the rename to finish here
+    if (!segments.empty() && !std::filesystem::exists(segmentFilename(filename, segments.back().sequence)))
+    {
+        renameActiveFile(segments.back().sequence);
+    }
+    adoptUnlistedSegments();
+    openSegments.resize(segments.size());
+    removeStaleSegmentFiles();
+}
+
+void Storage::adoptUnlistedSegments()
+{
+    //a crash after a roll renamed the active file but before the manifest named the segment leaves it to be
+    //named here. its sequence follows the manifest's; a rename cut short has moved sidecars but not the data file
+    while (true)
+    {
+        std::string segmentFile = segmentFilename(filename, nextSequence);
+        if (!std::filesystem::exists(segmentFile))
+        {
+            bool moving = std::any_of(std::begin(activeFileSuffixes), std::end(activeFileSuffixes) - 1,
+                                      [&](const char* suffix) { return std::filesystem::exists(segmentFile + suffix); });
+            if (!moving || !std::filesystem::exists(filename)) return;
+            renameActiveFile(nextSequence);
+        }
+
+        std::optional<SegmentInfo> segment;
+        {
+            Storage sealed(segmentFile, options, true);
+            if (sealed.recordCount > 0)
+            {
+                segment = SegmentInfo{nextSequence, sealed.sparseIndex[0].timestamp, sealed.readTimestamp(sealed.recordCount - 1), sealed.recordCount};
+            }
+        }
+        if (!segment || (!segments.empty() && segment->firstTimestamp < segments.back().lastTimestamp)) return;
+
+        manifestFile->append(std::span<const SegmentInfo>(&*segment, 1));
+        manifestFile->sync();
+        segments.push_back(*segment);
+        sealedRecords += segment->recordCount;
+        ++nextSequence;
+    }
+}
+
+void Storage::removeStaleSegmentFiles()
+{
+    //retention rewrites the manifest before it deletes, so a crash in between leaves segments nothing lists;
+    //a crash during compaction leaves its half written copy
+    for (const SegmentFile& file : listSegmentFiles(filename))
+    {
+        bool listed = std::any_of(segments.begin(), segments.end(), [&](const SegmentInfo& segment) { return segment.sequence == file.sequence; });
+        if (!listed || file.suffix.starts_with(".compact")) std::filesystem::remove(file.path);
+    }
+}
+
+void Storage::renameActiveFile(uint64_t sequence)
+{
+    std::string segment = segmentFilename(filename, sequence);
+    for (const char* suffix : activeFileSuffixes)
+    {
+        if (std::filesystem::exists(filename + suffix)) std::filesystem::rename(filename + suffix, segment + suffix);
+    }
+}
+
+void Storage::rollSegment()
+{
+    //runs under the exclusive view lock, so nothing here waits on the disk: the files keep their descriptors
+    //for syncSealedSegments, which names the segment in the manifest once they are synced
+    SegmentInfo segment{nextSequence++, sparseIndex[0].timestamp, readTimestamp(recordCount - 1), recordCount};
+    if (blockFile)
+    {
+        sealedUnsynced.add(blockFile->releaseDescriptors());
+    }
+    else
+    {
+        sealedUnsynced.add(fd);
+    }
+    fd = -1;
+
+    blockFile.reset();
+    reader.reset();
+    indexFile.reset();
+    learnedIndex.reset();
+    learnedFile.reset();
+    summaryFile.reset();
+    renameActiveFile(segment.sequence);
+
+    segments.push_back(segment);
+    unlistedSegments.push_back(segment);
+    sealedRecords += segment.recordCount;
+    {
+        std::lock_guard<std::mutex> lock(segmentMutex);
+        openSegments.push_back(nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> lock(summaryMutex);
+        summaries.clear();
+        tailSummary = {};
+    }
+    sparseIndex.assign({});
+
+    createActiveFile(header);
+    openActiveFile();
+}
+
+void Storage::syncSealedSegments()
+{
+    if (unlistedSegments.empty()) return;
+
+    //the segment is synced, then its rename, before the manifest names it; a crash before then leaves
+    //the renamed segment for the next open to adopt
+    sealedUnsynced.sync(syncSchedule.dataOnly());
+    syncDirectoryOf(filename);
+    manifestFile->append(std::span<const SegmentInfo>(unlistedSegments));
+    manifestFile->sync();
+
+    {
+        std::unique_lock<std::shared_mutex> lock(viewMutex);
+        unlistedSegments.clear();
+    }
+    compactor.wake();
+}
+
+void Storage::enforceRetention()
+{
+    if (retentionAge == 0 && retentionBytes == 0) return;
+
+    //only the flush thread changes the segment list, so it is read here without the view lock, which is
+    //taken just to unlist the expired segments; the records kept are not read
+    std::lock_guard<std::mutex> changeLock(segmentChangeMutex);
+    uint64_t held = 0;
+    if (retentionBytes > 0)
+    {
+        held = diskBytes(filename);
+        for (const SegmentInfo& segment : segments) held += sealedDiskBytes(segment.sequence);
+    }
+    //a segment the manifest does not name yet is never the oldest one due to go
+    size_t listed = segments.size() - unlistedSegments.size();
+    size_t drop = expiredSegments(segments, listed, lastTimestamp, retentionAge, retentionBytes, held,
+                                  [](const SegmentInfo& segment) { return segment.lastTimestamp; },
+                                  [this](const SegmentInfo& segment) { return sealedDiskBytes(segment.sequence); });
+    if (drop == 0) return;
+
+    manifestFile->rewrite(std::span<const SegmentInfo>(segments).subspan(drop, listed - drop), true);
+    std::vector<SegmentInfo> expired(segments.begin(), segments.begin() + static_cast<std::ptrdiff_t>(drop));
+    {
+        std::unique_lock<std::shared_mutex> lock(viewMutex);
+        segments.erase(segments.begin(), segments.begin() + static_cast<std::ptrdiff_t>(drop));
+        for (const SegmentInfo& segment : expired)
+        {
+            sealedRecords -= segment.recordCount;
+            droppedRecords += segment.recordCount;
+        }
+
+        std::lock_guard<std::mutex> segmentLock(segmentMutex);
+        openSegments.erase(openSegments.begin(), openSegments.begin() + static_cast<std::ptrdiff_t>(drop));
+    }
+
+    //a reader still holding a dropped segment keeps reading its unlinked files
+    for (const SegmentInfo& segment : expired)
+    {
+        segmentDiskBytes.erase(segment.sequence);
+        removeFiles(segmentFilename(filename, segment.sequence));
+    }
+}
+
+uint64_t Storage::sealedDiskBytes(uint64_t sequence)
+{
+    //sealed files only change when compaction swaps them, so each segment is stat'ed once
+    auto [entry, added] = segmentDiskBytes.try_emplace(sequence, 0);
+    if (added) entry->second = diskBytes(segmentFilename(filename, sequence));
+    return entry->second;
+}
+
+bool Storage::compactNext()
+{
+    //a segment the manifest does not name yet is left for a later pass
+    std::optional<SegmentInfo> next;
+    {
+        std::shared_lock<std::shared_mutex> lock(viewMutex);
+        std::span<const SegmentInfo> listed = std::span<const SegmentInfo>(segments).first(segments.size() - unlistedSegments.size());
+        next = compactor.candidate(listed, lastTimestamp, [](const SegmentInfo& segment) { return segment.sequence; },
+                                   [](const SegmentInfo& segment) { return segment.lastTimestamp; });
+    }
+    if (!next) return false;
+
+    std::string segmentFile = segmentFilename(filename, next->sequence);
+    try
+    {
+        std::ifstream inFile(segmentFile, std::ios::binary);
+        if (validateAndReadHeader(inFile, segmentFile).version == 1 && !compactSegment(next->sequence)) return false;
+    }
+    catch (const std::exception&)
+    {
+        //the row layout copy stays in place and is still read correctly, so a failed compaction only skips it
+        removeFiles(segmentFile + ".compact");
+    }
+    compactor.done(next->sequence);
+    return true;
+}
+
+bool Storage::compactSegment(uint64_t sequence)
+{
+    std::string segmentFile = segmentFilename(filename, sequence);
+    std::string compacted = segmentFile + ".compact";
+    removeFiles(compacted);
+
+    //blocks take the segment's index step, so their summaries line up with the sparse index of the new file
+    Storage source(segmentFile, options, true);
+    size_t capacity = source.getSparseIndexStep();
+    TSDBHeader blockHeader{'T', 'S', 'D', 'B', 2, {static_cast<uint8_t>(source.getChecksumAlgorithm()), static_cast<uint8_t>(ChecksumGranularity::PerBlock), 0}, columnarRecordSize};
+    BlockFile::create(compacted, blockHeader, static_cast<uint32_t>(capacity));
+
+    {
+        BlockFile blocks(compacted, ReadMode::Pread, true);
+        std::vector<BlockSummary> intervals;
+        BlockSummary interval{};
+        std::vector<Record> chunk(capacity * compactionBlocksPerPass);
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        size_t count = source.getRecordCount();
+        for (size_t index = 0; index < count;)
+        {
+            size_t n = source.readActiveRecords(index, chunk);
+            if (n == 0) throw std::runtime_error("Segment ended early: " + segmentFile);
+
+            blocks.append(std::span<const Record>(chunk).first(n));
+            for (size_t i = 0; i < n; ++i)
+            {
+                addToSummary(interval, chunk[i]);
+                if (interval.count == capacity)
+                {
+                    intervals.push_back(interval);
+                    interval = {};
+                }
+            }
+            index += n;
+
+            if (!compactor.pace(started, static_cast<uint64_t>(index) * sizeof(Record)))
+            {
+                removeFiles(compacted);
+                return false;
+            }
+        }
+        blocks.sync(true);
+        SidecarFile<BlockSummary>(compacted + ".sum").rewrite(intervals);
+    }
+
+    swapCompactedSegment(sequence, compacted);
+    return true;
+}
+
+void Storage::swapCompactedSegment(uint64_t sequence, const std::string& compacted)
+{
+    std::string segmentFile = segmentFilename(filename, sequence);
+    std::lock_guard<std::mutex> changeLock(segmentChangeMutex);
+    std::optional<size_t> position;
+    {
+        std::shared_lock<std::shared_mutex> lock(viewMutex);
+        auto found = std::find_if(segments.begin(), segments.end(), [sequence](const SegmentInfo& segment) { return segment.sequence == sequence; });
+        if (found != segments.end()) position = static_cast<size_t>(found - segments.begin());
+    }
+    if (!position)
+    {
+        //retention dropped the segment while it was being compacted
+        removeFiles(compacted);
+        return;
+    }
+
+    //renaming the data file is the switch: the head it needs is in place before it and the row layout
+    //sidecars go after. the summaries are the same either way, so a reader opening it in between reads
+    //either layout correctly
+    std::filesystem::rename(compacted + ".head", segmentFile + ".head");
+    std::filesystem::rename(compacted + ".sum", segmentFile + ".sum");
+    std::filesystem::rename(compacted, segmentFile);
+    std::filesystem::remove(segmentFile + ".idx");
+    std::filesystem::remove(segmentFile + ".lrn");
+    segmentDiskBytes.erase(sequence);
+
+    //readers holding the row layout segment finish on its unlinked file; later ones open the blocks
+    std::unique_lock<std::shared_mutex> lock(viewMutex);
+    std::lock_guard<std::mutex> segmentLock(segmentMutex);
+    openSegments[*position] = nullptr;
+}
+
+size_t Storage::recordsForActiveSegment(std::span<const Record> records) const
+{
+    //an empty active file takes at least the first record
+    size_t fit = records.size();
+    if (segmentBytes > 0)
+    {
+        size_t capacity = std::max<size_t>(segmentBytes / sizeof(Record), 1);
+        fit = recordCount >= capacity ? 0 : std::min(fit, capacity - recordCount);
+    }
+    if (segmentDuration > 0)
+    {
+        int64_t window = segmentWindow(recordCount > 0 ? sparseIndex[0].timestamp : records.front().timestamp, segmentDuration);
+        auto end = std::partition_point(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(fit),
+                                        [&](const Record& r) { return segmentWindow(r.timestamp, segmentDuration) == window; });
+        fit = static_cast<size_t>(end - records.begin());
+    }
+    return fit;
+}
+
+std::shared_ptr<const Storage> Storage::openSegment(size_t position) const
+{
+    std::lock_guard<std::mutex> lock(segmentMutex);
+    std::shared_ptr<const Storage>& segment = openSegments[position];
+    if (!segment) segment.reset(new Storage(segmentFilename(filename, segments[position].sequence), options, true));
+    return segment;
+}
+
+std::vector<std::shared_ptr<const Storage>> Storage::overlappingSegments(int64_t startTs, int64_t endTs) const
+{
+    //the manifest bounds rule segments out without touching their files
+    std::vector<std::shared_ptr<const Storage>> overlapping;
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (segments[i].lastTimestamp >= startTs && segments[i].firstTimestamp <= endTs) overlapping.push_back(openSegment(i));
+    }
+    return overlapping;
+}
+
+size_t Storage::recoverPartialWriteAndReturnRecordCount(std::ifstream& inFile)
+{
+    inFile.seekg(0, std::ios::end);
+    std::streampos fileSize = inFile.tellg();
+    std::streampos dataSize = fileSize - static_cast<std::streampos>(sizeof(TSDBHeader));
+    size_t count = dataSize/static_cast<std::streampos>(sizeof(Record));
+    std::streampos remainder = dataSize % static_cast<std::streampos>(sizeof(Record));
+
+    //a read only open leaves a torn tail in place and reads the whole records before it
+    if (remainder == 0 || readOnly) return count;
+
+    std::streamoff newFileSize = fileSize - remainder;
+
+    inFile.close();
+
+    int fd = ::open(filename.c_str(), O_WRONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open file for truncation");
+    }
+
+    if (::ftruncate(fd, newFileSize) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to truncate TSDB file");
+    }
+
+    ::close(fd);
+
+    return count;
+}
+
+uint32_t Storage::computeCRC(const Record& r) const
+{
+    return recordChecksum(r, checksumAlgorithm);
+}
+
+std::optional<size_t> Storage::findStartRecordIndex(int64_t startTs) const
+{
+    std::optional<size_t> position = sparseIndex.findLast(startTs);
+    if (!position.has_value()) return std::nullopt;
+
+    //records from several producers can share a timestamp, so the first of them may sit before the entry holding it
+    while (*position > 0 && sparseIndex[*position].timestamp == startTs) --*position;
+    size_t start = sparseIndex[*position].recordIndex;
+
+    //the learned prediction never passes the first match, so it can only move the start closer to it
+    if (learnedIndex)
+    {
+        start = std::max(start, learnedIndex->lowerBound(startTs).value_or(0));
+    }
+    return start;
+}
+
+RecordView Storage::mappedRecords() const
+{
+    std::shared_ptr<const MappedFile> mapping = reader->getMapping();
+    return RecordView(std::span<const char>(mapping->data() + sizeof(TSDBHeader), recordCount.load() * sizeof(Record)), mapping);
+}
+
+uint64_t Storage::recordOffset(size_t index) const
+{
+    return sizeof(TSDBHeader) + static_cast<uint64_t>(index) * sizeof(Record);
+}
+
+void Storage::verifyCRC(const Record& r) const
+{
+    if (computeCRC(r) != static_cast<uint32_t>(r.crc)) {
+        throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(r.timestamp));
+    }
+}
+
+void Storage::verifyCRCs(std::span<const Record> records) const
+{
+    size_t bad = verifyRecords(records.data(), records.size(), checksumAlgorithm);
+    if (bad != records.size()) verifyCRC(records[bad]);
+}
+
+void Storage::verifyCRCs(const RecordView& records) const
+{
+    //mapped records are checked in aligned copies, a chunk at a time
+    std::vector<Record> chunk;
+    for (size_t i = 0; i < records.size(); i += maxChunkRecords)
+    {
+        size_t n = std::min(maxChunkRecords, records.size() - i);
+        chunk.clear();
+        records.subview(i, n).copyTo(chunk);
+        verifyCRCs(std::span<const Record>(chunk));
+    }
+}
+
+int64_t Storage::readTimestamp(size_t index) const
+{
+    if (blockFile) return blockFile->getTimestamp(index);
+
+    int64_t ts;
+    reader->read(&ts, sizeof(ts), recordOffset(index));
+    return ts;
+}
+
+void Storage::buildSparseIndex()
+{
+    //block headers already hold every block's first timestamp, so only the row layout needs a sidecar
+    std::vector<IndexEntry> loaded;
+    if (!blockFile)
+    {
+        indexFile = std::make_unique<SidecarFile<IndexEntry>>(filename + ".idx");
+        loaded = indexFile->load();
+    }
+
+    //entries are trusted while they sit on consecutive step boundaries within recordCount in
+    //timestamp order; the first and last trusted entries are then checked against the records
+    //so a sidecar left by another file or step is rebuilt rather than used
+    size_t expected = (recordCount + sparseIndexStep - 1) / sparseIndexStep;
+    size_t valid = 0;
+    while (valid < loaded.size() && valid < expected &&
+           loaded[valid].recordIndex == valid * sparseIndexStep &&
+           (valid == 0 || loaded[valid].timestamp >= loaded[valid - 1].timestamp))
+    {
+        ++valid;
+    }
+    if (valid > 0 && (loaded[0].timestamp != readTimestamp(0) ||
+                      loaded[valid - 1].timestamp != readTimestamp(loaded[valid - 1].recordIndex)))
+    {
+        valid = 0;
+    }
+
+    std::vector<IndexEntry> entries(loaded.begin(), loaded.begin() + static_cast<std::ptrdiff_t>(valid));
+    for (size_t index = valid * sparseIndexStep; index < recordCount; index += sparseIndexStep)
+    {
+        IndexEntry indexEntry;
+        indexEntry.timestamp = readTimestamp(index);
+        indexEntry.recordIndex = index;
+        entries.push_back(indexEntry);
+    }
+    sparseIndex.assign(std::move(entries));
+
+    if (!indexFile || readOnly) return;
+    if (valid != loaded.size())
     {
-        std::lock_guard<std::mutex> lock(bufferMutex);
-        activeBuffer.push_back(r);
+        indexFile->rewrite(sparseIndex.entries());
+    }
+    else
+    {
+        indexFile->append(std::span<const IndexEntry>(sparseIndex.entries()).subspan(valid));
     }
-    return true;
 }
 
-std::vector<Record> Storage::readAll() const {
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile.is_open()) {
-        throw std::runtime_error("Failed to open file for reading: " + filename);
+void Storage::loadLearnedIndex(size_t maxError)
+{
+    learnedIndex = std::make_unique<LearnedIndex>(maxError);
+    learnedFile = std::make_unique<SidecarFile<LearnedSegment>>(filename + ".lrn");
+
+    //persisted segments must chain from record 0 with the requested error bound; the last one
+    //trusted is checked against the records before refitting resumes where it ends
+    std::vector<LearnedSegment> loaded = learnedFile->load();
+    size_t valid = 0;
+    while (valid < loaded.size() &&
+           loaded[valid].maxError == maxError &&
+           loaded[valid].firstIndex == (valid == 0 ? 0 : loaded[valid - 1].endIndex) &&
+           loaded[valid].endIndex > loaded[valid].firstIndex &&
+           loaded[valid].endIndex <= recordCount &&
+           (valid == 0 || loaded[valid].firstTimestamp > loaded[valid - 1].firstTimestamp))
+    {
+        ++valid;
+    }
+    if (valid > 0 && loaded[valid - 1].firstTimestamp != readTimestamp(loaded[valid - 1].firstIndex))
+    {
+        valid = 0;
     }
 
-    inFile.seekg(0, std::ios::end);
-    std::streampos fileSize = inFile.tellg();
-    inFile.seekg(static_cast<std::streampos>(sizeof(TSDBHeader)), std::ios::beg);
-
-    std::streampos dataSize = fileSize - static_cast<std::streampos>(sizeof(TSDBHeader));
+    learnedIndex->assign(std::vector<LearnedSegment>(loaded.begin(), loaded.begin() + static_cast<std::ptrdiff_t>(valid)));
 
-    std::vector<Record> records;
-    if (dataSize == 0) return records;
+    std::vector<Record> chunk(maxChunkRecords);
+    for (size_t index = learnedIndex->resumeIndex(); index < recordCount;)
+    {
+        size_t n = readActiveRecords(index, chunk);
+        if (n == 0) break;
+        for (size_t i = 0; i < n; ++i)
+        {
+            learnedIndex->add(chunk[i].timestamp, index + i);
+        }
+        index += n;
+    }
 
-    if (dataSize % sizeof(Record) != 0) {
-        throw std::runtime_error("Corrupted TSDB file: misaligned record section");
+    if (readOnly) return;
+    if (valid != loaded.size())
+    {
+        learnedFile->rewrite(learnedIndex->closedSegments());
+    }
+    else
+    {
+        learnedFile->append(std::span<const LearnedSegment>(learnedIndex->closedSegments()).subspan(valid));
     }
+}
 
-    size_t numRecords = dataSize / sizeof(Record);
-    records.resize(numRecords);
+void Storage::loadSummaries()
+{
+    summaryFile = std::make_unique<SidecarFile<BlockSummary>>(filename + ".sum");
+
+    //the sidecar is trusted only while it agrees with the sparse index; anything after the
+    //first mismatch (stale file, torn append, truncated data) is rebuilt from the records
+    std::vector<BlockSummary> loaded = summaryFile->load();
+    size_t complete = recordCount / sparseIndexStep;
+    size_t valid = 0;
+    while (valid < loaded.size() && valid < complete &&
+           loaded[valid].count == sparseIndexStep &&
+           loaded[valid].firstTimestamp == sparseIndex[valid].timestamp)
+    {
+        ++valid;
+    }
 
-    if (!inFile.read(reinterpret_cast<char*>(records.data()), dataSize)) {;
-        throw std::runtime_error("Failed to read records from file: " + filename);
+    summaries.assign(loaded.begin(), loaded.begin() + static_cast<std::ptrdiff_t>(valid));
+    for (size_t interval = valid; interval < complete; ++interval)
+    {
+        summaries.push_back(summarizeRecords(interval * sparseIndexStep, sparseIndexStep,
+                                             std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()));
     }
+    tailSummary = summarizeRecords(complete * sparseIndexStep, recordCount - complete * sparseIndexStep,
+                                   std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max());
 
-    for (const Record& r: records)
+    if (readOnly) return;
+    if (valid != loaded.size())
+    {
+        summaryFile->rewrite(summaries);
+    }
+    else
     {
-        uint32_t expected = computeCRC(r);
+        summaryFile->append(std::span<const BlockSummary>(summaries).subspan(valid));
+    }
+}
 
-        if (expected != static_cast<uint32_t>(r.crc)) {
-            throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(r.timestamp));
+BlockSummary Storage::summarizeRecords(size_t index, size_t count, int64_t startTs, int64_t endTs) const
+{
+    BlockSummary summary{};
+    std::vector<Record> chunk(std::min(std::max<size_t>(count, 1), maxChunkRecords));
+    while (count > 0)
+    {
+        size_t n = readActiveRecords(index, std::span<Record>(chunk).first(std::min(chunk.size(), count)));
+        if (n == 0) break;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (chunk[i].timestamp >= startTs && chunk[i].timestamp <= endTs) addToSummary(summary, chunk[i]);
         }
+        index += n;
+        count -= n;
     }
-
-    inFile.close();
-    return records;
+    return summary;
 }
 
-std::vector<Record> Storage::readRange(int64_t startTs, int64_t endTs) const
+void Storage::flushLoop()
 {
-    if (startTs > endTs) throw std::runtime_error("Invalid time range");
-
-    if (startTs > lastTimestamp) return {};
-
-    if (sparseIndex.empty()) return {};
+    //retention is checked on open and after every flush, including the idle rechecks
+    try
+    {
+        enforceRetention();
+    }
+    catch (...)
+    {
+        failFlushes(std::current_exception());
+    }
 
-    if (endTs < sparseIndex[0].timestamp) return {};
+    while (true) {
+        bool thresholdReached = false;
+        std::chrono::steady_clock::time_point queuedSince = waitForFlush(thresholdReached);
+        if (!running) break;
 
-    startTs = std::max(sparseIndex[0].timestamp, startTs);
-    endTs = std::min(lastTimestamp, endTs);
+        //records published by a producer that raced the failure stay readable; nothing is owed a sync
+        if (flushFailed)
+        {
+            drainIntoMemtable();
+            unsyncedBytes = 0;
+            continue;
+        }
 
-    size_t left = 0;
-    size_t right = sparseIndex.size()-1;
-    size_t lastIndex = sparseIndex.size();
-    while (left <= right)
-    {
-        size_t mid = left + (right - left) / 2;
-        if (sparseIndex[mid].timestamp <= startTs)
+        try
         {
-            lastIndex = mid;
-            left = mid + 1;
+            flushAndRecord(queuedSince, thresholdReached, false);
+            enforceRetention();
         }
-        else
+        catch (...)
         {
-            if (mid == 0) break;
-            right = mid - 1;
+            failFlushes(std::current_exception());
         }
     }
+}
+
+void Storage::flushAndRecord(std::chrono::steady_clock::time_point queuedSince, bool thresholdReached, bool closing)
+{
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    drainIntoMemtable();
 
-    if (lastIndex == sparseIndex.size()) return {};
-    size_t startRecordIndex = sparseIndex[lastIndex].recordIndex;
+    //close writes out the records held in the reorder window
+    if (closing) raiseAcceptAfter(lastTimestamp);
 
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+    //periodic syncs still happen once writes stop
+    int64_t limit = flushLimit();
+    std::vector<std::promise<bool>> waiters = takeDrainedWaiters(limit);
+    size_t flushed = flushAndSync(limit, waiters);
 
-    inFile.seekg(0, std::ios::end);
-    std::streampos fileSize = inFile.tellg();
-    std::streampos dataSize = fileSize - static_cast<std::streampos>(sizeof(TSDBHeader));
-    size_t numRecords = dataSize / sizeof(Record);
+    if (flushed > 0) recordFlush(flushed, queuedSince, started, thresholdReached, closing);
+    if (wal && checkpointDue(closing)) checkpoint();
 
-    std::vector<Record> records;
-    inFile.seekg(static_cast<std::streamoff>(sizeof(TSDBHeader)) + static_cast<std::streamoff>(startRecordIndex*sizeof(Record)), std::ios::beg);
-    for (size_t i=startRecordIndex; i<numRecords; i++)
+    //records held back behind a producer that was still publishing go out on the next deadline
+    bool waiting;
     {
-        Record record;
-        if (!inFile.read(reinterpret_cast<char*>(&record), sizeof(Record))) {
-            throw std::runtime_error("Failed to read records from file: " + filename);
-        }
-        if (record.timestamp > endTs) break;
-        if (record.timestamp < startTs) continue;
-        uint32_t expected = computeCRC(record);
-        if (expected != static_cast<uint32_t>(record.crc)) {
-            throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(record.timestamp));
-        }
-        records.push_back(record);
+        std::lock_guard<std::mutex> lock(waiterMutex);
+        waiting = !durableWaiters.empty();
     }
-    return records;
+    if (waiting || hasFlushable()) signalFlush(true, false);
 }
 
-std::optional<Record> Storage::readFromTime(int64_t timestamp) const
+void Storage::failFlushes(std::exception_ptr failure)
 {
-    std::vector<Record> result = readRange(timestamp, timestamp);
-    if (result.empty()) return std::nullopt;
-    return result.front();
+    std::lock_guard<std::mutex> lock(waiterMutex);
+    if (!flushFailure) flushFailure = failure;
+    flushFailed = true;
+    for (DurableWaiter& waiter : durableWaiters) waiter.promise.set_exception(flushFailure);
+    durableWaiters.clear();
 }
 
-std::optional<Record> Storage::getLastRecord() const
+void Storage::throwIfFlushFailed()
 {
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+    if (!flushFailed) return;
 
-    inFile.seekg(0, std::ios::end);
-    std::streampos fileSize = inFile.tellg();
+    std::lock_guard<std::mutex> lock(waiterMutex);
+    std::rethrow_exception(flushFailure);
+}
 
-    std::streampos dataSize = fileSize - static_cast<std::streampos>(sizeof(TSDBHeader));
-    if (dataSize == 0) return std::nullopt;
-    inFile.seekg(-static_cast<std::streamoff>(sizeof(Record)), std::ios::end);
+void Storage::signalPublished(IngestLane& lane, uint64_t first, size_t count)
+{
+    //the first records since the lane was drained start the latency deadline; crossing the threshold flushes now
+    uint64_t drained = lane.ring.drained();
+    uint64_t end = first + count;
+    if (end <= drained) return;
+
+    bool starts = first <= drained;
+    bool crosses = end - drained >= flushThreshold && (starts || first - drained < flushThreshold);
+    if (starts || crosses) signalFlush(true, crosses);
+}
 
-    Record last;
-    if (!inFile.read(reinterpret_cast<char*>(&last), sizeof(Record))) {
-        throw std::runtime_error("Failed to read last record: " + filename);
+void Storage::signalFlush(bool queued, bool requested) const
+{
+    {
+        std::lock_guard<std::mutex> lock(flushWakeupMutex);
+        if (queued && !recordsQueued)
+        {
+            recordsQueued = true;
+            firstQueued = std::chrono::steady_clock::now();
+        }
+        if (requested) flushRequested = true;
     }
+    flushWakeup.notify_one();
+}
 
-    uint32_t expected = computeCRC(last);
-
-    if (expected != static_cast<uint32_t>(last.crc)) {
-        throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(last.timestamp));
+std::chrono::steady_clock::time_point Storage::waitForFlush(bool& thresholdReached)
+{
+    std::unique_lock<std::mutex> lock(flushWakeupMutex);
+    while (running && !flushRequested)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (recordsQueued)
+        {
+            if (now >= firstQueued + maxFlushLatency) break;
+            flushWakeup.wait_until(lock, firstQueued + maxFlushLatency);
+        }
+        else if (syncSchedule.getMode() == DurabilityMode::Periodic && unsyncedBytes > 0)
+        {
+            //idle with a periodic sync still owed, which sets the only deadline
+            if (now >= syncSchedule.deadline()) break;
+            flushWakeup.wait_until(lock, syncSchedule.deadline());
+        }
+        else if (flushWakeup.wait_for(lock, idleRecheck) == std::cv_status::timeout)
+        {
+            //backstop for a signal lost to a race with the drain; an idle check finds nothing to write
+            break;
+        }
     }
 
-    return last;
+    thresholdReached = flushRequested;
+    std::chrono::steady_clock::time_point queuedSince = recordsQueued ? firstQueued : std::chrono::steady_clock::now();
+    recordsQueued = false;
+    flushRequested = false;
+    return queuedSince;
 }
 
-Record Storage::getRecord(size_t index) const
+void Storage::recordFlush(size_t records, std::chrono::steady_clock::time_point queuedSince,
+                          std::chrono::steady_clock::time_point started, bool thresholdReached, bool closing)
 {
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
+    std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+    auto micros = [](std::chrono::steady_clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    };
+    uint64_t flushTime = micros(finished - started);
+    uint64_t latency = micros(finished - std::min(queuedSince, started));
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    ++flushStats.flushes;
+    flushStats.records += records;
+    flushStats.bytes += records * sizeof(Record);
+    if (closing) ++flushStats.closeFlushes;
+    else if (thresholdReached) ++flushStats.thresholdFlushes;
+    else ++flushStats.deadlineFlushes;
+    flushStats.largestBatch = std::max<uint64_t>(flushStats.largestBatch, records);
+    flushStats.totalFlushTime += flushTime;
+    flushStats.longestFlushTime = std::max(flushStats.longestFlushTime, flushTime);
+    flushStats.totalIngestLatency += latency;
+    flushStats.longestIngestLatency = std::max(flushStats.longestIngestLatency, latency);
+}
 
-    inFile.seekg(0, std::ios::end);
+Storage::IngestLane& Storage::laneForThisThread()
+{
+    thread_local std::vector<std::unique_ptr<LaneLease>> leases;
+    for (const auto& lease : leases)
+    {
+        if (lease->storageId == storageId) return *lease->lane;
+    }
 
-    if (index >= static_cast<int>(recordCount)) throw std::out_of_range("Record index out of range");
-    inFile.seekg(static_cast<std::streamoff>(sizeof(TSDBHeader)) + static_cast<std::streamoff>(index*sizeof(Record)), std::ios::beg);
+    //leases on databases that have closed are dropped as the thread takes new ones
+    std::erase_if(leases, [](const std::unique_ptr<LaneLease>& lease) {
+        std::lock_guard<std::mutex> lock(lease->owner->mutex);
+        return lease->owner->storage == nullptr;
+    });
+
+    std::lock_guard<std::mutex> lock(laneMutex);
+    if (freeLanes.empty()) freeLanes.push_back(std::make_unique<IngestLane>(laneCapacity));
+    lanes.push_back(std::move(freeLanes.back()));
+    freeLanes.pop_back();
+    leases.push_back(std::make_unique<LaneLease>(storageId, laneOwner, lanes.back().get()));
+    return *lanes.back();
+}
 
-    Record record;
-    if (!inFile.read(reinterpret_cast<char*>(&record), sizeof(Record))) {
-        throw std::runtime_error("Failed to read record: " + filename);
-    }
+Storage::LaneLease::~LaneLease()
+{
+    std::lock_guard<std::mutex> lock(owner->mutex);
+    if (owner->storage) owner->storage->releaseLane(lane);
+}
 
-    uint32_t expected = computeCRC(record);
+void Storage::releaseLane(IngestLane* lane)
+{
+    //the exiting thread's records move to the memtable, so the lane is empty and nothing it held is lost;
+    //a durable waiter on the lane still sees its record as drained
+    drainForRead();
+    lane->newest = std::numeric_limits<int64_t>::min();
+    lane->recent.clear();
+
+    std::lock_guard<std::mutex> lock(laneMutex);
+    auto it = std::find_if(lanes.begin(), lanes.end(), [lane](const std::unique_ptr<IngestLane>& held) { return held.get() == lane; });
+    freeLanes.push_back(std::move(*it));
+    lanes.erase(it);
+}
 
-    if (expected != static_cast<uint32_t>(record.crc)) {
-        throw std::runtime_error("Data corruption detected in record with timestamp: " + std::to_string(record.timestamp));
-    }
+bool Storage::drainIntoMemtable() const
+{
+    std::lock_guard<std::mutex> lock(drainMutex);
+    std::vector<Record> run = drainLanes();
+    if (run.empty()) return false;
 
-    return record;
+    memtable.insert(run);
+    int64_t newest = memtable.last()->timestamp;
+    if (newest > lastTimestamp) lastTimestamp = newest;
+    return true;
 }
 
-int64_t Storage::getLastTimestamp() const
+void Storage::drainForRead() const
 {
-    return lastTimestamp;
+    //a reader may drain records whose producer saw the lane as already drained and skipped its signal
+    if (drainIntoMemtable() && hasFlushable()) signalFlush(true, memtable.size() >= flushThreshold);
 }
 
-TSDBHeader Storage::getHeader() const
+bool Storage::hasFlushable() const
 {
-    return header;
+    //what the next flush would commit, which drains alone never do
+    std::optional<Record> first = memtable.first();
+    return first && first->timestamp <= std::max(acceptAfter.load(), windowStart(lastTimestamp, reorderWindow));
 }
 
-size_t Storage::getRecordCount() const
+void Storage::raiseAcceptAfter(int64_t timestamp) const
 {
-    return recordCount;
+    int64_t current = acceptAfter.load();
+    while (current < timestamp && !acceptAfter.compare_exchange_weak(current, timestamp))
+    {
+    }
 }
 
-size_t Storage::getSparseIndexStep() const
+int64_t Storage::acceptFloor(const IngestLane& lane) const
 {
-    return sparseIndexStep;
+    //a window trails the newest record any producer had accepted, which flushes never pass; without one
+    //a producer's own records order its later ones even before they are drained
+    int64_t newest = reorderWindow > 0 ? std::max(lane.newest, newestAccepted.load()) : lane.newest;
+    return std::max(acceptAfter.load(), windowStart(newest, reorderWindow));
 }
 
-const std::vector<IndexEntry>& Storage::getSparseIndex() const
+bool Storage::acceptable(const IngestLane& lane, int64_t timestamp) const
 {
-    return sparseIndex;
+    //without a window the floor already holds a producer to strictly increasing timestamps
+    if (timestamp <= acceptFloor(lane)) return false;
+    return reorderWindow == 0 || !lane.recent.contains(timestamp);
 }
 
-TSDBHeader Storage::validateAndReadHeader(std::ifstream& inFile, std::string filename)
+void Storage::noteAccepted(IngestLane& lane, int64_t timestamp) const
 {
-    if (inFile.is_open()) {
+    lane.newest = std::max(lane.newest, timestamp);
+    if (reorderWindow == 0) return;
 
-        inFile.seekg(0, std::ios::end);
-        std::streampos fileSize = inFile.tellg();
+    //raised before the record is published, so no drained timestamp is ever newer
+    int64_t current = newestAccepted.load();
+    while (current < timestamp && !newestAccepted.compare_exchange_weak(current, timestamp))
+    {
+    }
 
-        if (fileSize < static_cast<std::streampos>(sizeof(TSDBHeader))) {
-            throw std::runtime_error("File too small to contain valid TSDB header: " + filename);
-        }
+    //only timestamps above the floor can be repeated, so the rest are forgotten
+    int64_t floor = windowStart(lane.newest, reorderWindow);
+    if (timestamp > floor) lane.recent.insert(timestamp);
+    lane.recent.erase(lane.recent.begin(), lane.recent.upper_bound(floor));
+}
 
-        TSDBHeader temporaryHeader;
-        inFile.seekg(0, std::ios::beg);
+int64_t Storage::flushLimit() const
+{
+    //the flush commits everything the window has left behind the newest drained record. loaded before
+    //the lanes are read: a producer that announces later also checks against a floor at least this high,
+    //and one that announced earlier keeps the limit below its record until it is published
+    raiseAcceptAfter(windowStart(lastTimestamp, reorderWindow));
+    int64_t limit = acceptAfter;
 
-        if (!inFile.read(reinterpret_cast<char*>(&temporaryHeader), sizeof(TSDBHeader))) {
-            throw std::runtime_error("Failed to read TSDB header: " + filename);
-        }
+    std::vector<IngestLane*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(laneMutex);
+        for (const auto& lane : lanes) snapshot.push_back(lane.get());
+    }
+    for (IngestLane* lane : snapshot)
+    {
+        int64_t publishing = lane->publishing.load();
+        if (publishing <= limit) limit = publishing == std::numeric_limits<int64_t>::min() ? publishing : publishing - 1;
+    }
 
-        if (temporaryHeader.magic[0] != 'T' || temporaryHeader.magic[1] != 'S' ||
-            temporaryHeader.magic[2] != 'D' || temporaryHeader.magic[3] != 'B') {
-            throw std::runtime_error("Invalid TSDB file magic number: " + filename);
-            }
+    //a producer that stopped announcing before the lanes were read has published its record; take it now
+    drainIntoMemtable();
+    return limit;
+}
 
-        if (temporaryHeader.version != 1) {
-            throw std::runtime_error("Unsupported TSDB file version: " + filename);
-        }
+std::vector<Record> Storage::drainLanes() const
+{
+    std::vector<IngestLane*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(laneMutex);
+        for (const auto& lane : lanes) snapshot.push_back(lane.get());
+    }
 
-        if (temporaryHeader.recordSize != sizeof(Record)) {
-            throw std::runtime_error("Record size mismatch: " + filename);
+    //a producer appends in timestamp order, so its lane normally drains as a sorted run; the rare
+    //lane that is not sorted is sorted on its own before the merge
+    std::vector<std::vector<Record>> runs;
+    for (IngestLane* lane : snapshot)
+    {
+        std::vector<Record> run;
+        if (lane->ring.drain(run) == 0) continue;
+        auto byTimestamp = [](const Record& a, const Record& b) { return a.timestamp < b.timestamp; };
+        if (!std::is_sorted(run.begin(), run.end(), byTimestamp)) std::stable_sort(run.begin(), run.end(), byTimestamp);
+        runs.push_back(std::move(run));
+    }
+
+    //a producer that published while its lane was being drained may have missed its signal
+    for (IngestLane* lane : snapshot)
+    {
+        if (lane->ring.size() > 0)
+        {
+            signalFlush(true, false);
+            break;
         }
+    }
 
-        return temporaryHeader;
+    std::vector<Record> batch;
+    if (!runs.empty()) mergeSortedRuns(runs, batch);
+    return batch;
+}
+
+std::vector<std::promise<bool>> Storage::takeDrainedWaiters(int64_t limit)
+{
+    //a drained record at or before the limit is either already written or in the memtable and written
+    //by this flush; a waiter may register after an earlier flush wrote its record, and the sync below still covers it
+    std::vector<std::promise<bool>> ready;
+    int64_t written = std::max(writtenThrough, limit);
+
+    std::lock_guard<std::mutex> lock(waiterMutex);
+    auto pending = std::partition(durableWaiters.begin(), durableWaiters.end(),
+                                  [written](const DurableWaiter& waiter) {
+                                      return waiter.position < waiter.lane->ring.drained() && waiter.timestamp <= written;
+                                  });
+    for (auto it = durableWaiters.begin(); it != pending; ++it)
+    {
+        ready.push_back(std::move(it->promise));
     }
-    throw std::runtime_error("File doesn't exist: " + filename);
+    durableWaiters.erase(durableWaiters.begin(), pending);
+    return ready;
 }
 
-size_t Storage::recoverPartialWriteAndReturnRecordCount(std::ifstream& inFile)
+size_t Storage::flushAndSync(int64_t limit, std::vector<std::promise<bool>>& waiters)
 {
-    inFile.seekg(0, std::ios::end);
-    std::streampos fileSize = inFile.tellg();
-    std::streampos dataSize = fileSize - static_cast<std::streampos>(sizeof(TSDBHeader));
-    size_t count = dataSize/static_cast<std::streampos>(sizeof(Record));
-    std::streampos remainder = dataSize % static_cast<std::streampos>(sizeof(Record));
+    size_t flushed = 0;
+    try
+    {
+        if (!ring || !submitFlush(limit, !waiters.empty(), flushed))
+        {
+            {
+                //readers see the batch either in the memtable or in the file; the sync happens outside the lock
+                std::unique_lock<std::shared_mutex> lock(viewMutex);
+                std::vector<Record> batch = memtable.takeThrough(limit);
+                flushed = batch.size();
+                if (!batch.empty() && wal) appendToLog(batch);
+                else if (!batch.empty()) flushBufferToDisk(batch);
+                writtenThrough = std::max(writtenThrough, limit);
+            }
+            syncSealedSegments();
+            if (unsyncedBytes > 0 && syncSchedule.due(!waiters.empty(), unsyncedBytes)) syncToDisk();
+        }
+    }
+    catch (...)
+    {
+        //the error sticks before any waiter wakes, so a caller that sees its append fail cannot append again
+        failFlushes(std::current_exception());
+        for (std::promise<bool>& waiter : waiters) waiter.set_exception(std::current_exception());
+        throw;
+    }
 
-    if (remainder == 0) return count;
+    for (std::promise<bool>& waiter : waiters) waiter.set_value(true);
+    return flushed;
+}
 
-    std::streamoff newFileSize = fileSize - remainder;
+bool Storage::submitFlush(int64_t limit, bool waiting, size_t& flushed)
+{
+    //blocks and batches that roll the file over take the blocking path
+    if (!wal && blockFile) return false;
 
-    inFile.close();
+    //the batch stays in the memtable while its write is in flight, so readers keep finding it there
+    std::vector<Record> batch;
+    memtable.readRange(std::numeric_limits<int64_t>::min(), limit, batch);
+    if (batch.empty()) return false;
+    if (!wal && recordsForActiveSegment(batch) != batch.size()) return false;
 
-    int fd = ::open(filename.c_str(), O_WRONLY);
-    if (fd == -1) {
-        throw std::runtime_error("Failed to open file for truncation");
+    size_t bytes = batch.size() * sizeof(Record);
+    int target = wal ? wal->descriptor() : fd;
+    uint64_t offset = wal ? wal->bytes() : recordOffset(recordCount);
+    bool sync = syncSchedule.due(waiting, unsyncedBytes);
+
+    //a linked sync starts only once the write has completed in full, and is cancelled if it fell short.
+    //a batch too long for one entry takes the blocking path, and a sync the ring has no room for is made
+    //with the blocking call once the write is done
+    if (!ring->queueWrite(target, batch.data(), bytes, offset, sync)) return false;
+    bool syncQueued = sync && ring->queueSync(target, syncSchedule.dataOnly());
+    unsyncedBytes += bytes;
+    ring->submit();
+
+    //producers' records move into the memtable for the next flush while the kernel works on this one
+    drainIntoMemtable();
+    ring->wait();
+
+    flushed = batch.size();
+    {
+        std::unique_lock<std::shared_mutex> lock(viewMutex);
+        memtable.takeThrough(limit);
+        if (wal)
+        {
+            wal->appended(batch.size());
+            logged.insert(batch);
+        }
+        else
+        {
+            publishWritten(batch);
+        }
+        writtenThrough = std::max(writtenThrough, limit);
     }
 
-    if (::ftruncate(fd, newFileSize) != 0) {
-        ::close(fd);
-        throw std::runtime_error("Failed to truncate TSDB file");
+    if (syncQueued)
+    {
+        recordSync();
     }
-
-    ::close(fd);
-
-    return count;
+    else if (sync)
+    {
+        syncToDisk();
+    }
+    return true;
 }
 
-uint32_t Storage::computeCRC(const Record& r) const
+void Storage::syncToDisk()
 {
-    uint32_t crc = crc32(0L, Z_NULL, 0);
-    crc = crc32(crc, reinterpret_cast<const Bytef*>(&r.timestamp), sizeof(r.timestamp));
-    crc = crc32(crc, reinterpret_cast<const Bytef*>(&r.value), sizeof(r.value));
-    return crc;
+    if (wal)
+    {
+        wal->sync(syncSchedule.dataOnly());
+    }
+    else
+    {
+        syncDataFile();
+    }
+    recordSync();
 }
 
-void Storage::buildSparseIndex()
+void Storage::recordSync()
 {
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile.is_open()) throw std::runtime_error("Failed to open file: " + filename);
-
-    inFile.seekg(0, std::ios::end);
+    unsyncedBytes = 0;
+    syncSchedule.synced();
 
-    size_t index = 0;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    ++flushStats.syncs;
+}
 
-    while (index<recordCount)
+void Storage::syncDataFile()
+{
+    if (blockFile)
     {
-        inFile.seekg(static_cast<std::streamoff>(sizeof(TSDBHeader)) + static_cast<std::streamoff>(index*sizeof(Record)), std::ios::beg);
-        int64_t ts;
-        if (!inFile.read(reinterpret_cast<char*>(&ts), sizeof(ts))) {
-            throw std::runtime_error("Failed to read timestamp from record: " + filename);
-        }
-        IndexEntry indexEntry;
-        indexEntry.timestamp = ts;
-        indexEntry.recordIndex = index;
-        sparseIndex.push_back(indexEntry);
-
-        index += sparseIndexStep;
+        blockFile->sync(syncSchedule.dataOnly());
+    }
+    else
+    {
+        syncSchedule.sync(fd);
     }
 }
 
-void Storage::flushLoop()
+void Storage::openWriteAheadLog()
 {
-    while (running) {
-        std::this_thread::sleep_for(flushInterval);
-
-        std::vector<Record> batch;
-
+    std::string walFilename = filename + ".wal";
+    wal = std::make_unique<WriteAheadLog<Record>>(walFilename);
+
+    //the log ends at a torn, corrupt or out of order record, which only a crash mid-write leaves; records
+    //from different producers may share a timestamp
+    std::vector<Record> records = wal->recover([this](const std::vector<Record>& entries) {
+        size_t valid = verifyRecords(entries.data(), entries.size(), checksumAlgorithm);
+        for (size_t i = 1; i < valid; ++i)
         {
-            std::lock_guard<std::mutex> lock(bufferMutex);
-            batch.swap(activeBuffer);
+            if (entries[i].timestamp < entries[i - 1].timestamp) valid = i;
         }
+        return valid;
+    });
+
+    //records a checkpoint wrote before it could empty the log are already in the data file
+    int64_t persisted = lastTimestamp;
+    records.erase(records.begin(), std::upper_bound(records.begin(), records.end(), persisted,
+                                                    [](int64_t ts, const Record& r) { return ts < r.timestamp; }));
+    if (!records.empty())
+    {
+        lastTimestamp = records.back().timestamp;
+        acceptAfter = lastTimestamp.load();
+        newestAccepted = lastTimestamp.load();
+        writtenThrough = lastTimestamp;
+        logged.insert(records);
+    }
+
+    //without the log from now on, what it held goes to the data file before anything newer
+    if (!writeAheadLog)
+    {
+        checkpoint();
+        wal.reset();
+        std::filesystem::remove(walFilename);
+    }
+}
+
+void Storage::appendToLog(std::vector<Record>& batch)
+{
+    //batches arrive sorted from the memtable and newer than everything logged
+    wal->append(batch);
+    unsyncedBytes += batch.size() * sizeof(Record);
+    logged.insert(batch);
+}
 
-        if (batch.empty()) continue;
+bool Storage::checkpointDue(bool closing) const
+{
+    size_t held = logged.size();
+    return held > 0 && (closing || held >= checkpointRecords || std::chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval);
+}
 
+void Storage::checkpoint()
+{
+    lastCheckpoint = std::chrono::steady_clock::now();
+    {
+        //readers see a record in the log memtable or in the file, never both
+        std::unique_lock<std::shared_mutex> lock(viewMutex);
+        std::vector<Record> batch = logged.takeThrough(std::numeric_limits<int64_t>::max());
+        if (batch.empty()) return;
         flushBufferToDisk(batch);
     }
+
+    //the log is emptied only once the data file holds its records durably
+    syncSealedSegments();
+    syncDataFile();
+    wal->clear();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    ++flushStats.checkpoints;
 }
 
 void Storage::flushBufferToDisk(std::vector<Record>& batch) {
-    std::sort(batch.begin(), batch.end(),
-              [](const Record& a, const Record& b) {
-                  return a.timestamp < b.timestamp;
-              });
+    //batches arrive sorted from the memtable; one that crosses a segment boundary is written in pieces
+    std::span<const Record> rest(batch);
+    while (!rest.empty())
+    {
+        size_t n = recordsForActiveSegment(rest);
+        if (n == 0)
+        {
+            rollSegment();
+            continue;
+        }
+        writeToActiveFile(rest.first(n));
+        rest = rest.subspan(n);
+    }
+}
 
-    size_t bytes = batch.size() * sizeof(Record);
+void Storage::writeToActiveFile(std::span<const Record> batch)
+{
+    //with a write-ahead log the data file is synced by the checkpoint instead
+    if (!wal) unsyncedBytes += batch.size() * sizeof(Record);
 
-    ssize_t written = ::write(fd, batch.data(), bytes);
-    if (written != static_cast<ssize_t>(bytes)) {
-        throw std::runtime_error("Partial write");
+    if (blockFile)
+    {
+        blockFile->append(batch);
     }
+    else
+    {
+        size_t bytes = batch.size() * sizeof(Record);
 
-    if (::fsync(fd) != 0) {
-        throw std::runtime_error("fsync failed");
+        ssize_t written = ::write(fd, batch.data(), bytes);
+        if (written != static_cast<ssize_t>(bytes)) {
+            throw std::runtime_error("Partial write");
+        }
     }
+    publishWritten(batch);
+}
+
+void Storage::publishWritten(std::span<const Record> batch)
+{
+    //indexes, summaries and the record count move past records already in the file
+    if (!blockFile) reader->grow(recordOffset(recordCount + batch.size()));
 
+    std::vector<BlockSummary> completed;
+    std::vector<IndexEntry> indexed;
+    size_t fittedSegments = learnedIndex ? learnedIndex->closedSegments().size() : 0;
+    std::unique_lock<std::mutex> lock(summaryMutex);
     for (const auto& r : batch) {
-        lastTimestamp = r.timestamp;
+        if (learnedIndex) learnedIndex->add(r.timestamp, recordCount);
 
         if (recordCount % sparseIndexStep == 0) {
-            sparseIndex.push_back({r.timestamp, recordCount});
+            indexed.push_back({r.timestamp, recordCount});
+            sparseIndex.append(indexed.back());
+        }
+
+        addToSummary(tailSummary, r);
+        if (tailSummary.count == sparseIndexStep)
+        {
+            summaries.push_back(tailSummary);
+            completed.push_back(tailSummary);
+            tailSummary = {};
         }
         ++recordCount;
     }
+    lock.unlock();
+
+    summaryFile->append(completed);
+    if (indexFile) indexFile->append(indexed);
+    if (learnedIndex) learnedFile->append(std::span<const LearnedSegment>(learnedIndex->closedSegments()).subspan(fittedSegments));
 }
\ No newline at end of file
@@ -3,65 +3,320 @@
 #include "Record.hpp"
 #include "TSDBHeader.hpp"
 #include "IndexEntry.hpp"
+#include "SparseIndex.hpp"
+#include "LearnedIndex.hpp"
+#include "StorageOptions.hpp"
+#include "FileReader.hpp"
+#include "BlockFile.hpp"
+#include "RangeCursor.hpp"
+#include "BlockSummary.hpp"
+#include "Aggregation.hpp"
+#include "SidecarFile.hpp"
+#include "MpscRing.hpp"
+#include "FlushStats.hpp"
+#include "BatchAppendResult.hpp"
+#include "Memtable.hpp"
+#include "SegmentInfo.hpp"
+#include "IoRing.hpp"
+#include "RecordView.hpp"
+#include "SegmentFiles.hpp"
+#include "CompactionWorker.hpp"
+#include "SyncSchedule.hpp"
+#include "WriteAheadLog.hpp"
 #include <vector>
 #include <optional>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <memory>
+#include <span>
+#include <future>
+#include <exception>
+#include <chrono>
+#include <limits>
+#include <unordered_map>
+#include <set>
 
 class Storage
 {
 public:
     //constructor
     explicit Storage(const std::string& filename, size_t sparseIndexStep = 1024);
+    Storage(const std::string& filename, const StorageOptions& options);
 
     //destructor
     ~Storage();
 
-    //write functions
+    //write functions; after a failed flush they throw or fail with its error
     bool append(Record r);
+    BatchAppendResult appendBatch(std::span<const Record> records);
+    std::future<bool> appendDurable(Record r);
 
-    //read functions
+    //read functions; unflushed records are included except by readRangeView, readRecords and getRecord
     std::vector<Record> readAll() const;
     std::vector<Record> readRange(int64_t startTs, int64_t endTs) const;
+    RecordView readRangeView(int64_t startTs, int64_t endTs) const;
+    size_t readRecords(size_t index, std::span<Record> out) const;
     std::optional<Record> readFromTime(int64_t timestamp) const;
     std::optional<Record> getLastRecord() const;
     Record getRecord(size_t index) const;
+    RangeCursor cursor(int64_t startTs, int64_t endTs, size_t chunkSize = 4096) const;
+
+    //aggregation functions
+    BlockSummary summarize(int64_t startTs, int64_t endTs) const;
+    std::optional<double> aggregate(int64_t startTs, int64_t endTs, AggregateFunction fn) const;
+    std::vector<DownsampleRow> downsample(int64_t startTs, int64_t endTs, int64_t bucketWidth, AggregateFunction fn) const;
 
     //getters
     int64_t getLastTimestamp() const;
     TSDBHeader getHeader() const;
     size_t getRecordCount() const;
     size_t getSparseIndexStep() const;
+    ReadMode getReadMode() const;
+    DurabilityMode getDurability() const;
+    IoBackend getIoBackend() const;
+    FlushStats getFlushStats() const;
+    ChecksumAlgorithm getChecksumAlgorithm() const;
+    std::vector<SegmentInfo> getSegments() const;
+    size_t getOpenSegmentCount() const;
+    size_t getLaneCount() const;
+    size_t getLearnedSegmentCount() const;
     const std::vector<IndexEntry>& getSparseIndex() const;
 
     static TSDBHeader validateAndReadHeader(std::ifstream& inFile, std::string filename);
 
+    //deletes the database file together with its sidecar files and sealed segments
+    static void removeFiles(const std::string& filename);
+
 private:
-    //file info
+    friend class RangeCursor;
+
+    //sealed segments open read only
+    Storage(const std::string& filename, const StorageOptions& options, bool readOnly);
+
+    //file info; filename is the active file, which new segments are created from
     const std::string filename;
+    const StorageOptions options;
+    const bool readOnly;
     TSDBHeader header;
-    int64_t lastTimestamp;
-    size_t recordCount;
-    int fd;
+    const ChecksumAlgorithm checksumAlgorithm;
+    //newest timestamp on disk or in the memtable
+    mutable std::atomic<int64_t> lastTimestamp;
+
+    //records at or before acceptAfter are final; flushes write only up to it
+    const int64_t reorderWindow;
+    mutable std::atomic<int64_t> acceptAfter;
+    //newest timestamp any producer has accepted
+    mutable std::atomic<int64_t> newestAccepted;
+    int64_t writtenThrough;
+    std::atomic<size_t> recordCount;
+    int fd = -1;
+
+    //read path
+    const ReadMode readMode;
+    std::unique_ptr<FileReader> reader;
+
+    //version 2 columnar layout
+    std::unique_ptr<BlockFile> blockFile;
+
+    //sparse index; the row layout persists it in the .idx sidecar
+    size_t sparseIndexStep;
+    SparseIndex sparseIndex;
+    std::unique_ptr<SidecarFile<IndexEntry>> indexFile;
+
+    //optional learned index; closed segments are persisted in the .lrn sidecar
+    std::unique_ptr<LearnedIndex> learnedIndex;
+    std::unique_ptr<SidecarFile<LearnedSegment>> learnedFile;
+
+    //per interval summaries; complete intervals are persisted in the .sum sidecar
+    mutable std::mutex summaryMutex;
+    std::vector<BlockSummary> summaries;
+    BlockSummary tailSummary{};
+    std::unique_ptr<SidecarFile<BlockSummary>> summaryFile;
+
+    //buffers; one lane per producer thread, publishing holds the oldest timestamp it is about to push
+    struct IngestLane
+    {
+        explicit IngestLane(size_t capacity) : ring(capacity) {}
+        MpscRing<Record> ring;
+        std::atomic<int64_t> publishing{std::numeric_limits<int64_t>::max()};
+
+        //owner thread only; recent holds its timestamps within the reorder window
+        int64_t newest = std::numeric_limits<int64_t>::min();
+        std::set<int64_t> recent;
+    };
+    //per thread lease on a lane, handed back on thread exit; the owner is cleared when the database closes
+    struct LaneOwner
+    {
+        std::mutex mutex;
+        Storage* storage = nullptr;
+    };
+    struct LaneLease
+    {
+        uint64_t storageId;
+        std::shared_ptr<LaneOwner> owner;
+        IngestLane* lane;
+        ~LaneLease();
+    };
+    const uint64_t storageId;
+    const std::shared_ptr<LaneOwner> laneOwner;
+    mutable std::mutex laneMutex;
+    std::vector<std::unique_ptr<IngestLane>> lanes;
+    std::vector<std::unique_ptr<IngestLane>> freeLanes;
 
-    //sparse index
-    const size_t sparseIndexStep;
-    std::vector<IndexEntry> sparseIndex;
+    //drains are serialised so each lane keeps a single consumer
+    mutable std::mutex drainMutex;
+    mutable Memtable memtable;
 
-    //buffers
-    std::vector<Record> activeBuffer;
-    std::vector<Record> flushBuffer;
+    //guards the file, its indexes and the memtable against a flush moving a batch
+    mutable std::shared_mutex viewMutex;
+
+    //sealed segments, oldest first; each is opened by the first query that overlaps it
+    const int64_t segmentDuration;
+    const size_t segmentBytes;
+    std::vector<SegmentInfo> segments;
+    std::atomic<size_t> sealedRecords{0};
+    std::unique_ptr<SidecarFile<SegmentInfo>> manifestFile;
+    mutable std::mutex segmentMutex;
+    mutable std::vector<std::shared_ptr<const Storage>> openSegments;
+    uint64_t nextSequence = 0;
+
+    //rolled segments waiting for their sync and manifest entry
+    UnsyncedFiles sealedUnsynced;
+    std::vector<SegmentInfo> unlistedSegments;
+
+    //retention; droppedRecords counts records dropped since the open
+    const int64_t retentionAge;
+    const size_t retentionBytes;
+    uint64_t droppedRecords = 0;
+
+    //serialises retention and compaction swaps outside the view lock
+    std::mutex segmentChangeMutex;
+
+    //cached on-disk size per segment sequence; guarded by segmentChangeMutex
+    std::unordered_map<uint64_t, uint64_t> segmentDiskBytes;
+
+    //background compaction of row layout segments into blocks
+    CompactionWorker compactor;
 
     //synchronisation
     std::atomic<bool> running{true};
-    mutable std::mutex bufferMutex;
     std::thread flushThread;
-    const std::chrono::milliseconds flushInterval{5};
+    const size_t flushThreshold;
+    const std::chrono::milliseconds maxFlushLatency;
+    mutable std::mutex flushWakeupMutex;
+    mutable std::condition_variable flushWakeup;
+    mutable bool recordsQueued = false;
+    mutable bool flushRequested = false;
+    mutable std::chrono::steady_clock::time_point firstQueued;
+
+    //flush statistics
+    mutable std::mutex statsMutex;
+    FlushStats flushStats{};
+
+    //write-ahead log; logged records wait in their own memtable until a checkpoint
+    const bool writeAheadLog;
+    const size_t checkpointRecords;
+    const std::chrono::milliseconds checkpointInterval;
+    std::unique_ptr<WriteAheadLog<Record>> wal;
+    mutable Memtable logged;
+    std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+
+    //durability; flush thread only
+    SyncSchedule syncSchedule;
+    size_t unsyncedBytes = 0;
+
+    //io_uring; the flush thread's ring is null when the backend is blocking or the kernel has none
+    const IoBackend ioBackend;
+    std::unique_ptr<IoRing> ring;
+
+    //durable appends waiting on the sync of the batch holding their lane position
+    struct DurableWaiter
+    {
+        IngestLane* lane;
+        uint64_t position;
+        int64_t timestamp;
+        std::promise<bool> promise;
+    };
+    std::mutex waiterMutex;
+    std::vector<DurableWaiter> durableWaiters;
 
+    //first flush failure, kept under waiterMutex
+    std::atomic<bool> flushFailed{false};
+    std::exception_ptr flushFailure;
 
     //private methods
+    void openActiveFile();
+    void createActiveFile(const TSDBHeader& fileHeader);
+    void loadSegments();
+    void renameActiveFile(uint64_t sequence);
+    void rollSegment();
+    void syncSealedSegments();
+    void adoptUnlistedSegments();
+    void enforceRetention();
+    uint64_t sealedDiskBytes(uint64_t sequence);
+    void removeStaleSegmentFiles();
+    bool compactNext();
+    bool compactSegment(uint64_t sequence);
+    void swapCompactedSegment(uint64_t sequence, const std::string& compacted);
+    size_t recordsForActiveSegment(std::span<const Record> records) const;
+    std::shared_ptr<const Storage> openSegment(size_t position) const;
+    std::vector<std::shared_ptr<const Storage>> overlappingSegments(int64_t startTs, int64_t endTs) const;
+    std::optional<Record> lastPersistedRecord() const;
+    size_t readActiveRecords(size_t index, std::span<Record> out) const;
+    size_t readIndexedRecords(size_t index, std::span<Record> out) const;
+    size_t readCursorRecords(size_t& position, size_t endPosition, std::span<Record> out) const;
     size_t recoverPartialWriteAndReturnRecordCount(std::ifstream& inFile);
     uint32_t computeCRC(const Record& r) const;
+    std::optional<size_t> findStartRecordIndex(int64_t startTs) const;
+    RecordView mappedRecords() const;
+    uint64_t recordOffset(size_t index) const;
+    void verifyCRC(const Record& r) const;
+    void verifyCRCs(std::span<const Record> records) const;
+    void verifyCRCs(const RecordView& records) const;
+    int64_t readTimestamp(size_t index) const;
     void buildSparseIndex();
+    void loadLearnedIndex(size_t maxError);
+    void loadSummaries();
+    BlockSummary summarizePersisted(int64_t startTs, int64_t endTs) const;
+    BlockSummary summarizeRecords(size_t index, size_t count, int64_t startTs, int64_t endTs) const;
     void flushLoop();
     void flushBufferToDisk( std::vector<Record>& buffer);
+    void writeToActiveFile(std::span<const Record> batch);
+    void publishWritten(std::span<const Record> batch);
+    size_t flushAndSync(int64_t limit, std::vector<std::promise<bool>>& waiters);
+    bool submitFlush(int64_t limit, bool waiting, size_t& flushed);
+    std::vector<std::promise<bool>> takeDrainedWaiters(int64_t limit);
+    void failFlushes(std::exception_ptr failure);
+    void throwIfFlushFailed();
+    IngestLane& laneForThisThread();
+    void releaseLane(IngestLane* lane);
+    void signalFlush(bool queued, bool requested) const;
+    void signalPublished(IngestLane& lane, uint64_t first, size_t count);
+    std::chrono::steady_clock::time_point waitForFlush(bool& thresholdReached);
+    void recordFlush(size_t records, std::chrono::steady_clock::time_point queuedSince,
+                     std::chrono::steady_clock::time_point started, bool thresholdReached, bool closing);
+    void flushAndRecord(std::chrono::steady_clock::time_point queuedSince, bool thresholdReached, bool closing);
+    std::vector<Record> drainLanes() const;
+    bool drainIntoMemtable() const;
+    void drainForRead() const;
+    bool hasFlushable() const;
+    void raiseAcceptAfter(int64_t timestamp) const;
+    int64_t acceptFloor(const IngestLane& lane) const;
+    bool acceptable(const IngestLane& lane, int64_t timestamp) const;
+    void noteAccepted(IngestLane& lane, int64_t timestamp) const;
+    int64_t flushLimit() const;
+    void readPersistedRange(int64_t startTs, int64_t endTs, std::vector<Record>& out) const;
+    void readChunksInFlight(IoRing& readRing, size_t index, size_t end, int64_t startTs, int64_t endTs, std::vector<Record>& out) const;
+    void mergeMemtable(int64_t startTs, int64_t endTs, std::vector<Record>& records) const;
+    RecordView mappedRange(int64_t startTs, int64_t endTs) const;
+    void syncToDisk();
+    void recordSync();
+    void syncDataFile();
+    void openWriteAheadLog();
+    void appendToLog(std::vector<Record>& batch);
+    bool checkpointDue(bool closing) const;
+    void checkpoint();
 };
\ No newline at end of file
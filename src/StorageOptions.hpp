@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+
+
+enum class ReadMode
+{
+    Stream,
+    Pread,
+    Mmap
+};
+
+//stored in TSDBHeader::reserved[0] so files written with zlib crc32 keep opening
+enum class ChecksumAlgorithm : uint8_t
+{
+    Zlib = 0,
+    Crc32c = 1
+};
+
+//stored in TSDBHeader::reserved[1]; block checksums need the version 2 block layout
+enum class ChecksumGranularity : uint8_t
+{
+    PerRecord = 0,
+    PerBlock = 1
+};
+
+//when flushed batches are synced; appendDurable syncs its batch in every mode
+enum class DurabilityMode
+{
+    Fsync,
+    Fdatasync,
+    Periodic,
+    Buffered
+};
+
+//flush writes and pread scans; io_uring falls back to blocking calls where the kernel lacks it
+enum class IoBackend
+{
+    Blocking,
+    IoUring
+};
+
+struct StorageOptions
+{
+    size_t sparseIndexStep = 1024;
+    ReadMode readMode = ReadMode::Pread;
+
+    //layout used when the file is created; existing files keep the version in their header
+    uint8_t formatVersion = 1;
+
+    //version 2 only: seal blocks with Gorilla encoded columns instead of raw columns
+    bool compressBlocks = true;
+
+    //checksum used when the file is created; existing files keep the algorithm in their header
+    ChecksumAlgorithm checksumAlgorithm = ChecksumAlgorithm::Crc32c;
+
+    //per block: sealed blocks drop the crc column and carry one checksum over the whole payload
+    ChecksumGranularity checksumGranularity = ChecksumGranularity::PerRecord;
+
+    //row layout only: max prediction error in records of a learned timestamp index; 0 is off
+    size_t learnedIndexError = 0;
+
+    //flush once a lane holds this many records or the oldest queued one has waited maxFlushLatency
+    size_t flushThresholdRecords = 8192;
+    std::chrono::milliseconds maxFlushLatency{5};
+
+    //accept records this far behind the newest any producer appended; 0 orders each producer on its own
+    int64_t reorderWindow = 0;
+
+    //roll over to a new segment per segmentDuration window or segmentBytes of records; 0 is off
+    int64_t segmentDuration = 0;
+    size_t segmentBytes = 0;
+
+    //drop whole sealed segments older than retentionAge or past retentionBytes on disk; 0 is off
+    int64_t retentionAge = 0;
+    size_t retentionBytes = 0;
+
+    //rewrite row segments older than compactionAge into compressed blocks; age 0 is off, rate 0 unthrottled
+    int64_t compactionAge = 0;
+    size_t compactionBytesPerSecond = 32 << 20;
+
+    //flushes sync only <file>.wal; a checkpoint moves its records to the data file
+    bool writeAheadLog = false;
+    size_t checkpointRecords = 1 << 16;
+    std::chrono::milliseconds checkpointInterval{1000};
+
+    DurabilityMode durability = DurabilityMode::Fsync;
+    IoBackend ioBackend = IoBackend::Blocking;
+
+    //periodic mode: sync after this long or this many bytes; 0 bytes means time only
+    std::chrono::milliseconds syncInterval{100};
+    size_t syncBytes = 0;
+};
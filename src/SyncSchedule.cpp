@@ -0,0 +1,48 @@
+#include "SyncSchedule.hpp"
+#include "SegmentFiles.hpp"
+
+SyncSchedule::SyncSchedule(DurabilityMode mode, std::chrono::milliseconds interval, size_t bytes) :
+    mode(mode), interval(interval), bytes(bytes)
+{
+}
+
+bool SyncSchedule::due(bool waiting, size_t unsyncedBytes) const
+{
+    switch (mode)
+    {
+        case DurabilityMode::Fsync:
+        case DurabilityMode::Fdatasync:
+            return true;
+        case DurabilityMode::Periodic:
+            return waiting || std::chrono::steady_clock::now() - lastSync >= interval ||
+                   (bytes > 0 && unsyncedBytes >= bytes);
+        case DurabilityMode::Buffered:
+            return waiting;
+    }
+    return true;
+}
+
+std::chrono::steady_clock::time_point SyncSchedule::deadline() const
+{
+    return lastSync + interval;
+}
+
+void SyncSchedule::sync(int fd) const
+{
+    syncFile(fd, dataOnly());
+}
+
+void SyncSchedule::synced()
+{
+    lastSync = std::chrono::steady_clock::now();
+}
+
+DurabilityMode SyncSchedule::getMode() const
+{
+    return mode;
+}
+
+bool SyncSchedule::dataOnly() const
+{
+    return mode != DurabilityMode::Fsync;
+}
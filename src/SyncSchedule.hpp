@@ -0,0 +1,31 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include "StorageOptions.hpp"
+
+//when a durability mode syncs what the flush thread has written, shared by both engines. only the flush
+//thread and the close touch it
+class SyncSchedule
+{
+public:
+    SyncSchedule(DurabilityMode mode, std::chrono::milliseconds interval, size_t bytes = 0);
+
+    //every mode syncs a flush someone waits on, which includes the close; a byte threshold of 0 is off
+    bool due(bool waiting, size_t unsyncedBytes) const;
+
+    //the periodic deadline while a sync is owed
+    std::chrono::steady_clock::time_point deadline() const;
+
+    //with the mode's call; synced() restarts the interval, whatever made the sync
+    void sync(int fd) const;
+    void synced();
+
+    DurabilityMode getMode() const;
+    bool dataOnly() const;
+
+private:
+    const DurabilityMode mode;
+    const std::chrono::milliseconds interval;
+    const size_t bytes;
+    std::chrono::steady_clock::time_point lastSync = std::chrono::steady_clock::now();
+};
@@ -1,10 +1,16 @@
 #include "TSDBCLI.hpp"
+#include "Checksum.hpp"
+#include "Kernels.hpp"
+#include "SparseIndex.hpp"
 #include <iostream>
 #include <sstream>
 #include <filesystem>
 #include <algorithm>
+#include <limits>
+#include <cmath>
+#include <random>
 
-TSDBCLI::TSDBCLI() : storage(nullptr)
+TSDBCLI::TSDBCLI() : storage(nullptr), engine(nullptr)
 {
 }
 
@@ -34,6 +40,14 @@ void TSDBCLI::printHelp() const
     std::cout << "  readfrom <timestamp>       - Read record from the specified timestamp\n";
     std::cout << "  readrange <start> <end>    - Read records in the specified time range\n";
     std::cout << "  append <timestamp> <value> - Append a new record\n";
+    std::cout << "  appendbatch <timestamp> <value> [<timestamp> <value> ...] - Append several records at once\n";
+    std::cout << "  aggregate <fn> <start> <end> - Compute count, sum, min, max, avg, first or last over a time range\n";
+    std::cout << "  downsample <fn> <start> <end> <width> - Aggregate a time range in buckets of the given width\n";
+    std::cout << "  stats                      - Show flush statistics for the current database\n";
+    std::cout << "  series <engine>            - Open or create a multi-series engine\n";
+    std::cout << "  slist                      - List the series in the current engine\n";
+    std::cout << "  sappend <series> <timestamp> <value> - Append a new record to a series\n";
+    std::cout << "  sreadrange <series> <start> <end> - Read a series' records in the specified time range\n";
     std::cout << "  exit, quit                 - Exit the CLI\n";
 }
 
@@ -120,36 +134,49 @@ void TSDBCLI::handleCommand(const std::string& command)
         std::cout << "p95 append time: " << p95 << " ns\n";
         std::cout << "p99 append time: " << p99 << " ns\n";
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        storage.reset();
 
-        std::vector<long long> readFromTimes;
-        long long totalReadFromTime = 0;
+        std::cout << "\nOpen time rebuilding the sparse index against loading the .idx sidecar:\n";
+        benchmarkOpen(db);
 
-        for (int i=0; i<timestamps.size(); i+=100)
-        {
-            int64_t ts = timestamps[i];
-            auto start = std::chrono::high_resolution_clock::now();
-            (*storage).readFromTime(ts);
-            auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "\nSparse index lookups (binary search over entries against the Eytzinger tree):\n";
+        benchmarkIndexLookups();
 
-            long long duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-            readFromTimes.push_back(duration_ns);
-            totalReadFromTime += duration_ns;
-        }
+        std::cout << "\nRead latency before (ifstream per call) and after (persistent descriptor / mapping):\n";
+        benchmarkReads(db, ReadMode::Stream, "ifstream", timestamps);
+        benchmarkReads(db, ReadMode::Pread, "pread", timestamps);
+        benchmarkReads(db, ReadMode::Mmap, "mmap", timestamps);
 
-        std::cout << "\nAverage read from time: " << static_cast<double>((totalReadFromTime / readFromTimes.size()))/1000 << " ms\n";
+        std::cout << "\nRead latency starting from the sparse index against the learned index:\n";
+        benchmarkReads(db, ReadMode::Pread, "pread, learned index", timestamps, 16);
+        std::cout << "Learned index segments: " << Storage(db, StorageOptions{.learnedIndexError = 16}).getLearnedSegmentCount()
+                  << " against " << Storage(db).getSparseIndex().size() << " sparse index entries\n";
 
-        std::sort(readFromTimes.begin(), readFromTimes.end());
-        p99 = readFromTimes[readFromTimes.size() * 99 / 100];
-        p95 = readFromTimes[readFromTimes.size() * 95 / 100];
-        p50 = readFromTimes[readFromTimes.size() / 2];
+        std::cout << "\nScan cost of the row layout against raw and compressed columnar blocks:\n";
+        benchmarkScans(db);
 
-        std::cout << "p50 read from time: " << static_cast<double>(p50)/1000 << " ms\n";
-        std::cout << "p95 read from time: " << static_cast<double>(p95)/1000 << " ms\n";
-        std::cout << "p99 read from time: " << static_cast<double>(p99)/1000 << " ms\n";
+        std::cout << "\nChecksum cost per record (zlib crc32 against CRC32C):\n";
+        benchmarkChecksums(db);
 
-        storage.reset();
-        std::filesystem::remove(db);
+        std::cout << "\nAggregation by folding readRange against per-block summaries:\n";
+        benchmarkAggregates(db);
+
+        std::cout << "\nDownsampling by folding readRange against the bucketed kernel (" << (avx2Available() ? "avx2" : "scalar") << "):\n";
+        benchmarkDownsample(db);
+
+        std::cout << "\nAppend latency through per-thread ingest lanes by producer count:\n";
+        benchmarkIngest();
+
+        std::cout << "\nWrite cost of each durability mode:\n";
+        benchmarkDurability();
+
+        std::cout << "\nMany series in one engine against one database per series:\n";
+        benchmarkSeries();
+
+        std::cout << "\nOpen and range query cost of one file against time segments:\n";
+        benchmarkSegments();
+
+        Storage::removeFiles(db);
         std::cout << "Performance metric mode exited. Database deleted.\n";
     }
     else if (command.rfind("create ", 0) == 0)
@@ -218,10 +245,13 @@ void TSDBCLI::handleCommand(const std::string& command)
             std::cout << "No database selected. Use the 'use <database>' command to select a database.\n";
             return;
         }
-        std::vector<Record> records = (*storage).readAll();
-        for (const Record& r : records)
+        RangeCursor cursor = (*storage).cursor(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max());
+        for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next())
         {
-            std::cout << "Timestamp: " << r.timestamp << ", Value: " << r.value << "\n";
+            for (const Record& r : chunk)
+            {
+                std::cout << "Timestamp: " << r.timestamp << ", Value: " << r.value << "\n";
+            }
         }
     }
     else if (command.rfind("readfrom ", 0) == 0)
@@ -277,17 +307,107 @@ void TSDBCLI::handleCommand(const std::string& command)
             return;
         }
 
-        std::vector<Record> records = (*storage).readRange(number1, number2);
-        if (records.empty())
+        bool found = false;
+        RangeCursor cursor = (*storage).cursor(number1, number2);
+        for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next())
+        {
+            for (const Record& r : chunk)
+            {
+                std::cout << "Timestamp: " << r.timestamp << ", Value: " << r.value << "\n";
+            }
+            found = true;
+        }
+        if (!found)
         {
             std::cout << "No record found\n";
         }
+    }
+    else if (command.rfind("aggregate ", 0) == 0)
+    {
+        if (!storage)
+        {
+            std::cout << "No database selected. Use the 'use <database>' command to select a database.\n";
+            return;
+        }
+        if (!validateAggregateCommand(command))
+        {
+            std::cout << "Invalid aggregate command. Usage: aggregate <count|sum|min|max|avg|first|last> <start> <end>\n";
+            return;
+        }
+        std::istringstream iss(command);
+        std::string ignore;
+        std::string fn;
+        int64_t number1, number2;
+
+        iss >> ignore >> fn >> number1 >> number2;
+
+        if (number1 > number2)
+        {
+            std::cout << "Invalid time range: start time is greater than end time.\n";
+            return;
+        }
+
+        std::optional<double> result = (*storage).aggregate(number1, number2, *parseAggregateFunction(fn));
+        if (result.has_value())
+        {
+            std::cout << fn << ": " << *result << "\n";
+        }
         else
         {
-            for (const Record& r : records)
-            {
-                std::cout << "Timestamp: " << r.timestamp << ", Value: " << r.value << "\n";
-            }
+            std::cout << "No record found\n";
+        }
+    }
+    else if (command == "stats")
+    {
+        if (!storage)
+        {
+            std::cout << "No database selected. Use the 'use <database>' command to select a database.\n";
+            return;
+        }
+        FlushStats stats = (*storage).getFlushStats();
+        uint64_t flushes = std::max<uint64_t>(stats.flushes, 1);
+        std::cout << "Flushes: " << stats.flushes << " (" << stats.thresholdFlushes << " threshold, "
+                  << stats.deadlineFlushes << " deadline, " << stats.closeFlushes << " close)\n";
+        std::cout << "Records flushed: " << stats.records << " (" << stats.bytes << " bytes)\n";
+        std::cout << "Syncs: " << stats.syncs << "\n";
+        std::cout << "Checkpoints: " << stats.checkpoints << "\n";
+        std::cout << "Largest batch: " << stats.largestBatch << " records\n";
+        std::cout << "Flush time: " << stats.totalFlushTime / flushes << " us average, " << stats.longestFlushTime << " us longest\n";
+        std::cout << "Ingest latency: " << stats.totalIngestLatency / flushes << " us average, " << stats.longestIngestLatency << " us longest\n";
+    }
+    else if (command.rfind("downsample ", 0) == 0)
+    {
+        if (!storage)
+        {
+            std::cout << "No database selected. Use the 'use <database>' command to select a database.\n";
+            return;
+        }
+        if (!validateDownsampleCommand(command))
+        {
+            std::cout << "Invalid downsample command. Usage: downsample <count|sum|min|max|avg|first|last> <start> <end> <width>\n";
+            return;
+        }
+        std::istringstream iss(command);
+        std::string ignore;
+        std::string fn;
+        int64_t number1, number2, width;
+
+        iss >> ignore >> fn >> number1 >> number2 >> width;
+
+        if (number1 > number2)
+        {
+            std::cout << "Invalid time range: start time is greater than end time.\n";
+            return;
+        }
+
+        std::vector<DownsampleRow> rows = (*storage).downsample(number1, number2, width, *parseAggregateFunction(fn));
+        if (rows.empty())
+        {
+            std::cout << "No record found\n";
+        }
+        for (const DownsampleRow& row : rows)
+        {
+            std::cout << "Timestamp: " << row.bucketStart << ", Value: " << row.value << "\n";
         }
     }
     else if (command.rfind("append ", 0) == 0)
@@ -314,12 +434,687 @@ void TSDBCLI::handleCommand(const std::string& command)
         if (success) std::cout << "Record accepted, pending persistence\n";
         else std::cout << "Failed to accept record.\n";
     }
+    else if (command.rfind("appendbatch ", 0) == 0)
+    {
+        if (!storage)
+        {
+            std::cout << "No database selected. Use the 'use <database>' command to select a database.\n";
+            return;
+        }
+        if (!validateAppendBatchCommand(command))
+        {
+            std::cout << "Invalid appendbatch command. Usage: appendbatch <timestamp> <value> [<timestamp> <value> ...]\n";
+            return;
+        }
+        std::istringstream iss(command);
+        std::string ignore;
+        iss >> ignore;
+
+        std::vector<Record> records;
+        Record r{};
+        while (iss >> r.timestamp >> r.value)
+        {
+            records.push_back(r);
+        }
+
+        BatchAppendResult result = (*storage).appendBatch(records);
+
+        std::cout << result.accepted << " records accepted, " << result.rejected << " rejected, pending persistence\n";
+    }
+    else if (command.rfind("series ", 0) == 0)
+    {
+        if (!validateSeriesCommand(command))
+        {
+            std::cout << "Invalid series command. Usage: series <engine> where <engine> contains letters and numbers only\n";
+            return;
+        }
+        std::istringstream iss(command);
+        std::string ignore;
+        std::string directory;
+
+        iss >> ignore >> directory;
+
+        directory += ".series";
+
+        if (engine)
+        {
+            engine.reset();
+        }
+        engine = std::make_unique<SeriesEngine>(directory);
+    }
+    else if (command == "slist")
+    {
+        if (!engine)
+        {
+            std::cout << "No engine selected. Use the 'series <engine>' command to select an engine.\n";
+            return;
+        }
+        std::vector<std::string> names = (*engine).getSeriesNames();
+        if (names.empty())
+        {
+            std::cout << "No series found\n";
+        }
+        for (const std::string& name : names)
+        {
+            std::cout << "Series: " << name << "\n";
+        }
+    }
+    else if (command.rfind("sappend ", 0) == 0)
+    {
+        if (!engine)
+        {
+            std::cout << "No engine selected. Use the 'series <engine>' command to select an engine.\n";
+            return;
+        }
+        if (!validateSeriesAppendCommand(command))
+        {
+            std::cout << "Invalid sappend command. Usage: sappend <series> <timestamp> <value>\n";
+            return;
+        }
+        std::istringstream iss(command);
+        std::string ignore;
+        std::string name;
+        int64_t timestamp;
+        double value;
+
+        iss >> ignore >> name >> timestamp >> value;
+
+        bool success = (*engine).append(name, Record{timestamp, value});
+
+        if (success) std::cout << "Record accepted, pending persistence\n";
+        else std::cout << "Failed to accept record.\n";
+    }
+    else if (command.rfind("sreadrange ", 0) == 0)
+    {
+        if (!engine)
+        {
+            std::cout << "No engine selected. Use the 'series <engine>' command to select an engine.\n";
+            return;
+        }
+        if (!validateSeriesReadRangeCommand(command))
+        {
+            std::cout << "Invalid sreadrange command. Usage: sreadrange <series> <start> <end>\n";
+            return;
+        }
+        std::istringstream iss(command);
+        std::string ignore;
+        std::string name;
+        int64_t number1, number2;
+
+        iss >> ignore >> name >> number1 >> number2;
+
+        if (number1 > number2)
+        {
+            std::cout << "Invalid time range: start time is greater than end time.\n";
+            return;
+        }
+
+        std::vector<Record> records = (*engine).readRange(name, number1, number2);
+        if (records.empty())
+        {
+            std::cout << "No record found\n";
+        }
+        for (const Record& r : records)
+        {
+            std::cout << "Timestamp: " << r.timestamp << ", Value: " << r.value << "\n";
+        }
+    }
     else
     {
         std::cout << "Unknown command: " << command << "\n";
     }
 }
 
+void TSDBCLI::benchmarkOpen(const std::string& db) const
+{
+    std::filesystem::remove(db + ".idx");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t entries = Storage(db).getSparseIndex().size();
+    auto end = std::chrono::high_resolution_clock::now();
+    long long rebuildTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    Storage(db).getSparseIndex();
+    end = std::chrono::high_resolution_clock::now();
+    long long loadTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::cout << "Open with " << entries << " index entries (rebuilt from records): " << rebuildTime << " us\n";
+    std::cout << "Open with " << entries << " index entries (loaded from sidecar): " << loadTime << " us\n";
+}
+
+void TSDBCLI::benchmarkIndexLookups() const
+{
+    const size_t entryCount = 10'000'000;
+    const size_t lookupCount = 1'000'000;
+
+    //the index of a ten billion record file at the default step
+    std::vector<IndexEntry> entries(entryCount);
+    for (size_t i = 0; i < entryCount; ++i)
+    {
+        entries[i] = {static_cast<int64_t>(i) * 1024 + static_cast<int64_t>(i % 7), i * 1024};
+    }
+    SparseIndex index;
+    index.assign(entries);
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int64_t> dist(0, static_cast<int64_t>(entryCount) * 1024);
+    std::vector<int64_t> keys(lookupCount);
+    for (int64_t& key : keys) key = dist(rng);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t binaryChecksum = 0;
+    for (int64_t key : keys)
+    {
+        auto next = std::upper_bound(entries.begin(), entries.end(), key,
+                                     [](int64_t ts, const IndexEntry& e) { return ts < e.timestamp; });
+        binaryChecksum += static_cast<size_t>(next - entries.begin());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    long long binaryTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    size_t treeChecksum = 0;
+    for (int64_t key : keys)
+    {
+        treeChecksum += index.findLast(key).value_or(static_cast<size_t>(-1)) + 1;
+    }
+    end = std::chrono::high_resolution_clock::now();
+    long long treeTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    if (binaryChecksum != treeChecksum)
+    {
+        std::cout << "Index lookup mismatch\n";
+    }
+
+    std::cout << "Lookup over " << entryCount << " entries (binary search): " << binaryTime / static_cast<long long>(lookupCount) << " ns\n";
+    std::cout << "Lookup over " << entryCount << " entries (Eytzinger): " << treeTime / static_cast<long long>(lookupCount) << " ns\n";
+}
+
+void TSDBCLI::benchmarkIngest() const
+{
+    const std::string db = "performance_ingest.tsdb";
+    const int totalRecords = 1'000'000;
+
+    for (int producerCount : {1, 2, 4, 8, 16, 32, 64})
+    {
+        Storage::removeFiles(db);
+        StorageOptions options;
+        options.durability = DurabilityMode::Buffered;
+
+        //power of two buckets: bucket b counts appends under 64 << b ns, and the last one everything slower
+        const int bucketCount = 16;
+        std::vector<long long> histogram(bucketCount, 0);
+        std::vector<long long> appendTimes;
+        appendTimes.reserve(totalRecords);
+        std::mutex mtx;
+        FlushStats stats{};
+        {
+            Storage writer(db, options);
+            std::atomic<int64_t> clock{0};
+            std::vector<std::thread> producers;
+            for (int p = 0; p < producerCount; ++p)
+            {
+                producers.emplace_back([&]() {
+                    std::vector<long long> local;
+                    local.reserve(totalRecords / producerCount);
+                    for (int i = 0; i < totalRecords / producerCount; ++i)
+                    {
+                        Record r{clock.fetch_add(1, std::memory_order_relaxed), static_cast<double>(i), 0};
+                        auto start = std::chrono::high_resolution_clock::now();
+                        writer.append(r);
+                        auto end = std::chrono::high_resolution_clock::now();
+                        local.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                    }
+
+                    std::lock_guard<std::mutex> lock(mtx);
+                    appendTimes.insert(appendTimes.end(), local.begin(), local.end());
+                });
+            }
+            for (auto& t : producers) t.join();
+            stats = writer.getFlushStats();
+        }
+
+        for (long long time : appendTimes)
+        {
+            int bucket = 0;
+            while (bucket < bucketCount - 1 && time >= (64LL << bucket)) ++bucket;
+            ++histogram[bucket];
+        }
+
+        std::sort(appendTimes.begin(), appendTimes.end());
+        std::cout << producerCount << " producers: p50 " << appendTimes[appendTimes.size() / 2]
+                  << " ns, p99 " << appendTimes[appendTimes.size() * 99 / 100]
+                  << " ns, p99.9 " << appendTimes[appendTimes.size() * 999 / 1000]
+                  << " ns, max " << appendTimes.back() << " ns\n   ";
+        for (int bucket = 0; bucket < bucketCount; ++bucket)
+        {
+            if (histogram[bucket] == 0) continue;
+            if (bucket == bucketCount - 1) std::cout << " >=" << (64LL << (bucket - 1)) << "ns:" << histogram[bucket];
+            else std::cout << " <" << (64LL << bucket) << "ns:" << histogram[bucket];
+        }
+        std::cout << "\n    " << stats.flushes << " flushes (" << stats.thresholdFlushes << " on threshold), "
+                  << stats.records / std::max<uint64_t>(stats.flushes, 1) << " records per flush, ingest latency "
+                  << stats.totalIngestLatency / std::max<uint64_t>(stats.flushes, 1) << " us average, "
+                  << stats.longestIngestLatency << " us longest\n";
+    }
+
+    //one producer handing over the same records singly and in batches of a thousand
+    std::vector<Record> records(totalRecords);
+    for (int i = 0; i < totalRecords; ++i) records[i] = Record{i, static_cast<double>(i), 0};
+    for (size_t batchSize : {size_t{1}, size_t{1000}})
+    {
+        Storage::removeFiles(db);
+        StorageOptions options;
+        options.durability = DurabilityMode::Buffered;
+        long long time;
+        {
+            Storage writer(db, options);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t offset = 0; offset < records.size(); offset += batchSize)
+            {
+                if (batchSize == 1) writer.append(records[offset]);
+                else writer.appendBatch(std::span<const Record>(records).subspan(offset, std::min(batchSize, records.size() - offset)));
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            time = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        }
+        std::cout << (batchSize == 1 ? "append" : "appendBatch of 1000") << ": " << time / totalRecords << " ns per record\n";
+    }
+
+    Storage::removeFiles(db);
+}
+
+void TSDBCLI::benchmarkSeries() const
+{
+    const std::string directory = "performance_series";
+    const int recordsPerSeries = 100;
+
+    auto elapsed = [](std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    //files the run actually left behind, so the comparison counts what each layout creates
+    auto countFiles = [](const std::filesystem::path& parent, const std::string& prefix) {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(parent))
+        {
+            if (entry.is_regular_file() && entry.path().filename().string().starts_with(prefix)) ++count;
+        }
+        return count;
+    };
+
+    //readings arrive round robin across series, as from a fleet of collectors
+    for (int seriesCount : {100, 10'000})
+    {
+        SeriesEngine::removeFiles(directory);
+        std::vector<std::string> names;
+        for (int i = 0; i < seriesCount; ++i) names.push_back("series" + std::to_string(i));
+
+        long long appendTime;
+        long long closeTime;
+        {
+            SeriesEngineOptions options;
+            options.durability = DurabilityMode::Buffered;
+            auto engine = std::make_unique<SeriesEngine>(directory, options);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < recordsPerSeries; ++i)
+            {
+                for (const std::string& name : names) engine->append(name, Record{i, static_cast<double>(i), 0});
+            }
+            appendTime = elapsed(start);
+            start = std::chrono::high_resolution_clock::now();
+            engine.reset();
+            closeTime = elapsed(start);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        SeriesEngine engine(directory);
+        long long openTime = elapsed(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        for (const std::string& name : names) engine.readRange(name, 0, recordsPerSeries);
+        long long readTime = elapsed(start);
+
+        std::cout << "Engine, " << seriesCount << " series: " << appendTime / (static_cast<long long>(seriesCount) * recordsPerSeries)
+                  << " ns per append, close " << closeTime / 1000 << " us, open " << openTime / 1000 << " us, "
+                  << readTime / seriesCount << " ns per series read, " << engine.getChunkCount() << " chunks, "
+                  << countFiles(directory, "") << " files, 1 flush thread\n";
+    }
+    SeriesEngine::removeFiles(directory);
+
+    //the same ingest with a Storage per series, which costs a file set and a flush thread each
+    const int storageCount = 100;
+    std::vector<std::unique_ptr<Storage>> databases;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < storageCount; ++i)
+    {
+        std::string db = directory + std::to_string(i) + ".tsdb";
+        Storage::removeFiles(db);
+        StorageOptions options;
+        options.durability = DurabilityMode::Buffered;
+        databases.push_back(std::make_unique<Storage>(db, options));
+    }
+    for (int i = 0; i < recordsPerSeries; ++i)
+    {
+        for (auto& database : databases) database->append(Record{i, static_cast<double>(i), 0});
+    }
+    long long appendTime = elapsed(start);
+    start = std::chrono::high_resolution_clock::now();
+    databases.clear();
+    long long closeTime = elapsed(start);
+    std::cout << "Storage per series, " << storageCount << " series: " << appendTime / 1000 << " us to open and append, close "
+              << closeTime / 1000 << " us, " << countFiles(".", directory) << " files, " << storageCount << " flush threads\n";
+    for (int i = 0; i < storageCount; ++i) Storage::removeFiles(directory + std::to_string(i) + ".tsdb");
+}
+
+void TSDBCLI::benchmarkSegments() const
+{
+    const std::string db = "performance_segments.tsdb";
+    const int64_t recordCount = 2'000'000;
+    const int64_t segmentDuration = 200'000;
+
+    auto elapsed = [](std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    std::vector<Record> records;
+    records.reserve(recordCount);
+    for (int64_t ts = 0; ts < recordCount; ++ts) records.push_back(Record{ts, static_cast<double>(ts), 0});
+
+    for (int64_t duration : {int64_t{0}, segmentDuration})
+    {
+        Storage::removeFiles(db);
+        {
+            StorageOptions options;
+            options.durability = DurabilityMode::Buffered;
+            options.segmentDuration = duration;
+            Storage writer(db, options);
+            writer.appendBatch(records);
+        }
+
+        //the sidecar is dropped so the open rebuilds the sparse index, as after a crash
+        std::filesystem::remove(db + ".idx");
+        auto start = std::chrono::high_resolution_clock::now();
+        Storage reader(db);
+        long long openTime = elapsed(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        size_t found = reader.readRange(recordCount - 1000, recordCount - 1).size();
+        long long readTime = elapsed(start);
+
+        std::cout << (duration == 0 ? "One file" : std::to_string(reader.getSegments().size()) + " sealed segments") << ": open "
+                  << openTime << " us, newest " << found << " records in " << readTime << " us, "
+                  << reader.getOpenSegmentCount() << " segments opened\n";
+    }
+    Storage::removeFiles(db);
+}
+
+void TSDBCLI::benchmarkDurability() const
+{
+    const std::string db = "performance_durability.tsdb";
+    const int recordCount = 200'000;
+    const int ackCount = 50;
+
+    //the block layout syncs every block it seals, which a write-ahead log takes off the append path
+    struct Mode
+    {
+        const char* label;
+        DurabilityMode mode;
+        uint8_t formatVersion;
+        bool writeAheadLog;
+        IoBackend ioBackend;
+    };
+    const Mode modes[] = {
+        {"fsync per batch", DurabilityMode::Fsync, 1, false, IoBackend::Blocking},
+        {"fdatasync per batch", DurabilityMode::Fdatasync, 1, false, IoBackend::Blocking},
+        {"fdatasync per batch, io_uring", DurabilityMode::Fdatasync, 1, false, IoBackend::IoUring},
+        {"periodic", DurabilityMode::Periodic, 1, false, IoBackend::Blocking},
+        {"buffered", DurabilityMode::Buffered, 1, false, IoBackend::Blocking},
+        {"fdatasync per batch, blocks", DurabilityMode::Fdatasync, 2, false, IoBackend::Blocking},
+        {"fdatasync per batch to the log, blocks", DurabilityMode::Fdatasync, 2, true, IoBackend::Blocking},
+        {"fdatasync per batch to the log, io_uring", DurabilityMode::Fdatasync, 2, true, IoBackend::IoUring},
+    };
+
+    for (const Mode& mode : modes)
+    {
+        Storage::removeFiles(db);
+        StorageOptions options;
+        options.durability = mode.mode;
+        options.formatVersion = mode.formatVersion;
+        options.writeAheadLog = mode.writeAheadLog;
+        options.ioBackend = mode.ioBackend;
+
+        //paced writes so the flush thread sees many small batches, as it does under live ingest
+        auto start = std::chrono::high_resolution_clock::now();
+        long long ackTime = 0;
+        {
+            Storage writer(db, options);
+            for (int i = 0; i < recordCount; ++i)
+            {
+                writer.append(Record{i, static_cast<double>(i)});
+                if (i % 1000 == 999) std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+
+            for (int i = 0; i < ackCount; ++i)
+            {
+                auto ackStart = std::chrono::high_resolution_clock::now();
+                writer.appendDurable(Record{recordCount + i, 0.0}).get();
+                auto ackEnd = std::chrono::high_resolution_clock::now();
+                ackTime += std::chrono::duration_cast<std::chrono::microseconds>(ackEnd - ackStart).count();
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        long long totalTime = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+        std::cout << "Write " << recordCount << " records and close (" << mode.label << "): " << totalTime << " ms, "
+                  << "durable append ack: " << ackTime / ackCount << " us\n";
+    }
+
+    Storage::removeFiles(db);
+}
+
+void TSDBCLI::benchmarkReads(const std::string& db, ReadMode mode, const std::string& label, const std::vector<int64_t>& timestamps, size_t learnedIndexError) const
+{
+    StorageOptions options;
+    options.readMode = mode;
+    options.learnedIndexError = learnedIndexError;
+    Storage reader(db, options);
+
+    std::vector<long long> readFromTimes;
+    long long totalReadFromTime = 0;
+
+    for (size_t i=0; i<timestamps.size(); i+=100)
+    {
+        int64_t ts = timestamps[i];
+        auto start = std::chrono::high_resolution_clock::now();
+        reader.readFromTime(ts);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        long long duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        readFromTimes.push_back(duration_ns);
+        totalReadFromTime += duration_ns;
+    }
+
+    if (readFromTimes.empty()) return;
+
+    std::sort(readFromTimes.begin(), readFromTimes.end());
+    long long p99 = readFromTimes[readFromTimes.size() * 99 / 100];
+    long long p95 = readFromTimes[readFromTimes.size() * 95 / 100];
+    long long p50 = readFromTimes[readFromTimes.size() / 2];
+
+    std::cout << "Average read from time (" << label << "): " << static_cast<double>(totalReadFromTime / readFromTimes.size())/1000 << " us\n";
+    std::cout << "p50 read from time (" << label << "): " << static_cast<double>(p50)/1000 << " us\n";
+    std::cout << "p95 read from time (" << label << "): " << static_cast<double>(p95)/1000 << " us\n";
+    std::cout << "p99 read from time (" << label << "): " << static_cast<double>(p99)/1000 << " us\n";
+}
+
+void TSDBCLI::benchmarkScans(const std::string& db) const
+{
+    std::vector<Record> records = Storage(db).readAll();
+    if (records.empty()) return;
+
+    struct Layout
+    {
+        std::string label;
+        std::string filename;
+        uint8_t formatVersion;
+        bool compressBlocks;
+        ChecksumGranularity checksumGranularity;
+        IoBackend ioBackend;
+    };
+    const std::vector<Layout> layouts = {
+        {"rows", db, 1, false, ChecksumGranularity::PerRecord, IoBackend::Blocking},
+        {"rows, io_uring", db, 1, false, ChecksumGranularity::PerRecord, IoBackend::IoUring},
+        {"raw blocks", "performance_raw.tsdb", 2, false, ChecksumGranularity::PerRecord, IoBackend::Blocking},
+        {"block checksummed blocks", "performance_blockcrc.tsdb", 2, false, ChecksumGranularity::PerBlock, IoBackend::Blocking},
+        {"compressed blocks", "performance_gorilla.tsdb", 2, true, ChecksumGranularity::PerRecord, IoBackend::Blocking},
+    };
+
+    for (const Layout& layout : layouts)
+    {
+        StorageOptions options;
+        options.formatVersion = layout.formatVersion;
+        options.compressBlocks = layout.compressBlocks;
+        options.checksumGranularity = layout.checksumGranularity;
+        options.ioBackend = layout.ioBackend;
+
+        if (layout.filename != db)
+        {
+            Storage::removeFiles(layout.filename);
+            Storage writer(layout.filename, options);
+            for (const Record& r : records)
+            {
+                writer.append(r);
+            }
+        }
+
+        Storage reader(layout.filename, options);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t scanned = reader.readAll().size();
+        auto end = std::chrono::high_resolution_clock::now();
+        long long fullScan = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        //100 windows of 10k timestamps spread over the whole series
+        start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < 100; ++i)
+        {
+            int64_t from = records[i * records.size() / 100].timestamp;
+            reader.readRange(from, from + 10'000);
+        }
+        end = std::chrono::high_resolution_clock::now();
+        long long rangeScans = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        std::cout << "File size (" << layout.label << "): " << std::filesystem::file_size(layout.filename) << " bytes\n";
+        std::cout << "Full scan of " << scanned << " records (" << layout.label << "): " << fullScan << " us\n";
+        std::cout << "100 range scans (" << layout.label << "): " << rangeScans << " us\n";
+
+        if (layout.filename != db)
+        {
+            Storage::removeFiles(layout.filename);
+        }
+    }
+}
+
+void TSDBCLI::benchmarkChecksums(const std::string& db) const
+{
+    std::vector<Record> records = Storage(db).readAll();
+    if (records.empty()) return;
+
+    std::vector<uint32_t> crcs(records.size());
+    const std::vector<std::pair<std::string, ChecksumAlgorithm>> algorithms = {
+        {"zlib", ChecksumAlgorithm::Zlib},
+        {crc32cHardwareAvailable() ? "crc32c sse4.2" : "crc32c table", ChecksumAlgorithm::Crc32c},
+    };
+
+    for (const auto& [label, algorithm] : algorithms)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const Record& r : records)
+        {
+            crcs[0] ^= recordChecksum(r, algorithm);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        long long single = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        recordChecksums(records.data(), records.size(), algorithm, crcs.data());
+        end = std::chrono::high_resolution_clock::now();
+        long long batch = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        std::cout << "Per record checksum (" << label << "): " << static_cast<double>(single) / records.size() << " ns\n";
+        std::cout << "Batch checksum (" << label << "): " << static_cast<double>(batch) / records.size() << " ns\n";
+    }
+}
+
+void TSDBCLI::benchmarkAggregates(const std::string& db) const
+{
+    Storage reader(db);
+    if (reader.getRecordCount() == 0) return;
+
+    //100 windows of 1m timestamps, each spanning most of one producer's records
+    long long foldTime = 0;
+    long long pushdownTime = 0;
+    for (int64_t i = 0; i < 100; ++i)
+    {
+        int64_t from = (i % 4) * 1'000'000 + i * 1'000;
+        int64_t to = from + 1'000'000;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        double sum = 0;
+        for (const Record& r : reader.readRange(from, to))
+        {
+            sum += r.value;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        foldTime += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        std::optional<double> pushed = reader.aggregate(from, to, AggregateFunction::Sum);
+        end = std::chrono::high_resolution_clock::now();
+        pushdownTime += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+        if (pushed.value_or(0) != sum && std::abs(pushed.value_or(0) - sum) > 1e-6 * std::abs(sum))
+        {
+            std::cout << "Aggregate mismatch for range " << from << " " << to << "\n";
+        }
+    }
+
+    std::cout << "100 range sums (readRange fold): " << foldTime << " us\n";
+    std::cout << "100 range sums (aggregate): " << pushdownTime << " us\n";
+}
+
+void TSDBCLI::benchmarkDownsample(const std::string& db) const
+{
+    Storage reader(db);
+    if (reader.getRecordCount() == 0) return;
+
+    const int64_t from = 0;
+    const int64_t to = 4'000'000;
+    const int64_t width = 1'000;
+
+    //what a caller does today: pull every record and bucket it by hand
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<DownsampleRow> manual;
+    for (const Record& r : reader.readRange(from, to))
+    {
+        int64_t bucketStart = from + (r.timestamp - from) / width * width;
+        if (manual.empty() || manual.back().bucketStart != bucketStart) manual.push_back({bucketStart, 0});
+        manual.back().value += r.value;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    long long manualTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<DownsampleRow> rows = reader.downsample(from, to, width, AggregateFunction::Sum);
+    end = std::chrono::high_resolution_clock::now();
+    long long kernelTime = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::cout << "Bucketed sums over " << rows.size() << " buckets (readRange fold): " << manualTime << " us\n";
+    std::cout << "Bucketed sums over " << rows.size() << " buckets (downsample): " << kernelTime << " us\n";
+}
+
 bool TSDBCLI::validateCreateCommand(const std::string& command)
 {
     const std::string prefix = "create ";
@@ -380,6 +1175,62 @@ bool TSDBCLI::validateReadRangeCommand(const std::string& command)
     return true;
 }
 
+bool TSDBCLI::validateAggregateCommand(const std::string& command)
+{
+    const std::string prefix = "aggregate ";
+    if (command.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::string remainder = command.substr(prefix.size());
+    if (remainder.empty()) {
+        return false;
+    }
+
+    std::istringstream iss(remainder);
+
+    std::string fn;
+    int64_t number1, number2;
+    std::string extra;
+    if (!(iss >> fn >> number1 >> number2)) {
+        return false;
+    }
+    if (!parseAggregateFunction(fn).has_value()) {
+        return false;
+    }
+    if (iss >> extra) {
+        return false;
+    }
+    return true;
+}
+
+bool TSDBCLI::validateDownsampleCommand(const std::string& command)
+{
+    const std::string prefix = "downsample ";
+    if (command.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::string remainder = command.substr(prefix.size());
+    if (remainder.empty()) {
+        return false;
+    }
+
+    std::istringstream iss(remainder);
+
+    std::string fn;
+    int64_t number1, number2, width;
+    std::string extra;
+    if (!(iss >> fn >> number1 >> number2 >> width)) {
+        return false;
+    }
+    if (!parseAggregateFunction(fn).has_value() || width <= 0) {
+        return false;
+    }
+    if (iss >> extra) {
+        return false;
+    }
+    return true;
+}
+
 bool TSDBCLI::validateReadFromCommand(const std::string& command)
 {
     const std::string prefix = "readfrom ";
@@ -404,6 +1255,26 @@ bool TSDBCLI::validateReadFromCommand(const std::string& command)
     return true;
 }
 
+bool TSDBCLI::validateAppendBatchCommand(const std::string& command)
+{
+    const std::string prefix = "appendbatch ";
+    if (command.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::istringstream iss(command.substr(prefix.size()));
+
+    int64_t timestamp;
+    double value;
+    size_t pairs = 0;
+    while (iss >> timestamp) {
+        if (!(iss >> value)) {
+            return false;
+        }
+        ++pairs;
+    }
+    return iss.eof() && pairs > 0;
+}
+
 bool TSDBCLI::validateAppendCommand(const std::string& command)
 {
     const std::string prefix = "append ";
@@ -428,4 +1299,66 @@ bool TSDBCLI::validateAppendCommand(const std::string& command)
         return false;
     }
     return true;
-}
\ No newline at end of file
+}
+bool TSDBCLI::validateSeriesCommand(const std::string& command)
+{
+    const std::string prefix = "series ";
+    if (command.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::string remainder = command.substr(prefix.size());
+    if (remainder.empty()) {
+        return false;
+    }
+    for (char c: remainder) {
+        if (!(int(c) >= 48 && int(c) <= 57) && !(int(c) >= 65 && int(c) <= 90) && !(int(c) >= 97 && int(c) <= 122)){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TSDBCLI::validateSeriesAppendCommand(const std::string& command)
+{
+    const std::string prefix = "sappend ";
+    if (command.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::istringstream iss(command.substr(prefix.size()));
+
+    std::string name;
+    int64_t timestamp;
+    double value;
+
+    std::string extra;
+    if (!(iss >> name >> timestamp >> value)) {
+        return false;
+    }
+    if (name.size() > maxSeriesNameLength) {
+        return false;
+    }
+    if (iss >> extra) {
+        return false;
+    }
+    return true;
+}
+
+bool TSDBCLI::validateSeriesReadRangeCommand(const std::string& command)
+{
+    const std::string prefix = "sreadrange ";
+    if (command.rfind(prefix, 0) != 0) {
+        return false;
+    }
+    std::istringstream iss(command.substr(prefix.size()));
+
+    std::string name;
+    int64_t number1, number2;
+    std::string extra;
+    if (!(iss >> name >> number1 >> number2)) {
+        return false;
+    }
+    if (iss >> extra) {
+        return false;
+    }
+    return true;
+}
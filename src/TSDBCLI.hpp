@@ -1,5 +1,6 @@
 #pragma once
 #include "Storage.hpp"
+#include "SeriesEngine.hpp"
 
 class TSDBCLI
 {
@@ -12,8 +13,27 @@ public:
     bool validateReadRangeCommand(const std::string& command);
     bool validateReadFromCommand(const std::string& command);
     bool validateAppendCommand(const std::string& command);
+    bool validateAppendBatchCommand(const std::string& command);
+    bool validateAggregateCommand(const std::string& command);
+    bool validateDownsampleCommand(const std::string& command);
+    bool validateSeriesCommand(const std::string& command);
+    bool validateSeriesAppendCommand(const std::string& command);
+    bool validateSeriesReadRangeCommand(const std::string& command);
     void handleCommand(const std::string& command);
 
 private:
     std::unique_ptr<Storage> storage;
+    std::unique_ptr<SeriesEngine> engine;
+
+    void benchmarkReads(const std::string& db, ReadMode mode, const std::string& label, const std::vector<int64_t>& timestamps, size_t learnedIndexError = 0) const;
+    void benchmarkScans(const std::string& db) const;
+    void benchmarkChecksums(const std::string& db) const;
+    void benchmarkIndexLookups() const;
+    void benchmarkIngest() const;
+    void benchmarkDurability() const;
+    void benchmarkSeries() const;
+    void benchmarkSegments() const;
+    void benchmarkOpen(const std::string& db) const;
+    void benchmarkAggregates(const std::string& db) const;
+    void benchmarkDownsample(const std::string& db) const;
 };
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include "SegmentFiles.hpp"
+
+//write-ahead log of fixed size entries, shared by both engines. a flush appends what it takes and syncs
+//the log instead of the data files; a checkpoint empties it once the data files hold its entries durably.
+//the log is the only copy of what it holds until then, so on open it is cut back to the entries its
+//owner accepts, which end at the first one a crash mid-write left torn
+template <typename T>
+class WriteAheadLog
+{
+    static_assert(std::is_trivially_copyable_v<T>, "log entries are written as raw bytes");
+
+public:
+    explicit WriteAheadLog(const std::string& filename) : filename(filename)
+    {
+        fd = ::open(filename.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open write-ahead log: " + filename);
+        }
+    }
+
+    ~WriteAheadLog()
+    {
+        if (fd >= 0) ::close(fd);
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    //validPrefix returns how many of the entries to keep; the rest are cut off
+    template <typename ValidPrefix>
+    std::vector<T> recover(ValidPrefix validPrefix)
+    {
+        off_t size = ::lseek(fd, 0, SEEK_END);
+        std::vector<T> entries(static_cast<size_t>(size) / sizeof(T));
+        size_t bytes = entries.size() * sizeof(T);
+        if (bytes > 0 && ::pread(fd, entries.data(), bytes, 0) != static_cast<ssize_t>(bytes)) {
+            throw std::runtime_error("Failed to read write-ahead log: " + filename);
+        }
+
+        size_t valid = validPrefix(static_cast<const std::vector<T>&>(entries));
+        if (static_cast<off_t>(valid * sizeof(T)) != size && ::ftruncate(fd, static_cast<off_t>(valid * sizeof(T))) != 0) {
+            throw std::runtime_error("Failed to truncate write-ahead log: " + filename);
+        }
+        entries.resize(valid);
+        count = valid;
+        return entries;
+    }
+
+    void append(std::span<const T> entries)
+    {
+        if (!entries.empty()) writeAll(fd, entries.data(), entries.size() * sizeof(T));
+        count += entries.size();
+    }
+
+    //entries written to the descriptor directly, as a flush through io_uring does
+    void appended(size_t entries)
+    {
+        count += entries;
+    }
+
+    void sync(bool dataOnly)
+    {
+        syncFile(fd, dataOnly);
+    }
+
+    void clear()
+    {
+        if (count > 0 && ::ftruncate(fd, 0) != 0) {
+            throw std::runtime_error("Failed to truncate write-ahead log");
+        }
+        count = 0;
+    }
+
+    //entries held, and the offset the next one is written at
+    size_t size() const
+    {
+        return count;
+    }
+
+    uint64_t bytes() const
+    {
+        return count * sizeof(T);
+    }
+
+    int descriptor() const
+    {
+        return fd;
+    }
+
+private:
+    const std::string filename;
+    int fd = -1;
+    size_t count = 0;
+};
@@ -1,7 +1,27 @@
 #include <gtest/gtest.h>
 #include "../src/Storage.hpp"
+#include "../src/Checksum.hpp"
+#include "../src/Kernels.hpp"
+#include "../src/SparseIndex.hpp"
+#include "../src/LearnedIndex.hpp"
+#include "../src/MpscRing.hpp"
+#include "../src/SeriesEngine.hpp"
+#include "../src/IoRing.hpp"
 #include <fstream>
 #include <optional>
+#include <cstring>
+#include <limits>
+#include <filesystem>
+#include <cmath>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 
 TEST(StorageTest, AppendSingleRecord) {
     const char* filename = "testdb.tsdb";
@@ -161,7 +181,7 @@ TEST(StorageTest, ValidHeaderCreation) {
     expectedHeader.magic[2] = 'D';
     expectedHeader.magic[3] = 'B';
     expectedHeader.version = 1;
-    expectedHeader.reserved[0] = 0;
+    expectedHeader.reserved[0] = static_cast<uint8_t>(ChecksumAlgorithm::Crc32c);
     expectedHeader.reserved[1] = 0;
     expectedHeader.reserved[2] = 0;
     expectedHeader.recordSize = sizeof(Record);
@@ -203,7 +223,7 @@ TEST(StorageTest, IncompatibleVersionThrows) {
     const char* filename = "testdb.tsdb";
     std::remove(filename);
 
-    TSDBHeader badHeader = {'T', 'S', 'D', 'B', 2, {0,0,0}, static_cast<uint16_t>(sizeof(Record))};
+    TSDBHeader badHeader = {'T', 'S', 'D', 'B', 3, {0,0,0}, static_cast<uint16_t>(sizeof(Record))};
     std::ofstream outFile(filename, std::ios::binary | std::ios::app);
     outFile.write(reinterpret_cast<const char*>(&badHeader), sizeof(TSDBHeader));
     outFile.close();
@@ -1051,4 +1071,2508 @@ TEST(StorageTest, ReadFromTimeStampNoResult) {
     std::optional<Record> actual = s.readFromTime(1100);
 
     ASSERT_FALSE(actual.has_value());
-}
\ No newline at end of file
+}
+TEST(StorageTest, MmapReadRangeView) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.readMode = ReadMode::Mmap;
+    Storage s(filename, options);
+
+    Record r1 {1000, 40.0};
+    Record r2 {1100, 41.0};
+    Record r3 {1200, 42.0};
+    Record r4 {1300, 43.0};
+    Record r5 {1400, 44.0};
+
+    s.append(r1);
+    s.append(r2);
+    s.append(r3);
+    s.append(r4);
+    s.append(r5);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    RecordView view = s.readRangeView(1050, 1300);
+    ASSERT_EQ(view.size(), 3);
+    for (int i=0; i<3; ++i) {
+        EXPECT_EQ(view[i].timestamp, 1100 + i*100);
+        EXPECT_EQ(view[i].value, 41.0 + i);
+    }
+
+    ASSERT_TRUE(s.readRangeView(1500, 1600).empty());
+    ASSERT_EQ(s.readRangeView(900, 1000).size(), 1);
+    ASSERT_EQ(s.readAll().size(), 5);
+    ASSERT_EQ(s.getLastRecord()->timestamp, 1400);
+    ASSERT_EQ(s.getRecord(2).value, 42.0);
+}
+
+TEST(StorageTest, MmapMappingGrowsWithFlushes) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.readMode = ReadMode::Mmap;
+    options.sparseIndexStep = 64;
+    Storage s(filename, options);
+
+    const int total = 100'000;
+    for (int i = 0; i < total; ++i) {
+        s.append(Record{i, static_cast<double>(i)});
+        if (i % 20'000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    ASSERT_EQ(s.getRecordCount(), total);
+
+    RecordView view = s.readRangeView(90'000, 99'999);
+    ASSERT_EQ(view.size(), 10'000);
+    EXPECT_EQ(view.front().timestamp, 90'000);
+    EXPECT_EQ(view.back().value, 99'999.0);
+
+    Storage s2(filename, options);
+    ASSERT_EQ(s2.readRange(0, total).size(), total);
+}
+
+TEST(StorageTest, ReadRangeViewRequiresMmap) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    Storage s(filename);
+
+    try {
+        s.readRangeView(0, 10);
+        FAIL() << "Expected std::runtime_error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Zero-copy reads require mmap read mode");
+    } catch (...) {
+        FAIL() << "Expected std::runtime_error";
+    }
+}
+
+TEST(StorageTest, ReadRecordsIntoCallerBuffer) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    Storage s(filename);
+    ASSERT_EQ(s.getReadMode(), ReadMode::Pread);
+
+    for (int i = 0; i < 10; ++i) {
+        s.append(Record{1000 + i * 100, 40.0 + i});
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<Record> buffer(4);
+    ASSERT_EQ(s.readRecords(3, buffer), 4);
+    EXPECT_EQ(buffer[0].timestamp, 1300);
+    EXPECT_EQ(buffer[3].value, 46.0);
+
+    ASSERT_EQ(s.readRecords(8, buffer), 2);
+    EXPECT_EQ(buffer[1].timestamp, 1900);
+    ASSERT_EQ(s.readRecords(10, buffer), 0);
+}
+
+TEST(StorageTest, ConcurrentPreadReaders) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    Storage s(filename, 16);
+
+    const int total = 2000;
+    for (int i = 0; i < total; ++i) {
+        s.append(Record{i, static_cast<double>(i)});
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<std::thread> readers;
+    std::atomic<int> mismatches{0};
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&, t]() {
+            for (int i = t; i < total; i += 7) {
+                std::optional<Record> r = s.readFromTime(i);
+                if (!r.has_value() || r->value != static_cast<double>(i)) ++mismatches;
+            }
+        });
+    }
+    for (auto& t : readers) {
+        t.join();
+    }
+
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST(StorageTest, StreamReadModeMatchesPread) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    {
+        Storage s(filename, 4);
+        for (int i = 0; i < 10; ++i) {
+            s.append(Record{1000 + i * 100, 40.0 + i});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    StorageOptions options;
+    options.sparseIndexStep = 4;
+    options.readMode = ReadMode::Stream;
+    Storage s(filename, options);
+
+    ASSERT_EQ(s.readAll().size(), 10);
+    ASSERT_EQ(s.readRange(1250, 1650).size(), 4);
+    ASSERT_EQ(s.getRecord(9).timestamp, 1900);
+    ASSERT_EQ(s.getSparseIndex().size(), 3);
+}
+
+TEST(StorageTest, ColumnarFormatHeader) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 4;
+    Storage s(filename, options);
+
+    EXPECT_EQ(s.getHeader().version, 2);
+    EXPECT_EQ(s.getHeader().recordSize, columnarRecordSize);
+
+    std::ifstream inFile(filename, std::ios::binary);
+    TSDBHeader header = Storage::validateAndReadHeader(inFile, filename);
+    EXPECT_EQ(header.version, 2);
+}
+
+TEST(StorageTest, ColumnarReadsMatchRowLayout) {
+    const char* rowFile = "testdb.tsdb";
+    const char* columnFile = "columnardb.tsdb";
+    std::remove(rowFile);
+    std::remove(columnFile);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 4;
+
+    Storage rows(rowFile, 4);
+    Storage columns(columnFile, options);
+
+    for (int i = 0; i < 10; ++i) {
+        Record r {1000 + i * 100, 40.0 + i};
+        rows.append(r);
+        columns.append(r);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    ASSERT_EQ(columns.getRecordCount(), 10);
+    ASSERT_EQ(columns.getLastTimestamp(), 1900);
+
+    std::vector<Record> expected = rows.readAll();
+    std::vector<Record> actual = columns.readAll();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(actual[i].timestamp, expected[i].timestamp);
+        EXPECT_EQ(actual[i].value, expected[i].value);
+    }
+
+    for (int64_t start : {900, 1000, 1150, 1300, 1700, 1900, 2000}) {
+        for (int64_t end : {1000, 1250, 1400, 1800, 2500}) {
+            if (start > end) continue;
+            std::vector<Record> a = rows.readRange(start, end);
+            std::vector<Record> b = columns.readRange(start, end);
+            ASSERT_EQ(a.size(), b.size()) << start << " " << end;
+            for (size_t i = 0; i < a.size(); ++i) {
+                EXPECT_EQ(a[i].timestamp, b[i].timestamp);
+            }
+        }
+    }
+
+    EXPECT_EQ(columns.getRecord(5).value, 45.0);
+    EXPECT_EQ(columns.getRecord(9).value, 49.0);
+    EXPECT_EQ(columns.getLastRecord()->timestamp, 1900);
+    EXPECT_EQ(columns.getSparseIndex().size(), rows.getSparseIndex().size());
+
+    std::vector<Record> buffer(6);
+    ASSERT_EQ(columns.readRecords(2, buffer), 6);
+    EXPECT_EQ(buffer[0].timestamp, 1200);
+    EXPECT_EQ(buffer[5].timestamp, 1700);
+}
+
+TEST(StorageTest, ColumnarRestartAndTornBlockRecovery) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 4;
+
+    {
+        Storage s(filename, options);
+        for (int i = 0; i < 10; ++i) {
+            s.append(Record{1000 + i * 100, 40.0 + i});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    //a half written block at the end of the data file must be discarded on open
+    {
+        std::ofstream outFile(filename, std::ios::binary | std::ios::app);
+        std::vector<char> garbage(30, 'x');
+        outFile.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    }
+
+    //reopening with a different step keeps the block capacity stored in the file
+    Storage s2(filename, 16);
+    EXPECT_EQ(s2.getSparseIndexStep(), 4);
+    EXPECT_EQ(s2.getRecordCount(), 10);
+    EXPECT_EQ(s2.getLastTimestamp(), 1900);
+    ASSERT_EQ(s2.readAll().size(), 10);
+
+    EXPECT_FALSE(s2.append(Record{1900, 0.0}));
+    EXPECT_TRUE(s2.append(Record{2000, 50.0}));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<Record> records = s2.readRange(1800, 2000);
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[2].value, 50.0);
+}
+
+TEST(StorageTest, ColumnarDeferredSealRecoversFromHead) {
+    const char* filename = "testdb.tsdb";
+    const char* crashed = "columnardb.tsdb";
+    std::string head = std::string(filename) + ".head";
+    std::remove(filename);
+    std::remove(crashed);
+    std::remove((std::string(crashed) + ".head").c_str());
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 4;
+    options.durability = DurabilityMode::Periodic;
+    options.syncInterval = std::chrono::hours(1);
+    {
+        Storage s(filename, options);
+        s.append(Record{0, 0.0});
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::filesystem::copy_file(filename, crashed);
+
+        //sealing leaves the records in the head file until a sync makes the blocks durable
+        for (int i = 1; i < 10; ++i) {
+            s.append(Record{i * 100, static_cast<double>(i)});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_EQ(std::filesystem::file_size(head), 10 * sizeof(Record));
+
+        //a crash that loses both blocks leaves every record in the head
+        std::filesystem::copy_file(head, std::string(crashed) + ".head");
+    }
+
+    //closing syncs, which trims the head to what no block holds
+    EXPECT_EQ(std::filesystem::file_size(head), 2 * sizeof(Record));
+
+    for (const char* name : {filename, crashed}) {
+        Storage s(name, options);
+        ASSERT_EQ(s.getRecordCount(), 10) << name;
+        EXPECT_EQ(s.readRange(100, 900).size(), 9);
+        EXPECT_EQ(s.getLastTimestamp(), 900);
+    }
+    std::remove(crashed);
+    std::remove((std::string(crashed) + ".head").c_str());
+}
+
+TEST(StorageTest, ColumnarMmapReads) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 8;
+    options.readMode = ReadMode::Mmap;
+    Storage s(filename, options);
+
+    for (int i = 0; i < 100; ++i) {
+        s.append(Record{i, static_cast<double>(i)});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    ASSERT_EQ(s.readRange(10, 89).size(), 80);
+    EXPECT_EQ(s.getRecord(50).value, 50.0);
+    EXPECT_THROW(s.readRangeView(0, 10), std::runtime_error);
+}
+
+TEST(StorageTest, CompressedBlocksRoundTripEdgeValues) {
+    const char* compressedFile = "testdb.tsdb";
+    const char* rawFile = "columnardb.tsdb";
+    std::remove(compressedFile);
+    std::remove(rawFile);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 16;
+    Storage compressed(compressedFile, options);
+    options.compressBlocks = false;
+    Storage raw(rawFile, options);
+
+    //irregular gaps and awkward doubles exercise every timestamp bucket and value window
+    std::vector<double> values = {0.0, -0.0, 1.5, 1.5, std::numeric_limits<double>::quiet_NaN(),
+                                  std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min(),
+                                  -1e300, 3.141592653589793, 42.0};
+    int64_t ts = std::numeric_limits<int64_t>::min() / 2;
+    int64_t gap = 1;
+    for (int i = 0; i < 100; ++i) {
+        ts += gap;
+        gap = (i % 7 == 0) ? gap * 977 % (int64_t{1} << 40) + 1 : gap + 1;
+        Record r {ts, values[i % values.size()] + (i % 3 == 0 ? 0.0 : i * 0.001)};
+        compressed.append(r);
+        raw.append(r);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<Record> expected = raw.readAll();
+    std::vector<Record> actual = compressed.readAll();
+    ASSERT_EQ(actual.size(), 100);
+    ASSERT_EQ(expected.size(), 100);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(actual[i].timestamp, expected[i].timestamp);
+        EXPECT_EQ(std::memcmp(&actual[i].value, &expected[i].value, sizeof(double)), 0) << i;
+    }
+
+    std::vector<Record> a = raw.readRange(expected[20].timestamp, expected[70].timestamp);
+    std::vector<Record> b = compressed.readRange(expected[20].timestamp, expected[70].timestamp);
+    ASSERT_EQ(b.size(), 51);
+    ASSERT_EQ(a.size(), b.size());
+    EXPECT_EQ(b.front().timestamp, a.front().timestamp);
+    EXPECT_EQ(b.back().timestamp, a.back().timestamp);
+    EXPECT_EQ(compressed.getRecord(33).timestamp, expected[33].timestamp);
+}
+
+TEST(StorageTest, CompressedBlocksShrinkRegularSeries) {
+    const char* rowFile = "testdb.tsdb";
+    const char* columnFile = "columnardb.tsdb";
+    std::remove(rowFile);
+    std::remove(columnFile);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 1024;
+
+    {
+        Storage rows(rowFile, 1024);
+        Storage columns(columnFile, options);
+        for (int i = 0; i < 16384; ++i) {
+            Record r {1700000000000 + i * 1000, 20.0 + (i / 256) * 0.5};
+            rows.append(r);
+            columns.append(r);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::ifstream rowIn(rowFile, std::ios::binary | std::ios::ate);
+    std::ifstream columnIn(columnFile, std::ios::binary | std::ios::ate);
+    EXPECT_LT(columnIn.tellg() * 10, rowIn.tellg());
+
+    Storage columns(columnFile, options);
+    EXPECT_EQ(columns.getRecordCount(), 16384);
+    std::vector<Record> records = columns.readRange(1700000000000 + 5000 * 1000, 1700000000000 + 5999 * 1000);
+    ASSERT_EQ(records.size(), 1000);
+    EXPECT_EQ(records.front().value, 20.0 + (5000 / 256) * 0.5);
+}
+
+TEST(StorageTest, CorruptedCompressedBlockThrows) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 4;
+
+    {
+        Storage s(filename, options);
+        for (int i = 0; i < 8; ++i) {
+            s.append(Record{1000 + i * 100, 40.0 + i * 0.25});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    //flip a byte inside the first block's payload; recovery only checks the last block
+    {
+        std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(sizeof(TSDBHeader) + 8 + 32 + 12);
+        char byte = 0x5a;
+        file.write(&byte, 1);
+    }
+
+    Storage s(filename, options);
+    EXPECT_EQ(s.getRecordCount(), 8);
+    EXPECT_THROW(s.readAll(), std::runtime_error);
+    EXPECT_THROW(s.readRange(1000, 1200), std::runtime_error);
+    EXPECT_EQ(s.readRange(1400, 1700).size(), 4);
+}
+
+TEST(StorageTest, Crc32cMatchesReference) {
+    const char* check = "123456789";
+    EXPECT_EQ(crc32c(check, 9), 0xE3069283u);
+
+    //bitwise reference over every length and alignment the sliced and hardware paths handle
+    std::vector<uint8_t> data(67);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 37 + 11);
+    for (size_t offset = 0; offset < 8; ++offset) {
+        for (size_t length = 0; offset + length <= data.size(); ++length) {
+            uint32_t crc = ~0u;
+            for (size_t i = 0; i < length; ++i) {
+                crc ^= data[offset + i];
+                for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+            }
+            ASSERT_EQ(crc32c(data.data() + offset, length), ~crc) << offset << " " << length;
+        }
+    }
+
+    Record r {1234, 5.5};
+    EXPECT_EQ(recordChecksum(r, ChecksumAlgorithm::Crc32c), crc32c(&r, 16));
+}
+
+TEST(StorageTest, BatchVerificationFindsCorruptRecord) {
+    std::vector<Record> records(1000);
+    for (size_t i = 0; i < records.size(); ++i) {
+        records[i] = Record{static_cast<int64_t>(i), i * 0.5};
+    }
+
+    for (ChecksumAlgorithm algorithm : {ChecksumAlgorithm::Zlib, ChecksumAlgorithm::Crc32c}) {
+        fillRecordChecksums(records.data(), records.size(), algorithm);
+        EXPECT_EQ(verifyRecords(records.data(), records.size(), algorithm), records.size());
+        EXPECT_EQ(static_cast<uint32_t>(records[700].crc), recordChecksum(records[700], algorithm));
+
+        records[700].value = -1.0;
+        EXPECT_EQ(verifyRecords(records.data(), records.size(), algorithm), 700);
+        records[700].value = 350.0;
+    }
+}
+
+TEST(StorageTest, ZlibChecksumFilesStillOpen) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.checksumAlgorithm = ChecksumAlgorithm::Zlib;
+    {
+        Storage s(filename, options);
+        s.append(Record{1000, 42.0});
+        s.append(Record{1100, 43.5});
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    //the algorithm in the header wins over the one requested for new files
+    Storage s2(filename);
+    EXPECT_EQ(s2.getHeader().reserved[0], 0);
+    EXPECT_EQ(s2.getChecksumAlgorithm(), ChecksumAlgorithm::Zlib);
+    ASSERT_EQ(s2.readAll().size(), 2);
+    EXPECT_EQ(s2.readAll()[1].value, 43.5);
+
+    EXPECT_TRUE(s2.append(Record{1200, 44.0}));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQ(s2.readRange(1000, 1200).size(), 3);
+}
+
+TEST(StorageTest, UnknownChecksumAlgorithmThrows) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    TSDBHeader badHeader = {'T', 'S', 'D', 'B', 1, {7,0,0}, static_cast<uint16_t>(sizeof(Record))};
+    std::ofstream outFile(filename, std::ios::binary | std::ios::app);
+    outFile.write(reinterpret_cast<const char*>(&badHeader), sizeof(TSDBHeader));
+    outFile.close();
+    std::ifstream inFile(filename, std::ios::binary);
+
+    try {
+        Storage::validateAndReadHeader(inFile, filename);
+        FAIL() << "Expected std::runtime_error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Unsupported checksum algorithm: testdb.tsdb");
+    } catch (...) {
+        FAIL() << "Expected std::runtime_error";
+    }
+
+    //the CLI tests reopen testdb.tsdb, so do not leave an unreadable file behind
+    std::remove(filename);
+}
+
+TEST(StorageTest, BlockChecksumsShrinkFiles) {
+    const char* rowFile = "testdb.tsdb";
+    const char* columnFile = "columnardb.tsdb";
+    std::remove(rowFile);
+    std::remove(columnFile);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.compressBlocks = false;
+    options.checksumGranularity = ChecksumGranularity::PerBlock;
+
+    {
+        Storage rows(rowFile, 1024);
+        Storage columns(columnFile, options);
+        for (int i = 0; i < 4096; ++i) {
+            Record r {1000 + i * 7, i * 0.25};
+            rows.append(r);
+            columns.append(r);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    //16 byte rows against 24 byte rows, plus a few bytes of header per block
+    std::ifstream rowIn(rowFile, std::ios::binary | std::ios::ate);
+    std::ifstream columnIn(columnFile, std::ios::binary | std::ios::ate);
+    EXPECT_LT(columnIn.tellg() * 10, rowIn.tellg() * 7);
+
+    Storage rows(rowFile);
+    Storage columns(columnFile, options);
+    EXPECT_EQ(columns.getHeader().reserved[1], static_cast<uint8_t>(ChecksumGranularity::PerBlock));
+    std::vector<Record> expected = rows.readAll();
+    std::vector<Record> actual = columns.readAll();
+    ASSERT_EQ(actual.size(), 4096);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(actual[i].timestamp, expected[i].timestamp);
+        EXPECT_EQ(actual[i].value, expected[i].value);
+    }
+    ASSERT_EQ(columns.readRange(1000 + 1000 * 7, 1000 + 3000 * 7).size(), 2001);
+    EXPECT_EQ(columns.getRecord(2049).value, 2049 * 0.25);
+}
+
+TEST(StorageTest, BlockChecksumRecoveryTruncatesToLastValidBlock) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 4;
+    options.compressBlocks = false;
+    options.checksumGranularity = ChecksumGranularity::PerBlock;
+
+    {
+        Storage s(filename, options);
+        for (int i = 0; i < 12; ++i) {
+            s.append(Record{1000 + i * 100, 40.0 + i});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    //each block is a 32 byte header, an 8 byte payload header and 4 rows of 16 bytes
+    const std::streamoff dataStart = sizeof(TSDBHeader) + 8;
+    const std::streamoff blockBytes = 32 + 8 + 4 * 16;
+    {
+        std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(dataStart + 2 * blockBytes + 32 + 8 + 20);
+        char byte = 0x5a;
+        file.write(&byte, 1);
+    }
+
+    {
+        Storage s(filename, options);
+        EXPECT_EQ(s.getRecordCount(), 8);
+        EXPECT_EQ(s.getLastTimestamp(), 1700);
+        ASSERT_EQ(s.readAll().size(), 8);
+    }
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    EXPECT_EQ(in.tellg(), dataStart + 2 * blockBytes);
+    in.close();
+
+    //damage before the tail is not recoverable and surfaces on read
+    {
+        std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(dataStart + 32 + 8 + 20);
+        char byte = 0x5a;
+        file.write(&byte, 1);
+    }
+    Storage s(filename, options);
+    EXPECT_EQ(s.getRecordCount(), 8);
+    EXPECT_THROW(s.readAll(), std::runtime_error);
+    EXPECT_THROW(s.readRange(1000, 1100), std::runtime_error);
+    EXPECT_EQ(s.readRange(1400, 1700).size(), 4);
+}
+
+TEST(StorageTest, BlockChecksumsRequireBlockLayout) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.checksumGranularity = ChecksumGranularity::PerBlock;
+    EXPECT_THROW(Storage(filename, options), std::runtime_error);
+}
+
+TEST(StorageTest, CursorStreamsRangeInChunks) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    Storage s(filename, 64);
+    for (int i = 0; i < 5000; ++i) {
+        s.append(Record{1000 + i * 10, i * 0.5});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (auto [start, end] : std::vector<std::pair<int64_t, int64_t>>{{0, 100000}, {1005, 1005}, {2345, 31000}, {50990, 60000}}) {
+        std::vector<Record> expected = s.readRange(start, end);
+        std::vector<Record> streamed;
+        RangeCursor cursor = s.cursor(start, end, 100);
+        for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next()) {
+            EXPECT_LE(chunk.size(), 100);
+            streamed.insert(streamed.end(), chunk.begin(), chunk.end());
+        }
+        EXPECT_TRUE(cursor.done());
+        ASSERT_EQ(streamed.size(), expected.size()) << start << " " << end;
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(streamed[i].timestamp, expected[i].timestamp);
+        }
+    }
+
+    //stopping early simply means not asking for more
+    RangeCursor cursor = s.cursor(1000, 50990, 256);
+    EXPECT_EQ(cursor.next().size(), 256);
+    EXPECT_FALSE(cursor.done());
+
+    EXPECT_THROW(s.cursor(10, 5), std::runtime_error);
+    EXPECT_THROW(s.cursor(0, 5, 0), std::runtime_error);
+}
+
+TEST(StorageTest, CursorVerifiesChecksumsIncrementally) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    {
+        Storage s(filename, 64);
+        for (int i = 0; i < 1000; ++i) {
+            s.append(Record{1000 + i, static_cast<double>(i)});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    //corrupt the value of record 550
+    {
+        std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(sizeof(TSDBHeader) + 550 * sizeof(Record) + 8);
+        char byte = 0x5a;
+        file.write(&byte, 1);
+    }
+
+    Storage s(filename, 64);
+    RangeCursor cursor = s.cursor(1000, 1999, 100);
+    size_t seen = 0;
+    for (int chunk = 0; chunk < 5; ++chunk) {
+        seen += cursor.next().size();
+    }
+    EXPECT_EQ(seen, 500);
+    EXPECT_THROW(cursor.next(), std::runtime_error);
+}
+
+TEST(StorageTest, CursorOverColumnarBlocks) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 32;
+    Storage s(filename, options);
+    for (int i = 0; i < 1000; ++i) {
+        s.append(Record{i, static_cast<double>(i)});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    size_t total = 0;
+    int64_t expected = 100;
+    RangeCursor cursor = s.cursor(100, 899, 50);
+    for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next()) {
+        for (const Record& r : chunk) {
+            EXPECT_EQ(r.timestamp, expected++);
+        }
+        total += chunk.size();
+    }
+    EXPECT_EQ(total, 800);
+}
+
+TEST(StorageTest, AggregateMatchesRecordFold) {
+    const char* rowFile = "testdb.tsdb";
+    const char* columnFile = "columnardb.tsdb";
+    std::remove(rowFile);
+    std::remove(columnFile);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 16;
+
+    Storage rows(rowFile, 16);
+    Storage columns(columnFile, options);
+    for (int i = 0; i < 1000; ++i) {
+        Record r {1000 + i * 10, ((i * 37) % 101) - 50.0};
+        rows.append(r);
+        columns.append(r);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (auto [start, end] : std::vector<std::pair<int64_t, int64_t>>{{0, 100000}, {1005, 1155}, {1160, 1319}, {3333, 7777}, {10985, 20000}, {20000, 30000}}) {
+        std::vector<Record> records = rows.readRange(start, end);
+        for (Storage* s : {&rows, &columns}) {
+            BlockSummary summary = s->summarize(start, end);
+            ASSERT_EQ(summary.count, records.size()) << start << " " << end;
+            EXPECT_EQ(*s->aggregate(start, end, AggregateFunction::Count), static_cast<double>(records.size()));
+            if (records.empty()) {
+                EXPECT_FALSE(s->aggregate(start, end, AggregateFunction::Avg).has_value());
+                continue;
+            }
+
+            double sum = 0;
+            double min = records[0].value;
+            double max = records[0].value;
+            for (const Record& r : records) {
+                sum += r.value;
+                min = std::min(min, r.value);
+                max = std::max(max, r.value);
+            }
+            EXPECT_DOUBLE_EQ(*s->aggregate(start, end, AggregateFunction::Sum), sum);
+            EXPECT_EQ(*s->aggregate(start, end, AggregateFunction::Min), min);
+            EXPECT_EQ(*s->aggregate(start, end, AggregateFunction::Max), max);
+            EXPECT_DOUBLE_EQ(*s->aggregate(start, end, AggregateFunction::Avg), sum / records.size());
+            EXPECT_EQ(*s->aggregate(start, end, AggregateFunction::First), records.front().value);
+            EXPECT_EQ(*s->aggregate(start, end, AggregateFunction::Last), records.back().value);
+        }
+    }
+}
+
+TEST(StorageTest, SummariesPersistAndRebuild) {
+    const char* filename = "testdb.tsdb";
+    const std::string summaryFilename = std::string(filename) + ".sum";
+    std::remove(filename);
+
+    {
+        Storage s(filename, 8);
+        for (int i = 0; i < 100; ++i) {
+            s.append(Record{i, static_cast<double>(i)});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    //only complete intervals are persisted
+    EXPECT_EQ(std::filesystem::file_size(summaryFilename), 12 * sizeof(BlockSummary));
+
+    {
+        Storage s(filename, 8);
+        EXPECT_EQ(*s.aggregate(0, 99, AggregateFunction::Sum), 4950.0);
+    }
+
+    //a damaged sidecar is rebuilt from the records
+    {
+        std::fstream file(summaryFilename, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(5 * sizeof(BlockSummary));
+        std::vector<char> garbage(sizeof(BlockSummary) + 3, 'x');
+        file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    }
+    Storage s(filename, 8);
+    EXPECT_EQ(*s.aggregate(0, 99, AggregateFunction::Sum), 4950.0);
+    EXPECT_EQ(*s.aggregate(40, 47, AggregateFunction::Max), 47.0);
+    EXPECT_EQ(std::filesystem::file_size(summaryFilename), 12 * sizeof(BlockSummary));
+
+    //a new database of the same name does not inherit the old summaries
+    std::remove(filename);
+    Storage fresh(filename, 8);
+    EXPECT_EQ(*fresh.aggregate(0, 99, AggregateFunction::Count), 0.0);
+    EXPECT_FALSE(std::filesystem::exists(summaryFilename) && std::filesystem::file_size(summaryFilename) > 0);
+}
+
+TEST(StorageTest, SimdKernelMatchesScalar) {
+    std::vector<double> values(1027);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = std::sin(static_cast<double>(i)) * 1e6 + (i % 7 == 0 ? -0.0 : 0.1 * i);
+    }
+
+    for (size_t count : {1, 2, 3, 4, 5, 8, 63, 64, 1000, 1027}) {
+        ValueStats simd = reduceValues(values.data(), count);
+        ValueStats scalar = reduceValuesScalar(values.data(), count);
+        EXPECT_EQ(std::memcmp(&simd.sum, &scalar.sum, sizeof(double)), 0) << count;
+        EXPECT_EQ(simd.min, scalar.min);
+        EXPECT_EQ(simd.max, scalar.max);
+        EXPECT_EQ(scalar.min, *std::min_element(values.begin(), values.begin() + count));
+        EXPECT_EQ(scalar.max, *std::max_element(values.begin(), values.begin() + count));
+    }
+}
+
+TEST(StorageTest, DownsampleMatchesBucketedFold) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.formatVersion = 2;
+    options.sparseIndexStep = 64;
+    Storage s(filename, options);
+    for (int i = 0; i < 10000; ++i) {
+        s.append(Record{1000 + i * 3 + (i % 5), static_cast<double>((i * 7919) % 1000) / 10.0});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (int64_t width : {1, 7, 100, 4096, 1000000}) {
+        for (auto [start, end] : std::vector<std::pair<int64_t, int64_t>>{{0, 40000}, {1234, 5678}, {29000, 29100}}) {
+            std::vector<Record> records = s.readRange(start, end);
+            std::vector<DownsampleRow> rows = s.downsample(start, end, width, AggregateFunction::Avg);
+            std::vector<DownsampleRow> counts = s.downsample(start, end, width, AggregateFunction::Count);
+            std::vector<DownsampleRow> maxima = s.downsample(start, end, width, AggregateFunction::Max);
+            ASSERT_EQ(rows.size(), counts.size());
+
+            size_t next = 0;
+            for (size_t b = 0; b < rows.size(); ++b) {
+                double sum = 0;
+                double max = records[next].value;
+                size_t n = 0;
+                while (next < records.size() && (records[next].timestamp - start) / width * width + start == rows[b].bucketStart) {
+                    sum += records[next].value;
+                    max = std::max(max, records[next].value);
+                    ++n;
+                    ++next;
+                }
+                ASSERT_GT(n, 0);
+                EXPECT_EQ(counts[b].value, static_cast<double>(n));
+                EXPECT_NEAR(rows[b].value, sum / n, 1e-9);
+                EXPECT_EQ(maxima[b].value, max);
+            }
+            EXPECT_EQ(next, records.size()) << width << " " << start;
+        }
+    }
+
+    EXPECT_TRUE(s.downsample(50000, 60000, 10, AggregateFunction::Sum).empty());
+    EXPECT_THROW(s.downsample(0, 10, 0, AggregateFunction::Sum), std::runtime_error);
+}
+
+TEST(StorageTest, SparseIndexPersistsAndRebuilds) {
+    const char* filename = "testdb.tsdb";
+    const std::string indexFilename = std::string(filename) + ".idx";
+    std::remove(filename);
+
+    std::vector<IndexEntry> expected;
+    {
+        Storage s(filename, 8);
+        for (int i = 0; i < 100; ++i) {
+            s.append(Record{i * 10, static_cast<double>(i)});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        expected = s.getSparseIndex();
+    }
+    ASSERT_EQ(expected.size(), 13);
+    EXPECT_EQ(std::filesystem::file_size(indexFilename), 13 * sizeof(IndexEntry));
+
+    auto expectIndex = [&](const Storage& s, const std::vector<IndexEntry>& want) {
+        const std::vector<IndexEntry>& index = s.getSparseIndex();
+        ASSERT_EQ(index.size(), want.size());
+        for (size_t i = 0; i < index.size(); ++i) {
+            EXPECT_EQ(index[i].timestamp, want[i].timestamp);
+            EXPECT_EQ(index[i].recordIndex, want[i].recordIndex);
+        }
+    };
+
+    {
+        Storage s(filename, 8);
+        expectIndex(s, expected);
+        EXPECT_EQ(s.readFromTime(550)->value, 55.0);
+    }
+
+    //a torn append is completed from the records
+    std::filesystem::resize_file(indexFilename, 7 * sizeof(IndexEntry) + 5);
+    {
+        Storage s(filename, 8);
+        expectIndex(s, expected);
+    }
+    EXPECT_EQ(std::filesystem::file_size(indexFilename), 13 * sizeof(IndexEntry));
+
+    //damaged entries are rebuilt from the first mismatch
+    {
+        std::fstream file(indexFilename, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(5 * sizeof(IndexEntry));
+        std::vector<char> garbage(sizeof(IndexEntry), 'x');
+        file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    }
+    {
+        Storage s(filename, 8);
+        expectIndex(s, expected);
+    }
+    EXPECT_EQ(std::filesystem::file_size(indexFilename), 13 * sizeof(IndexEntry));
+
+    //reopening with another step does not trust the old entries
+    {
+        Storage s(filename, 16);
+        EXPECT_EQ(s.getSparseIndex().size(), 7);
+        EXPECT_EQ(s.getSparseIndex()[3].timestamp, 480);
+        EXPECT_EQ(s.readRange(475, 505).size(), 3);
+    }
+    EXPECT_EQ(std::filesystem::file_size(indexFilename), 7 * sizeof(IndexEntry));
+
+    Storage::removeFiles(filename);
+    EXPECT_FALSE(std::filesystem::exists(indexFilename));
+}
+
+TEST(StorageTest, EytzingerIndexMatchesBinarySearch) {
+    auto expectMatches = [](const SparseIndex& index, int64_t key) {
+        const std::vector<IndexEntry>& entries = index.entries();
+        auto next = std::upper_bound(entries.begin(), entries.end(), key,
+                                     [](int64_t ts, const IndexEntry& e) { return ts < e.timestamp; });
+        std::optional<size_t> found = index.findLast(key);
+        if (next == entries.begin()) {
+            EXPECT_FALSE(found.has_value()) << key;
+        } else {
+            ASSERT_TRUE(found.has_value()) << key;
+            EXPECT_EQ(*found, static_cast<size_t>(next - entries.begin()) - 1) << key;
+        }
+    };
+
+    for (size_t count : {0, 1, 2, 3, 7, 8, 9, 100, 1023, 1024, 5000}) {
+        std::vector<IndexEntry> entries;
+        for (size_t i = 0; i < count; ++i) {
+            //repeated timestamps cover a batch of equal timestamps spanning an interval boundary
+            entries.push_back({static_cast<int64_t>(i / 3 * 3) * 10, i * 8});
+        }
+        SparseIndex index;
+        index.assign(entries);
+        for (int64_t key = -5; key <= static_cast<int64_t>(count) * 10 + 5; key += 3) {
+            expectMatches(index, key);
+        }
+    }
+
+    //appends are searchable straight away, before and after they are folded into the tree
+    SparseIndex index;
+    for (size_t i = 0; i < 3000; ++i) {
+        index.append({static_cast<int64_t>(i) * 10, i * 8});
+        expectMatches(index, static_cast<int64_t>(i) * 10);
+        expectMatches(index, static_cast<int64_t>(i) * 5 - 1);
+    }
+    EXPECT_EQ(index.size(), 3000);
+    EXPECT_EQ(index[2999].recordIndex, 2999 * 8);
+}
+
+TEST(StorageTest, LearnedIndexNeverPassesFirstMatch) {
+    //a regular stretch, a jittery stretch with repeated timestamps, and a large gap
+    std::vector<int64_t> timestamps;
+    for (int i = 0; i < 5000; ++i) timestamps.push_back(i * 10);
+    for (int i = 0; i < 5000; ++i) timestamps.push_back(50000 + i * 7 - (i % 3 == 0 ? 0 : i % 3) + (i / 50) * 3);
+    std::sort(timestamps.begin(), timestamps.end());
+    for (int i = 0; i < 200; ++i) timestamps.push_back(10'000'000);
+    for (int i = 0; i < 3000; ++i) timestamps.push_back(20'000'000 + i);
+
+    LearnedIndex index(4);
+    for (size_t i = 0; i < timestamps.size(); ++i) {
+        index.add(timestamps[i], i);
+
+        //lookups against the segment still being fitted
+        if (i % 997 == 0) {
+            size_t match = std::lower_bound(timestamps.begin(), timestamps.begin() + i + 1, timestamps[i]) - timestamps.begin();
+            EXPECT_LE(*index.lowerBound(timestamps[i]), match);
+        }
+    }
+    EXPECT_LT(index.segmentCount(), 200);
+
+    EXPECT_FALSE(index.lowerBound(-1).has_value());
+    for (int64_t key = 0; key < 20'004'000; key += (key < 100'000 ? 1 : 997)) {
+        size_t match = std::lower_bound(timestamps.begin(), timestamps.end(), key) - timestamps.begin();
+        size_t predicted = *index.lowerBound(key);
+        ASSERT_LE(predicted, match) << key;
+
+        //keys that are present land within the error bound
+        if (match < timestamps.size() && timestamps[match] == key) {
+            EXPECT_LE(match - predicted, 2 * 4 + 2) << key;
+        }
+    }
+}
+
+TEST(StorageTest, LearnedIndexNarrowsRangeReads) {
+    const char* filename = "testdb.tsdb";
+    const std::string learnedFilename = std::string(filename) + ".lrn";
+    std::remove(filename);
+
+    StorageOptions options;
+    options.sparseIndexStep = 64;
+    options.learnedIndexError = 8;
+
+    std::vector<Record> expected;
+    {
+        Storage s(filename, options);
+        for (int i = 0; i < 20000; ++i) {
+            Record r{i * 5 + (i % 4) + (i > 15000 ? 100000 : 0), static_cast<double>(i)};
+            s.append(r);
+            expected.push_back(r);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_LT(s.getLearnedSegmentCount(), s.getSparseIndex().size());
+    }
+
+    auto expectReads = [&](const Storage& s) {
+        for (int64_t start : {-10, 0, 3, 999, 1000, 74999, 75000, 75003, 80000, 174999, 175100, 200000}) {
+            std::vector<Record> records = s.readRange(start, start + 40);
+            auto first = std::lower_bound(expected.begin(), expected.end(), start,
+                                          [](const Record& r, int64_t ts) { return r.timestamp < ts; });
+            auto last = std::upper_bound(first, expected.end(), start + 40,
+                                         [](int64_t ts, const Record& r) { return ts < r.timestamp; });
+            ASSERT_EQ(records.size(), static_cast<size_t>(last - first)) << start;
+            for (size_t i = 0; i < records.size(); ++i) {
+                EXPECT_EQ(records[i].timestamp, first[i].timestamp);
+            }
+        }
+        EXPECT_EQ(s.readFromTime(180012)->value, 16002.0);
+    };
+
+    {
+        Storage s(filename, options);
+        EXPECT_GT(s.getLearnedSegmentCount(), 0);
+        expectReads(s);
+    }
+    EXPECT_TRUE(std::filesystem::exists(learnedFilename));
+
+    //a sidecar fitted with another bound is refitted rather than trusted
+    options.learnedIndexError = 2;
+    {
+        Storage s(filename, options);
+        expectReads(s);
+    }
+
+    options.learnedIndexError = 0;
+    {
+        Storage s(filename, options);
+        EXPECT_EQ(s.getLearnedSegmentCount(), 0);
+        expectReads(s);
+    }
+
+    Storage::removeFiles(filename);
+    EXPECT_FALSE(std::filesystem::exists(learnedFilename));
+}
+
+TEST(StorageTest, DurableAppendsCompleteInEveryMode) {
+    const char* filename = "testdb.tsdb";
+
+    for (uint8_t version : {1, 2}) {
+        for (DurabilityMode mode : {DurabilityMode::Fsync, DurabilityMode::Fdatasync, DurabilityMode::Periodic, DurabilityMode::Buffered}) {
+            Storage::removeFiles(filename);
+
+            StorageOptions options;
+            options.formatVersion = version;
+            options.sparseIndexStep = 16;
+            options.durability = mode;
+            options.syncInterval = std::chrono::hours(1);
+
+            {
+                Storage s(filename, options);
+                EXPECT_EQ(s.getDurability(), mode);
+                for (int i = 0; i < 100; ++i) {
+                    s.append(Record{i, static_cast<double>(i)});
+                }
+
+                //a durable append is acknowledged once its batch is on disk, even when the mode would not sync it
+                std::future<bool> acked = s.appendDurable(Record{100, 100.0});
+                ASSERT_EQ(acked.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+                EXPECT_TRUE(acked.get());
+                EXPECT_EQ(s.getRecordCount(), 101);
+
+                EXPECT_FALSE(s.appendDurable(Record{50, 0.0}).get());
+
+                for (int i = 101; i < 150; ++i) {
+                    s.append(Record{i, static_cast<double>(i)});
+                }
+            }
+
+            //buffered records are synced and readable after a clean close
+            Storage reopened(filename, options);
+            ASSERT_EQ(reopened.getRecordCount(), 150) << static_cast<int>(mode);
+            EXPECT_EQ(reopened.readRange(95, 105).size(), 11);
+        }
+    }
+
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, FailedFlushFailsDurableAppends) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    //files may not grow past 1000 bytes, so writing the first batch fails part way
+    std::signal(SIGXFSZ, SIG_IGN);
+    rlimit original{};
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &original), 0);
+    rlimit limited = original;
+    limited.rlim_cur = 1000;
+
+    std::vector<Record> batch;
+    for (int64_t ts = 0; ts < 100; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+
+    {
+        Storage s(filename);
+        ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limited), 0);
+        EXPECT_EQ(s.appendBatch(batch).accepted, 100);
+
+        std::future<bool> acked = s.appendDurable(Record{100, 100.0});
+        ASSERT_EQ(acked.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+        EXPECT_THROW(acked.get(), std::runtime_error);
+
+        //the error sticks instead of taking the process down, and nothing more is written
+        EXPECT_THROW(s.append(Record{101, 1.0}), std::runtime_error);
+        EXPECT_THROW(s.appendBatch(batch), std::runtime_error);
+        EXPECT_THROW(s.appendDurable(Record{102, 1.0}).get(), std::runtime_error);
+    }
+
+    ::setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, SIG_DFL);
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, IngestRingKeepsEveryProducerInOrder) {
+    //a small ring so producers keep wrapping and waiting on the consumer
+    MpscRing<Record> ring(64);
+    EXPECT_EQ(ring.getCapacity(), 64);
+
+    const int producerCount = 4;
+    const int recordsPerProducer = 5000;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p) {
+        producers.emplace_back([&ring, p]() {
+            for (int i = 0; i < recordsPerProducer; ++i) {
+                ring.push(Record{i, static_cast<double>(p), 0});
+            }
+        });
+    }
+
+    std::vector<Record> drained;
+    while (drained.size() < producerCount * recordsPerProducer) {
+        if (ring.drain(drained) == 0) std::this_thread::yield();
+    }
+    for (auto& producer : producers) producer.join();
+
+    EXPECT_EQ(ring.drain(drained), 0);
+    EXPECT_EQ(ring.drained(), producerCount * recordsPerProducer);
+
+    std::vector<int64_t> next(producerCount, 0);
+    for (const Record& r : drained) {
+        int p = static_cast<int>(r.value);
+        ASSERT_EQ(r.timestamp, next[p]);
+        ++next[p];
+    }
+    for (int64_t count : next) EXPECT_EQ(count, recordsPerProducer);
+}
+
+TEST(StorageTest, MergeSortedRunsMatchesStableSort) {
+    std::mt19937 rng(7);
+    for (size_t runCount : {1, 2, 3, 8, 64}) {
+        std::vector<std::vector<Record>> runs(runCount);
+        std::vector<Record> expected;
+        for (size_t run = 0; run < runCount; ++run) {
+            //small steps so equal timestamps show up across runs
+            int64_t ts = static_cast<int64_t>(rng() % 10);
+            size_t length = rng() % 200;
+            for (size_t i = 0; i < length; ++i) {
+                ts += static_cast<int64_t>(rng() % 3);
+                runs[run].push_back(Record{ts, static_cast<double>(run), static_cast<int32_t>(i)});
+            }
+            expected.insert(expected.end(), runs[run].begin(), runs[run].end());
+        }
+        std::stable_sort(expected.begin(), expected.end(),
+                         [](const Record& a, const Record& b) { return a.timestamp < b.timestamp; });
+
+        std::vector<Record> merged;
+        mergeSortedRuns(runs, merged);
+        ASSERT_EQ(merged.size(), expected.size());
+        for (size_t i = 0; i < merged.size(); ++i) {
+            EXPECT_EQ(merged[i].timestamp, expected[i].timestamp);
+            EXPECT_EQ(merged[i].value, expected[i].value);
+            EXPECT_EQ(merged[i].crc, expected[i].crc);
+        }
+    }
+}
+
+TEST(StorageTest, OneThreadKeepsOneLanePerDatabase) {
+    //many open databases written round robin from one thread
+    std::vector<std::string> filenames;
+    std::vector<std::unique_ptr<Storage>> storages;
+    for (int i = 0; i < 40; ++i) {
+        filenames.push_back("testlanes" + std::to_string(i) + ".tsdb");
+        Storage::removeFiles(filenames.back());
+        storages.push_back(std::make_unique<Storage>(filenames.back()));
+    }
+
+    for (int64_t round = 0; round < 20; ++round) {
+        for (auto& s : storages) EXPECT_TRUE(s->append(Record{round, 1.0}));
+    }
+    for (auto& s : storages) {
+        EXPECT_EQ(s->getLaneCount(), 1);
+        EXPECT_EQ(s->readAll().size(), 20);
+    }
+
+    storages.clear();
+    for (const std::string& filename : filenames) Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, ExitedThreadsHandBackTheirLanes) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    {
+        StorageOptions options;
+        options.maxFlushLatency = std::chrono::hours(1);
+        Storage s(filename, options);
+
+        //each producer exits before the next starts, so they all share one lane in turn
+        for (int64_t p = 0; p < 200; ++p) {
+            std::thread producer([&]() {
+                EXPECT_TRUE(s.append(Record{1000 - p, 1.0}));
+                EXPECT_EQ(s.getLaneCount(), 1);
+            });
+            producer.join();
+            EXPECT_EQ(s.getLaneCount(), 0);
+        }
+
+        //a new thread inherits none of the history of the lane it reuses, even one whose id is reused
+        std::thread late([&]() { EXPECT_TRUE(s.append(Record{500, 2.0})); });
+        late.join();
+        EXPECT_EQ(s.readAll().size(), 201);
+    }
+
+    Storage s(filename);
+    EXPECT_EQ(s.getRecordCount(), 201);
+    EXPECT_EQ(s.readRange(500, 500).size(), 1);
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, ConcurrentAppendsAreAllFlushed) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    std::atomic<size_t> accepted{0};
+    {
+        StorageOptions options;
+        options.durability = DurabilityMode::Buffered;
+        Storage s(filename, options);
+
+        std::atomic<int64_t> clock{0};
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 4; ++p) {
+            producers.emplace_back([&]() {
+                for (int i = 0; i < 50000; ++i) {
+                    if (s.append(Record{clock.fetch_add(1), 1.0})) ++accepted;
+                }
+            });
+        }
+        for (auto& producer : producers) producer.join();
+    }
+
+    //every accepted record reaches the file in order, including those still in the ring at close
+    Storage s(filename);
+    EXPECT_GT(accepted.load(), 0);
+    EXPECT_EQ(s.getRecordCount(), accepted.load());
+    std::vector<Record> records = s.readAll();
+    EXPECT_TRUE(std::is_sorted(records.begin(), records.end(), [](const Record& a, const Record& b) { return a.timestamp < b.timestamp; }));
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, FlushesOnThresholdDeadlineAndClose) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    auto waitForCount = [](const Storage& s, size_t count) {
+        for (int i = 0; i < 400 && s.getRecordCount() < count; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return s.getRecordCount();
+    };
+
+    {
+        //a far deadline leaves the record threshold as the only trigger
+        StorageOptions options;
+        options.flushThresholdRecords = 100;
+        options.maxFlushLatency = std::chrono::seconds(30);
+        Storage s(filename, options);
+
+        for (int i = 0; i < 100; ++i) {
+            s.append(Record{i, static_cast<double>(i)});
+        }
+        EXPECT_EQ(waitForCount(s, 100), 100);
+
+        for (int i = 100; i < 105; ++i) {
+            s.append(Record{i, static_cast<double>(i)});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_EQ(s.getRecordCount(), 100);
+
+        FlushStats stats = s.getFlushStats();
+        EXPECT_EQ(stats.thresholdFlushes, 1);
+        EXPECT_EQ(stats.deadlineFlushes, 0);
+        EXPECT_EQ(stats.records, 100);
+        EXPECT_EQ(stats.bytes, 100 * sizeof(Record));
+        EXPECT_EQ(stats.syncs, 1);
+    }
+
+    {
+        //the queued tail is written on close
+        Storage s(filename);
+        EXPECT_EQ(s.getRecordCount(), 105);
+    }
+
+    {
+        StorageOptions options;
+        options.maxFlushLatency = std::chrono::milliseconds(20);
+        Storage s(filename, options);
+
+        auto start = std::chrono::steady_clock::now();
+        s.append(Record{200, 1.0});
+        s.append(Record{201, 2.0});
+        EXPECT_EQ(waitForCount(s, 107), 107);
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(15));
+
+        //nothing queued means no further flushes
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        FlushStats stats = s.getFlushStats();
+        EXPECT_EQ(stats.flushes, 1);
+        EXPECT_EQ(stats.deadlineFlushes, 1);
+        EXPECT_EQ(stats.largestBatch, 2);
+        EXPECT_GE(stats.longestIngestLatency, 15000);
+    }
+
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, AppendBatchAcceptsOnlyIncreasingRecords) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    {
+        StorageOptions options;
+        options.flushThresholdRecords = 1000;
+        Storage s(filename, options);
+
+        //an ordered batch larger than the threshold is taken whole
+        std::vector<Record> batch;
+        for (int i = 0; i < 20000; ++i) {
+            batch.push_back(Record{i, static_cast<double>(i)});
+        }
+        BatchAppendResult result = s.appendBatch(batch);
+        EXPECT_EQ(result.accepted, 20000);
+        EXPECT_EQ(result.rejected, 0);
+        EXPECT_EQ(s.appendBatch({}).accepted, 0);
+
+        for (int i = 0; i < 400 && s.getRecordCount() < 20000; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        ASSERT_EQ(s.getRecordCount(), 20000);
+
+        //old, duplicate and out of order records are dropped and the rest kept in order
+        std::vector<Record> mixed = {{19999, 0.0}, {20000, 1.0}, {20002, 2.0}, {20001, 3.0}, {20002, 4.0}, {20005, 5.0}};
+        result = s.appendBatch(mixed);
+        EXPECT_EQ(result.accepted, 3);
+        EXPECT_EQ(result.rejected, 3);
+    }
+
+    Storage s(filename);
+    std::vector<Record> records = s.readAll();
+    ASSERT_EQ(records.size(), 20003);
+    EXPECT_EQ(records[19999].timestamp, 19999);
+    EXPECT_EQ(records[20000].timestamp, 20000);
+    EXPECT_EQ(records[20001].timestamp, 20002);
+    EXPECT_EQ(records[20001].value, 2.0);
+    EXPECT_EQ(records[20002].timestamp, 20005);
+}
+
+TEST(StorageTest, UnflushedRecordsAreReadable) {
+    const char* filename = "testdb.tsdb";
+
+    for (uint8_t formatVersion : {1, 2}) {
+        Storage::removeFiles(filename);
+        {
+            Storage s(filename, StorageOptions{.formatVersion = formatVersion});
+            for (int i = 0; i < 100; ++i) {
+                s.append(Record{i, static_cast<double>(i)});
+            }
+        }
+
+        //a far deadline and threshold keep everything appended below in the memtable
+        StorageOptions options;
+        options.formatVersion = formatVersion;
+        options.flushThresholdRecords = 1 << 20;
+        options.maxFlushLatency = std::chrono::seconds(30);
+        Storage s(filename, options);
+        for (int i = 100; i < 150; ++i) {
+            s.append(Record{i, static_cast<double>(i)});
+        }
+
+        std::vector<Record> range = s.readRange(90, 120);
+        ASSERT_EQ(range.size(), 31);
+        for (size_t i = 0; i < range.size(); ++i) {
+            EXPECT_EQ(range[i].timestamp, 90 + static_cast<int64_t>(i));
+        }
+
+        EXPECT_EQ(s.readFromTime(130)->value, 130.0);
+        EXPECT_EQ(s.getLastRecord()->timestamp, 149);
+        EXPECT_EQ(s.getLastTimestamp(), 149);
+        EXPECT_EQ(s.readAll().size(), 150);
+        EXPECT_EQ(*s.aggregate(95, 104, AggregateFunction::Sum), 995.0);
+        EXPECT_EQ(*s.aggregate(0, 200, AggregateFunction::Last), 149.0);
+
+        //the 50 unflushed records are handed out in chunks no larger than the file's
+        size_t visited = 0;
+        size_t chunks = 0;
+        RangeCursor cursor = s.cursor(50, 149, 16);
+        for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next()) {
+            EXPECT_LE(chunk.size(), 16);
+            ++chunks;
+            for (const Record& r : chunk) EXPECT_EQ(r.timestamp, 50 + static_cast<int64_t>(visited++));
+            EXPECT_EQ(cursor.done(), visited == 100);
+        }
+        EXPECT_EQ(visited, 100);
+        EXPECT_EQ(chunks, 4 + 4);
+        EXPECT_TRUE(cursor.done());
+
+        //nothing was written to make them visible
+        EXPECT_EQ(s.getRecordCount(), 100);
+        EXPECT_EQ(s.getFlushStats().flushes, 0);
+    }
+
+    Storage s(filename);
+    EXPECT_EQ(s.getRecordCount(), 150);
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, ReorderWindowAcceptsLateRecords) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    auto timestamps = [](const std::vector<Record>& records) {
+        std::vector<int64_t> out;
+        for (const Record& r : records) out.push_back(r.timestamp);
+        return out;
+    };
+
+    {
+        StorageOptions options;
+        options.reorderWindow = 30;
+        options.maxFlushLatency = std::chrono::milliseconds(1);
+        Storage s(filename, options);
+
+        //late records within the window are held and read back in order
+        EXPECT_TRUE(s.append(Record{100, 1.0}));
+        EXPECT_TRUE(s.append(Record{90, 2.0}));
+        EXPECT_FALSE(s.append(Record{70, 3.0}));
+        EXPECT_TRUE(s.append(Record{75, 4.0}));
+        EXPECT_EQ(timestamps(s.readAll()), (std::vector<int64_t>{75, 90, 100}));
+
+        //a producer repeating its own timestamp is rejected, in a batch too; another producer's record with a
+        //held timestamp is kept after the one already held
+        EXPECT_FALSE(s.append(Record{90, 2.5}));
+        std::thread repeater([&]() { EXPECT_TRUE(s.append(Record{75, 4.5})); });
+        repeater.join();
+        BatchAppendResult repeated = s.appendBatch(std::vector<Record>{{95, 0.0}, {80, 0.0}, {95, 1.0}, {100, 0.0}});
+        EXPECT_EQ(repeated.accepted, 2);
+        EXPECT_EQ(repeated.rejected, 2);
+        std::vector<Record> held = s.readAll();
+        EXPECT_EQ(timestamps(held), (std::vector<int64_t>{75, 75, 80, 90, 95, 100}));
+        EXPECT_EQ(held[0].value, 4.0);
+        EXPECT_EQ(held[1].value, 4.5);
+
+        //a newer record moves the window on, so what falls behind it is written and later records must clear it
+        EXPECT_TRUE(s.append(Record{200, 5.0}));
+        EXPECT_EQ(s.getLastTimestamp(), 200);
+        for (int i = 0; i < 400 && s.getRecordCount() < 6; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_EQ(s.getRecordCount(), 6);
+
+        EXPECT_FALSE(s.append(Record{150, 6.0}));
+        EXPECT_TRUE(s.append(Record{180, 7.0}));
+
+        //another producer is held to the same window
+        std::thread producer([&]() {
+            EXPECT_FALSE(s.append(Record{160, 8.0}));
+            EXPECT_TRUE(s.append(Record{175, 9.0}));
+        });
+        producer.join();
+        EXPECT_EQ(timestamps(s.readRange(100, 300)), (std::vector<int64_t>{100, 175, 180, 200}));
+
+        //a durable append writes the window out up to its own record; the rest of it stays open to every producer
+        EXPECT_TRUE(s.appendDurable(Record{190, 10.0}).get());
+        EXPECT_EQ(s.getRecordCount(), 9);
+        EXPECT_FALSE(s.append(Record{185, 11.0}));
+        EXPECT_TRUE(s.append(Record{195, 11.0}));
+        EXPECT_TRUE(s.append(Record{201, 12.0}));
+        std::thread late([&]() {
+            EXPECT_FALSE(s.append(Record{188, 13.0}));
+            EXPECT_TRUE(s.append(Record{192, 13.0}));
+        });
+        late.join();
+    }
+
+    Storage s(filename);
+    EXPECT_EQ(timestamps(s.readAll()), (std::vector<int64_t>{75, 75, 80, 90, 95, 100, 175, 180, 190, 192, 195, 200, 201}));
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, ReorderWindowHoldsEveryProducerAlike) {
+    const char* filename = "testdb.tsdb";
+
+    //whether the window behind one producer's records is flushed yet does not change what another may append
+    for (bool flushed : {false, true}) {
+        Storage::removeFiles(filename);
+        StorageOptions options;
+        options.reorderWindow = 50;
+        options.maxFlushLatency = flushed ? std::chrono::milliseconds(1) : std::chrono::milliseconds(std::chrono::hours(1));
+        Storage s(filename, options);
+
+        for (int64_t ts = 0; ts <= 100; ++ts) EXPECT_TRUE(s.append(Record{ts, 0.0}));
+        for (int i = 0; flushed && i < 400 && s.getRecordCount() < 51; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_EQ(s.getRecordCount(), flushed ? 51 : 0);
+
+        std::thread producer([&]() {
+            EXPECT_FALSE(s.append(Record{40, 1.0}));
+            EXPECT_FALSE(s.append(Record{50, 1.0}));
+            EXPECT_TRUE(s.append(Record{60, 1.0}));
+            EXPECT_TRUE(s.append(Record{100, 1.0}));
+            BatchAppendResult batch = s.appendBatch(std::vector<Record>{{45, 1.0}, {51, 1.0}, {120, 1.0}});
+            EXPECT_EQ(batch.accepted, 2);
+            EXPECT_EQ(batch.rejected, 1);
+        });
+        producer.join();
+
+        //the newer record moves the window on for the first producer too
+        EXPECT_FALSE(s.append(Record{65, 0.0}));
+        EXPECT_TRUE(s.append(Record{105, 0.0}));
+        EXPECT_EQ(s.readRange(51, 51).size(), 2);
+        EXPECT_EQ(s.readRange(60, 60).size(), 2);
+        EXPECT_EQ(s.readRange(100, 100).size(), 2);
+        EXPECT_EQ(s.readAll().size(), 106);
+    }
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, RecordsSharingATimestampAreAllKept) {
+    const char* filename = "testdb.tsdb";
+
+    //producers writing the same timestamps, split across blocks and segments by the close flush
+    for (uint8_t version : {1, 2}) {
+        Storage::removeFiles(filename);
+        {
+            StorageOptions options;
+            options.formatVersion = version;
+            options.sparseIndexStep = 4;
+            options.segmentBytes = 10 * sizeof(Record);
+            options.maxFlushLatency = std::chrono::hours(1);
+            Storage s(filename, options);
+
+            std::vector<std::thread> producers;
+            for (int p = 0; p < 3; ++p) {
+                producers.emplace_back([&, p]() {
+                    for (int64_t ts = 0; ts < 50; ++ts) EXPECT_TRUE(s.append(Record{ts, static_cast<double>(p)}));
+                });
+            }
+            for (auto& t : producers) t.join();
+        }
+
+        Storage s(filename);
+        std::vector<Record> records = s.readAll();
+        ASSERT_EQ(records.size(), 150);
+        for (size_t i = 1; i < records.size(); ++i) EXPECT_LE(records[i - 1].timestamp, records[i].timestamp);
+        for (int64_t ts : {0, 17, 33, 49}) EXPECT_EQ(s.readRange(ts, ts).size(), 3);
+    }
+
+    //a durable append that is acknowledged is on disk, whichever producer wrote the timestamp first
+    Storage::removeFiles(filename);
+    int acknowledged = 0;
+    {
+        Storage s(filename);
+        std::future<bool> first;
+        std::thread producer([&]() { first = s.appendDurable(Record{100, 1.0}); });
+        std::future<bool> second = s.appendDurable(Record{100, 2.0});
+        producer.join();
+        acknowledged = first.get() + second.get();
+    }
+    EXPECT_GE(acknowledged, 1);
+    EXPECT_EQ(Storage(filename).readAll().size(), acknowledged);
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, SegmentsRollOverAndPruneQueries) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    for (uint8_t version : {1, 2})
+    {
+        {
+            StorageOptions options;
+            options.formatVersion = version;
+            options.sparseIndexStep = 64;
+            options.segmentDuration = 1000;
+            Storage s(filename, options);
+            std::vector<Record> batch;
+            for (int64_t ts = 0; ts < 5000; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+            EXPECT_EQ(s.appendBatch(batch).accepted, 5000);
+        }
+
+        {
+            //one segment per window; the newest window stays in the active file
+            Storage s(filename);
+            std::vector<SegmentInfo> segments = s.getSegments();
+            ASSERT_EQ(segments.size(), 4);
+            EXPECT_EQ(segments[1].firstTimestamp, 1000);
+            EXPECT_EQ(segments[1].lastTimestamp, 1999);
+            EXPECT_EQ(segments[1].recordCount, 1000);
+            EXPECT_EQ(s.getOpenSegmentCount(), 0);
+
+            //only the segment overlapping the range is opened
+            std::vector<Record> range = s.readRange(2100, 2200);
+            ASSERT_EQ(range.size(), 101);
+            EXPECT_EQ(range.front().timestamp, 2100);
+            EXPECT_EQ(s.getOpenSegmentCount(), 1);
+
+            EXPECT_EQ(s.getRecordCount(), 5000);
+            EXPECT_EQ(s.getRecord(1500).timestamp, 1500);
+            EXPECT_EQ(s.getLastRecord()->timestamp, 4999);
+            EXPECT_EQ(s.summarize(0, 4999).count, 5000);
+
+            size_t visited = 0;
+            int64_t expected = 900;
+            RangeCursor cursor = s.cursor(900, 4100, 300);
+            for (std::span<const Record> chunk = cursor.next(); !chunk.empty(); chunk = cursor.next()) {
+                for (const Record& r : chunk) EXPECT_EQ(r.timestamp, expected++);
+                visited += chunk.size();
+            }
+            EXPECT_EQ(visited, 3201);
+
+            std::vector<Record> all = s.readAll();
+            ASSERT_EQ(all.size(), 5000);
+            for (size_t i = 0; i < all.size(); ++i) EXPECT_EQ(all[i].timestamp, static_cast<int64_t>(i));
+        }
+        EXPECT_TRUE(std::filesystem::exists(std::string(filename) + ".seg3"));
+        Storage::removeFiles(filename);
+        EXPECT_FALSE(std::filesystem::exists(std::string(filename) + ".seg0"));
+    }
+
+    //a size limit rolls over after a crash left the last rename undone
+    {
+        StorageOptions options;
+        options.segmentBytes = 100 * sizeof(Record);
+        Storage s(filename, options);
+        for (int64_t ts = 0; ts < 450; ++ts) s.append(Record{ts, 1.0});
+    }
+    for (const char* suffix : {"", ".idx"}) {
+        std::filesystem::remove(std::string(filename) + suffix);
+        std::filesystem::rename(std::string(filename) + ".seg3" + suffix, std::string(filename) + suffix);
+    }
+
+    {
+        Storage s(filename);
+        EXPECT_EQ(s.getSegments().size(), 4);
+        EXPECT_EQ(s.getRecordCount(), 400);
+        EXPECT_EQ(s.readRange(350, 360).size(), 11);
+        EXPECT_TRUE(s.append(Record{1000, 1.0}));
+        EXPECT_EQ(s.readAll().size(), 401);
+    }
+    Storage::removeFiles(filename);
+
+    //a crash after the rename but before the manifest named the segment leaves it to be adopted on open
+    for (uint8_t version : {1, 2})
+    {
+        StorageOptions options;
+        options.formatVersion = version;
+        options.sparseIndexStep = 10;
+        options.segmentBytes = 100 * sizeof(Record);
+        {
+            Storage s(filename, options);
+            for (int64_t ts = 0; ts < 450; ++ts) s.append(Record{ts, 1.0});
+        }
+        std::string manifest = std::string(filename) + ".manifest";
+        std::filesystem::resize_file(manifest, std::filesystem::file_size(manifest) - sizeof(SegmentInfo));
+
+        {
+            Storage s(filename, options);
+            std::vector<SegmentInfo> segments = s.getSegments();
+            ASSERT_EQ(segments.size(), 4);
+            EXPECT_EQ(segments[3].sequence, 3);
+            EXPECT_EQ(segments[3].firstTimestamp, 300);
+            EXPECT_EQ(segments[3].lastTimestamp, 399);
+            EXPECT_EQ(segments[3].recordCount, 100);
+            EXPECT_EQ(s.getRecordCount(), 450);
+            EXPECT_EQ(s.readRange(350, 360).size(), 11);
+        }
+        EXPECT_EQ(std::filesystem::file_size(manifest), 4 * sizeof(SegmentInfo));
+        Storage::removeFiles(filename);
+    }
+}
+
+TEST(StorageTest, RecordViewOutlivesRollover) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    StorageOptions options;
+    options.readMode = ReadMode::Mmap;
+    options.segmentDuration = 1000;
+    std::optional<RecordView> view;
+    {
+        Storage s(filename, options);
+        std::vector<Record> batch;
+        for (int64_t ts = 0; ts < 500; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+        EXPECT_EQ(s.appendBatch(batch).accepted, 500);
+        EXPECT_TRUE(s.appendDurable(Record{500, 500.0}).get());
+
+        view = s.readRangeView(100, 500);
+        ASSERT_EQ(view->size(), 401);
+
+        //the next window rolls the active file, whose mapping the view still points into
+        EXPECT_TRUE(s.appendDurable(Record{1000, 1000.0}).get());
+        ASSERT_EQ(s.getSegments().size(), 1);
+    }
+
+    //and the view stays readable after the database is closed
+    for (size_t i = 0; i < view->size(); ++i) {
+        EXPECT_EQ((*view)[i].timestamp, static_cast<int64_t>(100 + i));
+        EXPECT_EQ((*view)[i].value, static_cast<double>(100 + i));
+    }
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, RetentionDropsWholeSegments) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    //the count passes through the retained one while the batch is still being written, so wait for the drop
+    auto waitForDrop = [](const Storage& s, int64_t firstTimestamp) {
+        for (int i = 0; i < 400 && (s.getSegments().empty() || s.getSegments().front().firstTimestamp != firstTimestamp); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return s.getRecordCount();
+    };
+
+    std::vector<Record> batch;
+    for (int64_t ts = 0; ts < 1000; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+
+    {
+        //segments ending more than 250 before the newest record go; 700..799 still reaches past 749
+        StorageOptions options;
+        options.segmentDuration = 100;
+        options.retentionAge = 250;
+        options.maxFlushLatency = std::chrono::milliseconds(1);
+        Storage s(filename, options);
+        EXPECT_EQ(s.appendBatch(batch).accepted, 1000);
+
+        EXPECT_EQ(waitForDrop(s, 700), 300);
+        EXPECT_EQ(s.getSegments().front().firstTimestamp, 700);
+        EXPECT_EQ(s.getRecord(0).timestamp, 700);
+        //the files are unlinked once the manifest has dropped them
+        for (int i = 0; i < 400 && std::filesystem::exists(std::string(filename) + ".seg0"); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_FALSE(std::filesystem::exists(std::string(filename) + ".seg0"));
+        EXPECT_EQ(s.summarize(0, 999).count, 300);
+
+        std::vector<Record> all = s.readAll();
+        ASSERT_EQ(all.size(), 300);
+        EXPECT_EQ(all.front().timestamp, 700);
+
+        RangeCursor cursor = s.cursor(0, 999, 100);
+        EXPECT_EQ(cursor.next().front().timestamp, 700);
+    }
+
+    {
+        Storage s(filename);
+        EXPECT_EQ(s.readAll().size(), 300);
+    }
+    Storage::removeFiles(filename);
+
+    {
+        StorageOptions options;
+        options.segmentBytes = 100 * sizeof(Record);
+        options.retentionBytes = 250 * sizeof(Record);
+        options.maxFlushLatency = std::chrono::milliseconds(1);
+        Storage s(filename, options);
+        EXPECT_EQ(s.appendBatch(batch).accepted, 1000);
+
+        //the active file keeps 900..999, so one sealed segment fits under the limit
+        EXPECT_EQ(waitForDrop(s, 800), 200);
+        EXPECT_EQ(s.readRange(0, 999).front().timestamp, 800);
+    }
+    Storage::removeFiles(filename);
+
+    {
+        //segments compacted into blocks count at their size on disk, well under 24 bytes a record
+        StorageOptions options;
+        options.segmentDuration = 100;
+        options.compactionAge = 100;
+        options.compactionBytesPerSecond = 0;
+        Storage s(filename, options);
+        EXPECT_EQ(s.appendBatch(batch).accepted, 1000);
+        std::string last = std::string(filename) + ".seg7";
+        for (int i = 0; i < 400; ++i) {
+            std::ifstream inFile(last, std::ios::binary);
+            if (inFile.is_open() && Storage::validateAndReadHeader(inFile, last).version == 2) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    {
+        //raw, the limit would hold the active file and three segments
+        StorageOptions options;
+        options.segmentDuration = 100;
+        options.retentionBytes = 4 * (100 * sizeof(Record) + sizeof(TSDBHeader)) + 1000;
+        Storage s(filename, options);
+        EXPECT_EQ(s.getSegments().size(), 9);
+        EXPECT_EQ(s.readAll().size(), 1000);
+    }
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, CompactionSwapsColdSegmentsIntoBlocks) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    auto segmentVersion = [&](int sequence) {
+        std::string segment = std::string(filename) + ".seg" + std::to_string(sequence);
+        std::ifstream inFile(segment, std::ios::binary);
+        return Storage::validateAndReadHeader(inFile, segment).version;
+    };
+
+    std::vector<Record> batch;
+    for (int64_t ts = 0; ts < 1000; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+
+    {
+        //segments wholly older than 799 are cold: 0..699 in seven segments
+        StorageOptions options;
+        options.sparseIndexStep = 32;
+        options.segmentDuration = 100;
+        options.compactionAge = 200;
+        options.compactionBytesPerSecond = 100 * sizeof(Record) * 50;
+        options.maxFlushLatency = std::chrono::milliseconds(1);
+        Storage s(filename, options);
+
+        //readers never see a segment half swapped
+        std::atomic<bool> stop{false};
+        std::thread reader([&]() {
+            while (!stop) {
+                std::vector<Record> range = s.readRange(0, 699);
+                if (range.empty()) continue;
+                ASSERT_EQ(range.size(), 700);
+                ASSERT_EQ(range.back().timestamp, 699);
+            }
+        });
+
+        EXPECT_EQ(s.appendBatch(batch).accepted, 1000);
+        for (int i = 0; i < 600 && (s.getSegments().size() < 9 || segmentVersion(6) != 2); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        stop = true;
+        reader.join();
+
+        for (int sequence = 0; sequence < 7; ++sequence) EXPECT_EQ(segmentVersion(sequence), 2);
+        EXPECT_EQ(segmentVersion(7), 1);
+        EXPECT_FALSE(std::filesystem::exists(std::string(filename) + ".seg0.idx"));
+        EXPECT_EQ(s.summarize(0, 999).count, 1000);
+        EXPECT_EQ(s.getRecord(250).timestamp, 250);
+    }
+
+    Storage s(filename);
+    std::vector<Record> all = s.readAll();
+    ASSERT_EQ(all.size(), 1000);
+    for (size_t i = 0; i < all.size(); ++i) EXPECT_EQ(all[i].value, static_cast<double>(i));
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, SealedSegmentsOpenWithoutWrites) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+    std::string segment = std::string(filename) + ".seg0";
+
+    StorageOptions options;
+    options.sparseIndexStep = 32;
+    options.segmentDuration = 1000;
+    options.maxFlushLatency = std::chrono::milliseconds(1);
+    {
+        Storage s(filename, options);
+        for (int64_t ts = 0; ts < 2000; ++ts) ASSERT_TRUE(s.append(Record{ts, static_cast<double>(ts)}));
+    }
+
+    //a missing sidecar and a torn tail would both be repaired by a writable open
+    std::filesystem::remove(segment + ".idx");
+    std::filesystem::remove(segment + ".sum");
+    {
+        std::ofstream torn(segment, std::ios::binary | std::ios::app);
+        torn.write("torn", 4);
+    }
+    uintmax_t segmentSize = std::filesystem::file_size(segment);
+
+    //the compactor holds its own read only open of segment 0 while it is throttled mid copy
+    options.compactionAge = 500;
+    options.compactionBytesPerSecond = 1000;
+    {
+        Storage s(filename, options);
+        for (int i = 0; i < 600 && !std::filesystem::exists(segment + ".compact"); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        ASSERT_TRUE(std::filesystem::exists(segment + ".compact"));
+
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&]() {
+                for (int i = 0; i < 20; ++i) {
+                    std::vector<Record> range = s.readRange(0, 999);
+                    ASSERT_EQ(range.size(), 1000);
+                    ASSERT_EQ(range.back().value, 999.0);
+                }
+            });
+        }
+        for (std::thread& reader : readers) reader.join();
+        EXPECT_EQ(s.summarize(0, 999).count, 1000);
+
+        EXPECT_FALSE(std::filesystem::exists(segment + ".idx"));
+        EXPECT_FALSE(std::filesystem::exists(segment + ".sum"));
+        EXPECT_EQ(std::filesystem::file_size(segment), segmentSize);
+    }
+
+    //block segments do not get a head file either
+    Storage::removeFiles(filename);
+    options.formatVersion = 2;
+    options.compactionAge = 0;
+    {
+        Storage s(filename, options);
+        for (int64_t ts = 0; ts < 2000; ++ts) ASSERT_TRUE(s.append(Record{ts, static_cast<double>(ts)}));
+    }
+    std::filesystem::remove(segment + ".head");
+    {
+        Storage s(filename, options);
+        EXPECT_EQ(s.readRange(0, 999).size(), 992);
+        EXPECT_FALSE(std::filesystem::exists(segment + ".head"));
+    }
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, WriteAheadLogReplaysUncheckpointedRecords) {
+    const char* filename = "testdb.tsdb";
+    const char* crashed = "testcrash.tsdb";
+    const std::string stale = std::string(crashed) + ".stale";
+    Storage::removeFiles(filename);
+    Storage::removeFiles(crashed);
+    std::filesystem::remove(stale);
+
+    auto copyDatabase = [&]() {
+        Storage::removeFiles(crashed);
+        std::filesystem::copy_file(filename, crashed);
+        std::filesystem::copy_file(std::string(filename) + ".wal", std::string(crashed) + ".wal");
+    };
+
+    {
+        StorageOptions options;
+        options.writeAheadLog = true;
+        options.checkpointInterval = std::chrono::hours(1);
+        Storage s(filename, options);
+        for (int64_t ts = 1; ts < 50; ++ts) s.append(Record{ts, static_cast<double>(ts)});
+        EXPECT_TRUE(s.appendDurable(Record{50, 50.0}).get());
+
+        //durable in the log and readable, but not yet in the data file
+        EXPECT_EQ(s.getRecordCount(), 0);
+        EXPECT_EQ(s.readRange(10, 19).size(), 10);
+        EXPECT_EQ(s.getLastRecord()->timestamp, 50);
+        EXPECT_EQ(s.getFlushStats().checkpoints, 0);
+
+        //a copy taken now is what a crash would leave, torn trailing write included
+        copyDatabase();
+        std::filesystem::copy_file(std::string(crashed) + ".wal", stale);
+        std::ofstream(std::string(crashed) + ".wal", std::ios::binary | std::ios::app).write("torn", 4);
+    }
+
+    {
+        //replayed into the data file by an open without the log; the log goes once it is checkpointed
+        Storage s(crashed);
+        std::vector<Record> all = s.readAll();
+        ASSERT_EQ(all.size(), 50);
+        EXPECT_EQ(all.back().timestamp, 50);
+        EXPECT_EQ(s.getRecordCount(), 50);
+        EXPECT_FALSE(std::filesystem::exists(std::string(crashed) + ".wal"));
+    }
+
+    {
+        //close checkpointed everything
+        EXPECT_EQ(std::filesystem::file_size(std::string(filename) + ".wal"), 0);
+
+        StorageOptions options;
+        options.writeAheadLog = true;
+        options.checkpointRecords = 100;
+        options.maxFlushLatency = std::chrono::milliseconds(1);
+        Storage s(filename, options);
+        EXPECT_EQ(s.getRecordCount(), 50);
+
+        std::vector<Record> batch;
+        for (int64_t ts = 51; ts <= 300; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+        s.appendBatch(batch);
+        for (int i = 0; i < 400 && s.getFlushStats().checkpoints == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_GE(s.getFlushStats().checkpoints, 1);
+        EXPECT_EQ(s.readAll().size(), 300);
+    }
+    {
+        //a log whose checkpoint reached the file before the log was emptied replays nothing twice
+        Storage::removeFiles(crashed);
+        std::filesystem::copy_file(filename, crashed);
+        std::filesystem::rename(stale, std::string(crashed) + ".wal");
+        Storage s(crashed);
+        EXPECT_EQ(s.readAll().size(), 300);
+    }
+
+    Storage::removeFiles(filename);
+    Storage::removeFiles(crashed);
+}
+
+TEST(StorageTest, IoUringBackendMatchesBlocking) {
+    const char* filename = "testdb.tsdb";
+    Storage::removeFiles(filename);
+
+    //a kernel without io_uring leaves the ring null and everything below on the blocking calls
+    std::unique_ptr<IoRing> ring = IoRing::create(4);
+    if (ring) {
+        int fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        ASSERT_GE(fd, 0);
+        const char data[8] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h'};
+        EXPECT_TRUE(ring->queueWrite(fd, data, sizeof(data), 0, true));
+        EXPECT_TRUE(ring->queueSync(fd, true));
+        ring->wait();
+
+        char back[16] = {};
+        EXPECT_TRUE(ring->queueRead(fd, back, 4, 4));
+        ring->wait();
+        EXPECT_EQ(std::memcmp(back, data + 4, 4), 0);
+
+        //reading past the end moves fewer bytes than asked
+        EXPECT_TRUE(ring->queueRead(fd, back, sizeof(back), 0));
+        EXPECT_THROW(ring->wait(), std::runtime_error);
+
+        //a transfer one entry cannot describe and an entry past the ring's capacity are refused
+        EXPECT_FALSE(ring->queueRead(fd, back, IoRing::maxTransfer + 1, 0));
+        for (unsigned i = 0; i < ring->getCapacity(); ++i) EXPECT_TRUE(ring->queueSync(fd, true));
+        EXPECT_FALSE(ring->queueSync(fd, true));
+        ring->wait();
+        ::close(fd);
+        std::remove(filename);
+    }
+
+    const int64_t total = 100000;
+    for (bool writeAheadLog : {false, true}) {
+        Storage::removeFiles(filename);
+        {
+            StorageOptions options;
+            options.ioBackend = IoBackend::IoUring;
+            options.writeAheadLog = writeAheadLog;
+            options.checkpointRecords = 1 << 14;
+            options.maxFlushLatency = std::chrono::milliseconds(1);
+            Storage s(filename, options);
+            EXPECT_EQ(s.getIoBackend(), ring ? IoBackend::IoUring : IoBackend::Blocking);
+
+            std::vector<Record> batch;
+            for (int64_t ts = 0; ts < total; ++ts) {
+                batch.push_back(Record{ts, static_cast<double>(ts)});
+                if (batch.size() == 1000) {
+                    s.appendBatch(batch);
+                    batch.clear();
+                }
+            }
+            EXPECT_TRUE(s.appendDurable(Record{total, static_cast<double>(total)}).get());
+            EXPECT_GE(s.getFlushStats().syncs, 1);
+
+            //ranges long enough to need several rounds of chunk reads, and ones that stop mid chunk
+            for (auto [start, end] : std::vector<std::pair<int64_t, int64_t>>{{0, total}, {5000, 90000}, {70000, 70010}, {-10, -5}, {99990, 200000}}) {
+                std::vector<Record> records = s.readRange(start, end);
+                int64_t expected = std::max<int64_t>(std::min(end, total) - std::max<int64_t>(start, 0) + 1, 0);
+                ASSERT_EQ(static_cast<int64_t>(records.size()), expected) << start << " " << end;
+                for (size_t i = 0; i < records.size(); ++i) {
+                    ASSERT_EQ(records[i].timestamp, std::max<int64_t>(start, 0) + static_cast<int64_t>(i));
+                }
+            }
+        }
+
+        Storage s(filename);
+        std::vector<Record> all = s.readAll();
+        ASSERT_EQ(all.size(), static_cast<size_t>(total + 1));
+        for (size_t i = 0; i < all.size(); ++i) ASSERT_EQ(all[i].value, static_cast<double>(i));
+    }
+    Storage::removeFiles(filename);
+}
+
+TEST(StorageTest, IoUringFallsBackWithoutReadWriteOps) {
+    //kernels 5.1 to 5.5 set up a ring but cannot probe it for the read and write opcodes; a seccomp filter
+    //failing the probe stands in for one in a child process
+    auto withoutProbe = []() {
+        sock_filter filter[] = {
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_io_uring_register, 0, 1),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EINVAL),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        };
+        sock_fprog program{static_cast<unsigned short>(std::size(filter)), filter};
+        if (::prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0 || ::prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) != 0) return 2;
+        if (IoRing::create(4)) return 3;
+
+        const char* filename = "testdb.tsdb";
+        Storage::removeFiles(filename);
+        {
+            StorageOptions options;
+            options.ioBackend = IoBackend::IoUring;
+            options.maxFlushLatency = std::chrono::milliseconds(1);
+            Storage s(filename, options);
+            if (s.getIoBackend() != IoBackend::Blocking) return 4;
+
+            std::vector<Record> batch;
+            for (int64_t ts = 0; ts < 10000; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+            if (s.appendBatch(batch).accepted != batch.size() || !s.appendDurable(Record{10000, 1.0}).get()) return 5;
+
+            //a new thread has no read ring yet, so its scan takes the blocking reads
+            size_t read = 0;
+            std::thread([&]() { read = s.readRange(0, 10000).size(); }).join();
+            if (read != 10001) return 6;
+        }
+        Storage::removeFiles(filename);
+        return 0;
+    };
+    EXPECT_EXIT(std::_Exit(withoutProbe()), ::testing::ExitedWithCode(0), "");
+}
+
+TEST(StorageTest, SeriesEngineKeepsSeriesApartByName) {
+    const char* directory = "testengine";
+    SeriesEngine::removeFiles(directory);
+
+    {
+        SeriesEngine engine(directory);
+        for (int i = 0; i < 50; ++i) {
+            EXPECT_TRUE(engine.append("cpu", Record{100 + i, static_cast<double>(i)}));
+            EXPECT_TRUE(engine.append("mem", Record{i, static_cast<double>(-i)}));
+        }
+        std::vector<Record> batch = {{10, 1.0}, {20, 2.0}, {15, 3.0}, {30, 4.0}};
+        BatchAppendResult result = engine.appendBatch("disk", batch);
+        EXPECT_EQ(result.accepted, 3);
+        EXPECT_EQ(result.rejected, 1);
+
+        //each series keeps its own order, and everything is readable before a flush
+        EXPECT_FALSE(engine.append("cpu", Record{120, 0.0}));
+        EXPECT_TRUE(engine.append("mem", Record{120, 0.0}));
+        EXPECT_EQ(engine.readRange("cpu", 110, 119).size(), 10);
+        EXPECT_EQ(engine.readFromTime("mem", 7)->value, -7.0);
+        EXPECT_EQ(engine.getLastRecord("disk")->timestamp, 30);
+        EXPECT_TRUE(engine.readRange("missing", 0, 100).empty());
+        EXPECT_FALSE(engine.getLastRecord("missing").has_value());
+        EXPECT_THROW(engine.append("", Record{1, 1.0}), std::runtime_error);
+        EXPECT_EQ(engine.getSeriesCount(), 3);
+    }
+
+    SeriesEngine engine(directory);
+    EXPECT_EQ(engine.getSeriesNames(), (std::vector<std::string>{"cpu", "mem", "disk"}));
+    EXPECT_GT(engine.getChunkCount(), 0);
+
+    std::vector<Record> cpu = engine.readRange("cpu", 0, 1000);
+    ASSERT_EQ(cpu.size(), 50);
+    for (size_t i = 0; i < cpu.size(); ++i) {
+        EXPECT_EQ(cpu[i].timestamp, 100 + static_cast<int64_t>(i));
+        EXPECT_EQ(cpu[i].value, static_cast<double>(i));
+    }
+    EXPECT_EQ(engine.readRange("mem", 0, 1000).size(), 51);
+    EXPECT_EQ(engine.getLastRecord("mem")->timestamp, 120);
+    EXPECT_EQ(engine.getLastRecord("cpu")->timestamp, 149);
+    EXPECT_FALSE(engine.append("disk", Record{30, 0.0}));
+    EXPECT_TRUE(engine.append("disk", Record{31, 0.0}));
+
+    //a chunk file is not a database file of any version
+    std::string chunkFile = std::string(directory) + "/series.tsdb";
+    std::ifstream inFile(chunkFile, std::ios::binary);
+    EXPECT_THROW(Storage::validateAndReadHeader(inFile, chunkFile), std::runtime_error);
+    SeriesEngine::removeFiles(directory);
+}
+
+TEST(StorageTest, SeriesEngineDropsTornFlush) {
+    const char* directory = "testengine";
+    SeriesEngine::removeFiles(directory);
+
+    {
+        SeriesEngine engine(directory);
+        for (int i = 0; i < 10; ++i) engine.append("a", Record{i, 1.0});
+    }
+    {
+        SeriesEngine engine(directory);
+        for (int i = 10; i < 20; ++i) engine.append("a", Record{i, 1.0});
+        for (int i = 0; i < 5; ++i) engine.append("b", Record{i, 2.0});
+    }
+
+    //cutting into the second flush loses all of it, including the chunk that landed whole
+    std::string chunkFile = std::string(directory) + "/series.tsdb";
+    std::filesystem::resize_file(chunkFile, std::filesystem::file_size(chunkFile) - 10);
+
+    {
+        SeriesEngine engine(directory);
+        EXPECT_EQ(engine.getSeriesCount(), 2);
+        EXPECT_EQ(engine.readRange("a", 0, 100).size(), 10);
+        EXPECT_TRUE(engine.readRange("b", 0, 100).empty());
+        EXPECT_TRUE(engine.append("a", Record{10, 3.0}));
+    }
+
+    SeriesEngine engine(directory);
+    EXPECT_EQ(engine.readRange("a", 0, 100).size(), 11);
+    SeriesEngine::removeFiles(directory);
+}
+
+TEST(StorageTest, SeriesEngineKeepsFailedFlush) {
+    const char* directory = "testengine";
+    SeriesEngine::removeFiles(directory);
+
+    //files may not grow past 1000 bytes, so the first flush fails part way
+    std::signal(SIGXFSZ, SIG_IGN);
+    rlimit original{};
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &original), 0);
+    rlimit limited = original;
+    limited.rlim_cur = 1000;
+
+    std::vector<Record> batch;
+    for (int64_t ts = 0; ts < 100; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+
+    {
+        SeriesEngineOptions options;
+        options.chunkRecords = 10;
+        options.flushThresholdRecords = 10;
+        SeriesEngine engine(directory, options);
+        ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limited), 0);
+        EXPECT_EQ(engine.appendBatch("a", batch).accepted, 100);
+
+        //the error sticks instead of taking the process down, and the records stay readable
+        bool failed = false;
+        for (int i = 0; i < 500 && !failed; ++i) {
+            try {
+                engine.append("b", Record{i, 1.0});
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            } catch (const std::runtime_error&) {
+                failed = true;
+            }
+        }
+        EXPECT_TRUE(failed);
+        EXPECT_THROW(engine.appendBatch("a", batch), std::runtime_error);
+        EXPECT_EQ(engine.readRange("a", 0, 100).size(), 100);
+    }
+
+    ::setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, SIG_DFL);
+    SeriesEngine::removeFiles(directory);
+}
+
+TEST(StorageTest, SeriesEngineRollsAndRetainsSegments) {
+    const char* directory = "testengine";
+    SeriesEngine::removeFiles(directory);
+
+    SeriesEngineOptions options;
+    options.segmentDuration = 1000;
+    auto waitForSegments = [&](SeriesEngine& engine, size_t count) {
+        for (int i = 0; i < 500 && engine.getSegmentCount() != count; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return engine.getSegmentCount();
+    };
+
+    //each open writes one window, and the flush that reaches the next window seals the file before it
+    for (int64_t window = 0; window < 5; ++window) {
+        SeriesEngine engine(directory, options);
+        for (const char* name : {"a", "b"}) {
+            std::vector<Record> batch;
+            for (int64_t ts = window * 1000; ts < (window + 1) * 1000; ++ts) batch.push_back(Record{ts, 1.0});
+            EXPECT_EQ(engine.appendBatch(name, batch).accepted, 1000);
+        }
+    }
+
+    {
+        SeriesEngine engine(directory, options);
+        EXPECT_EQ(engine.getSegmentCount(), 4);
+        EXPECT_EQ(engine.readRange("a", 0, 4999).size(), 5000);
+        EXPECT_EQ(engine.readRange("b", 1500, 2500).size(), 1001);
+        EXPECT_EQ(engine.getLastRecord("b")->timestamp, 4999);
+    }
+
+    //segments whose records are all more than 2500 older than the newest go whole
+    options.retentionAge = 2500;
+    {
+        SeriesEngine engine(directory, options);
+        EXPECT_EQ(waitForSegments(engine, 2), 2);
+        EXPECT_EQ(engine.readRange("a", 0, 4999).size(), 3000);
+        EXPECT_FALSE(std::filesystem::exists(std::string(directory) + "/series.tsdb.seg0"));
+        EXPECT_TRUE(engine.append("a", Record{5000, 1.0}));
+    }
+
+    //the record above started a new window, so the active file holds only it; a byte limit below the
+    //active file's size leaves nothing else
+    options.retentionAge = 0;
+    options.retentionBytes = 1;
+    {
+        SeriesEngine engine(directory, options);
+        EXPECT_EQ(waitForSegments(engine, 0), 0);
+        EXPECT_EQ(engine.readRange("a", 0, 5000).size(), 1);
+        EXPECT_TRUE(engine.readRange("b", 0, 5000).empty());
+        EXPECT_EQ(engine.getLastRecord("b"), std::nullopt);
+    }
+
+    SeriesEngine::removeFiles(directory);
+    EXPECT_FALSE(std::filesystem::exists(directory));
+}
+
+TEST(StorageTest, SeriesEngineCompactsColdSegments) {
+    const char* directory = "testengine";
+    SeriesEngine::removeFiles(directory);
+
+    //every open leaves one chunk per series, four per window, and each new window seals the one before
+    SeriesEngineOptions options;
+    options.segmentDuration = 1000;
+    for (int64_t start = 0; start < 3000; start += 250) {
+        SeriesEngine engine(directory, options);
+        for (const char* name : {"a", "b"}) {
+            std::vector<Record> batch;
+            for (int64_t ts = start; ts < start + 250; ++ts) batch.push_back(Record{ts, static_cast<double>(ts)});
+            EXPECT_EQ(engine.appendBatch(name, batch).accepted, 250);
+        }
+    }
+
+    //only the first segment is entirely more than 1000 older than the newest record
+    options.compactionAge = 1000;
+    {
+        SeriesEngine engine(directory, options);
+        EXPECT_EQ(engine.getSegmentCount(), 2);
+        for (int i = 0; i < 500 && engine.getChunkCount() != 18; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(engine.getChunkCount(), 18);
+        std::vector<Record> records = engine.readRange("b", 500, 1500);
+        ASSERT_EQ(records.size(), 1001);
+        for (size_t i = 0; i < records.size(); ++i) EXPECT_EQ(records[i].value, static_cast<double>(500 + i));
+    }
+
+    //the compacted segment is marked and keeps its merged chunks
+    SeriesEngine engine(directory, options);
+    EXPECT_EQ(engine.getChunkCount(), 18);
+    EXPECT_EQ(engine.readRange("a", 0, 3000).size(), 3000);
+    EXPECT_FALSE(std::filesystem::exists(std::string(directory) + "/series.tsdb.seg0.compact"));
+    SeriesEngine::removeFiles(directory);
+}
+
+TEST(StorageTest, SeriesEngineReorderWindowAndDurableAppends) {
+    const char* directory = "testengine";
+    SeriesEngine::removeFiles(directory);
+
+    SeriesEngineOptions options;
+    options.reorderWindow = 30;
+    options.maxChunkAge = std::chrono::milliseconds(1);
+    {
+        SeriesEngine engine(directory, options);
+
+        //late records within their series' window are held and read back in order, and a repeat is rejected
+        EXPECT_TRUE(engine.append("a", Record{100, 1.0}));
+        EXPECT_TRUE(engine.append("a", Record{90, 2.0}));
+        EXPECT_FALSE(engine.append("a", Record{70, 3.0}));
+        EXPECT_FALSE(engine.append("a", Record{90, 4.0}));
+        EXPECT_TRUE(engine.append("b", Record{10, 5.0}));
+        BatchAppendResult batch = engine.appendBatch("a", std::vector<Record>{{95, 0.0}, {80, 0.0}, {95, 1.0}});
+        EXPECT_EQ(batch.accepted, 2);
+        EXPECT_EQ(batch.rejected, 1);
+        std::vector<Record> records = engine.readRange("a", 0, 200);
+        ASSERT_EQ(records.size(), 4);
+        for (size_t i = 1; i < records.size(); ++i) EXPECT_LT(records[i - 1].timestamp, records[i].timestamp);
+        EXPECT_EQ(engine.getLastRecord("a")->timestamp, 100);
+
+        //only what the window has left behind is written, however old the chunk gets
+        EXPECT_TRUE(engine.append("a", Record{200, 6.0}));
+        for (int i = 0; i < 500 && engine.getChunkCount() < 1; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_EQ(engine.getChunkCount(), 1);
+        EXPECT_FALSE(engine.append("a", Record{150, 7.0}));
+        EXPECT_TRUE(engine.append("a", Record{180, 7.0}));
+
+        //a durable append writes its series out up to its own record; the rest of the window stays open
+        EXPECT_TRUE(engine.appendDurable("a", Record{190, 8.0}).get());
+        EXPECT_EQ(engine.getChunkCount(), 2);
+        EXPECT_FALSE(engine.append("a", Record{185, 9.0}));
+        EXPECT_TRUE(engine.append("a", Record{195, 9.0}));
+        EXPECT_FALSE(engine.appendDurable("a", Record{195, 10.0}).get());
+        EXPECT_TRUE(engine.appendDurable("b", Record{5, 11.0}).get());
+    }
+
+    {
+        SeriesEngine engine(directory, options);
+        std::vector<Record> records = engine.readRange("a", 0, 300);
+        std::vector<int64_t> timestamps;
+        for (const Record& r : records) timestamps.push_back(r.timestamp);
+        EXPECT_EQ(timestamps, (std::vector<int64_t>{80, 90, 95, 100, 180, 190, 195, 200}));
+        EXPECT_EQ(engine.readRange("b", 0, 300).size(), 2);
+    }
+
+    //the log replays a series' records in the order they were appended
+    options.writeAheadLog = true;
+    options.maxChunkAge = std::chrono::hours(1);
+    options.checkpointInterval = std::chrono::hours(1);
+    const char* copy = "testengine.crashed";
+    SeriesEngine::removeFiles(copy);
+    {
+        SeriesEngine engine(directory, options);
+        for (int64_t ts : {310, 300, 305}) EXPECT_TRUE(engine.append("a", Record{ts, 1.0}));
+        EXPECT_TRUE(engine.appendDurable("c", Record{1, 1.0}).get());
+        std::filesystem::copy(directory, copy);
+    }
+    {
+        SeriesEngine engine(copy, options);
+        EXPECT_EQ(engine.readRange("a", 300, 400).size(), 3);
+        EXPECT_EQ(engine.getLastRecord("a")->timestamp, 310);
+    }
+
+    SeriesEngine::removeFiles(directory);
+    SeriesEngine::removeFiles(copy);
+}
+
+TEST(StorageTest, SeriesEngineReplaysWriteAheadLog) {
+    const char* directory = "testengine";
+    const char* copy = "testengine.crashed";
+    const char* unlogged = "testengine.unlogged";
+    SeriesEngine::removeFiles(directory);
+    SeriesEngine::removeFiles(copy);
+    SeriesEngine::removeFiles(unlogged);
+
+    //no chunk is due for an hour, so the records reach disk only through the log
+    SeriesEngineOptions options;
+    options.writeAheadLog = true;
+    options.maxChunkAge = std::chrono::hours(1);
+    options.checkpointInterval = std::chrono::hours(1);
+    std::string log = std::string(directory) + "/wal";
+    {
+        SeriesEngine engine(directory, options);
+        for (int64_t ts = 0; ts < 100; ++ts) {
+            EXPECT_TRUE(engine.append("a", Record{ts, static_cast<double>(ts)}));
+            EXPECT_TRUE(engine.append("b", Record{ts, -static_cast<double>(ts)}));
+        }
+        for (int i = 0; i < 500 && std::filesystem::file_size(log) != 200 * sizeof(LogEntry); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ(std::filesystem::file_size(log), 200 * sizeof(LogEntry));
+        EXPECT_EQ(engine.getChunkCount(), 0);
+
+        //what is on disk now is what a crash would leave, plus a torn entry at the end
+        std::filesystem::copy(directory, copy);
+        std::filesystem::copy(directory, unlogged);
+        std::ofstream(std::string(copy) + "/wal", std::ios::binary | std::ios::app) << "torn";
+    }
+
+    //closing checkpoints, so the log is empty and the chunks hold everything
+    EXPECT_EQ(std::filesystem::file_size(log), 0);
+
+    {
+        SeriesEngine engine(copy, options);
+        EXPECT_EQ(std::filesystem::file_size(std::string(copy) + "/wal"), 200 * sizeof(LogEntry));
+        std::vector<Record> records = engine.readRange("b", 0, 99);
+        ASSERT_EQ(records.size(), 100);
+        for (size_t i = 0; i < records.size(); ++i) EXPECT_EQ(records[i].value, -static_cast<double>(i));
+        EXPECT_FALSE(engine.append("a", Record{99, 1.0}));
+        EXPECT_TRUE(engine.append("a", Record{100, 1.0}));
+    }
+
+    //opening without the log writes out what it holds and removes it
+    options.writeAheadLog = false;
+    {
+        SeriesEngine engine(unlogged, options);
+        EXPECT_FALSE(std::filesystem::exists(std::string(unlogged) + "/wal"));
+        EXPECT_EQ(engine.getChunkCount(), 2);
+        EXPECT_EQ(engine.readRange("a", 0, 99).size(), 100);
+    }
+
+    SeriesEngine::removeFiles(directory);
+    SeriesEngine::removeFiles(copy);
+    SeriesEngine::removeFiles(unlogged);
+}
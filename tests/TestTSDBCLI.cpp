@@ -336,4 +336,174 @@ TEST(StorageTest, TestMonotonicAppendCommand) {
         "Failed to accept record.\n"
         "Failed to accept record.\n"
         );
-}
\ No newline at end of file
+}
+TEST(StorageTest, TestAppendBatchCommand) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    {
+        Storage s(filename);
+    }
+
+    TSDBCLI cli;
+    cli.handleCommand("use testdb");
+
+    testing::internal::CaptureStdout();
+    cli.handleCommand("appendbatch 1 1.5 2");
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "Invalid appendbatch command. Usage: appendbatch <timestamp> <value> [<timestamp> <value> ...]\n");
+
+    testing::internal::CaptureStdout();
+    cli.handleCommand("appendbatch 1 1.5 3 2.5 2 9.0");
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "2 records accepted, 1 rejected, pending persistence\n");
+}
+
+TEST(StorageTest, TestAggregateCommand) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    Storage s(filename);
+    s.append(Record{1000, 42.0});
+    s.append(Record{1500, 43.5});
+    s.append(Record{2000, 44.5});
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    TSDBCLI cli;
+
+    EXPECT_TRUE(cli.validateAggregateCommand("aggregate avg 1000 2000"));
+    EXPECT_FALSE(cli.validateAggregateCommand("aggregate median 1000 2000"));
+    EXPECT_FALSE(cli.validateAggregateCommand("aggregate sum 1000"));
+    EXPECT_FALSE(cli.validateAggregateCommand("aggregate sum 1000 2000 extra"));
+
+    cli.handleCommand("use testdb");
+
+    testing::internal::CaptureStdout();
+
+    cli.handleCommand("aggregate count 1000 1500");
+    cli.handleCommand("aggregate max 1000 2000");
+    cli.handleCommand("aggregate sum 1500 2500");
+    cli.handleCommand("aggregate min 3000 4000");
+    cli.handleCommand("aggregate median 1000 2000");
+
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output,
+        "count: 2\n"
+        "max: 44.5\n"
+        "sum: 88\n"
+        "No record found\n"
+        "Invalid aggregate command. Usage: aggregate <count|sum|min|max|avg|first|last> <start> <end>\n"
+        );
+}
+
+TEST(StorageTest, TestDownsampleCommand) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    Storage s(filename);
+    s.append(Record{1000, 1.0});
+    s.append(Record{1050, 3.0});
+    s.append(Record{1100, 5.0});
+    s.append(Record{1350, 7.0});
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    TSDBCLI cli;
+
+    EXPECT_TRUE(cli.validateDownsampleCommand("downsample avg 1000 2000 100"));
+    EXPECT_FALSE(cli.validateDownsampleCommand("downsample avg 1000 2000 0"));
+    EXPECT_FALSE(cli.validateDownsampleCommand("downsample avg 1000 2000"));
+
+    cli.handleCommand("use testdb");
+
+    testing::internal::CaptureStdout();
+
+    cli.handleCommand("downsample avg 1000 2000 100");
+    cli.handleCommand("downsample count 5000 6000 100");
+
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output,
+        "Timestamp: 1000, Value: 2\n"
+        "Timestamp: 1100, Value: 5\n"
+        "Timestamp: 1300, Value: 7\n"
+        "No record found\n"
+        );
+}
+
+TEST(StorageTest, TestStatsCommand) {
+    const char* filename = "testdb.tsdb";
+    std::remove(filename);
+
+    TSDBCLI cli;
+
+    testing::internal::CaptureStdout();
+    cli.handleCommand("stats");
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "No database selected. Use the 'use <database>' command to select a database.\n");
+
+    {
+        Storage s(filename);
+    }
+    cli.handleCommand("use testdb");
+
+    testing::internal::CaptureStdout();
+    cli.handleCommand("stats");
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output.rfind("Flushes: 0 (0 threshold, 0 deadline, 0 close)\n", 0), 0);
+    EXPECT_NE(output.find("Records flushed: 0 (0 bytes)\n"), std::string::npos);
+}
+
+TEST(StorageTest, TestSeriesCommands) {
+    const char* directory = "testengine.series";
+    SeriesEngine::removeFiles(directory);
+
+    {
+        TSDBCLI cli;
+
+        EXPECT_TRUE(cli.validateSeriesCommand("series testengine"));
+        EXPECT_FALSE(cli.validateSeriesCommand("series test/engine"));
+        EXPECT_TRUE(cli.validateSeriesAppendCommand("sappend cpu 1 1.5"));
+        EXPECT_FALSE(cli.validateSeriesAppendCommand("sappend cpu 1"));
+        EXPECT_FALSE(cli.validateSeriesReadRangeCommand("sreadrange cpu 1 2 3"));
+
+        testing::internal::CaptureStdout();
+        cli.handleCommand("sappend cpu 1 1.5");
+        std::string output = testing::internal::GetCapturedStdout();
+        EXPECT_EQ(output, "No engine selected. Use the 'series <engine>' command to select an engine.\n");
+
+        cli.handleCommand("series testengine");
+
+        testing::internal::CaptureStdout();
+        cli.handleCommand("slist");
+        cli.handleCommand("sappend cpu 1 1.5");
+        cli.handleCommand("sappend cpu 1 2.5");
+        cli.handleCommand("sappend mem 1 3.5");
+        cli.handleCommand("sappend cpu 2 4.5");
+        cli.handleCommand("sreadrange cpu 0 10");
+        cli.handleCommand("sreadrange disk 0 10");
+        cli.handleCommand("slist");
+        output = testing::internal::GetCapturedStdout();
+        EXPECT_EQ(output,
+            "No series found\n"
+            "Record accepted, pending persistence\n"
+            "Failed to accept record.\n"
+            "Record accepted, pending persistence\n"
+            "Record accepted, pending persistence\n"
+            "Timestamp: 1, Value: 1.5\n"
+            "Timestamp: 2, Value: 4.5\n"
+            "No record found\n"
+            "Series: cpu\n"
+            "Series: mem\n"
+            );
+
+        //reopening the engine finds what was appended
+        cli.handleCommand("series testengine");
+        testing::internal::CaptureStdout();
+        cli.handleCommand("sreadrange mem 0 10");
+        output = testing::internal::GetCapturedStdout();
+        EXPECT_EQ(output, "Timestamp: 1, Value: 3.5\n");
+    }
+
+    SeriesEngine::removeFiles(directory);
+}